@@ -0,0 +1,337 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT ams_ccs811
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "ccs811_emul.h"
+
+LOG_MODULE_REGISTER(ccs811_emul, CONFIG_SENSOR_LOG_LEVEL);
+
+/* Mailboxes, see the CCS811 datasheet */
+#define CCS811_EMUL_STATUS          0x00
+#define CCS811_EMUL_MEAS_MODE       0x01
+#define CCS811_EMUL_ALG_RESULT_DATA 0x02
+#define CCS811_EMUL_RAW_DATA        0x03
+#define CCS811_EMUL_ENV_DATA        0x05
+#define CCS811_EMUL_THRESHOLDS      0x10
+#define CCS811_EMUL_BASELINE        0x11
+#define CCS811_EMUL_HW_ID           0x20
+#define CCS811_EMUL_HW_VERSION      0x21
+#define CCS811_EMUL_FW_BOOT_VERSION 0x23
+#define CCS811_EMUL_FW_APP_VERSION  0x24
+#define CCS811_EMUL_ERROR_ID        0xE0
+#define CCS811_EMUL_APP_START       0xF4
+#define CCS811_EMUL_SW_RESET        0xFF
+
+#define CCS811_EMUL_STATUS_ERROR      BIT(0)
+#define CCS811_EMUL_STATUS_DATA_READY BIT(3)
+#define CCS811_EMUL_STATUS_APP_VALID  BIT(4)
+#define CCS811_EMUL_STATUS_FW_MODE    BIT(7)
+
+#define CCS811_EMUL_ERROR_WRITE_REG_INVALID BIT(0)
+#define CCS811_EMUL_ERROR_READ_REG_INVALID  BIT(1)
+#define CCS811_EMUL_ERROR_MEASMODE_INVALID  BIT(2)
+
+#define CCS811_EMUL_DRIVE_MODE(meas_mode) (((meas_mode) >> 4) & 0x07)
+/* Drive mode 4 only updates RAW_DATA */
+#define CCS811_EMUL_DRIVE_MODE_RAW        4
+
+/* Values of a CCS811 with application firmware 1.1.0 */
+#define CCS811_EMUL_HW_ID_VALUE      0x81
+#define CCS811_EMUL_HW_VERSION_VALUE 0x12
+#define CCS811_EMUL_FW_BOOT_VALUE    0x1000
+#define CCS811_EMUL_FW_APP_VALUE     0x1100
+#define CCS811_EMUL_BASELINE_VALUE   0x847B
+/* 14 uA through the sensor, 420/1023 of 1.65 V across it */
+#define CCS811_EMUL_RAW_VALUE        ((14 << 10) | 420)
+
+/* Written to SW_RESET after its address */
+static const uint8_t ccs811_emul_reset_key[] = {0x11, 0xE5, 0x72, 0x8A};
+
+/* Sampling interval of each drive mode, 0 for idle */
+static const uint16_t ccs811_emul_interval_ms[] = {0, 1000, 10000, 60000, 250};
+
+static const struct ccs811_emul_sample ccs811_emul_default_trace[] = {
+	{.ms = 0, .eco2 = 450, .tvoc = 10},
+};
+
+struct ccs811_emul_data {
+	/* Mailbox the next read returns */
+	uint8_t mailbox;
+	bool app_mode;
+	uint8_t meas_mode;
+	uint8_t error_id;
+	bool data_ready;
+	int64_t next_ms;
+	uint16_t eco2;
+	uint16_t tvoc;
+	uint8_t baseline[2];
+	/* Set from another thread than the one sampling the sensor */
+	struct k_spinlock trace_lock;
+	const struct ccs811_emul_sample *trace;
+	size_t trace_len;
+	uint32_t trace_period_ms;
+	int64_t trace_start_ms;
+};
+
+static uint8_t ccs811_emul_status(const struct ccs811_emul_data *data)
+{
+	return CCS811_EMUL_STATUS_APP_VALID | (data->app_mode ? CCS811_EMUL_STATUS_FW_MODE : 0) |
+	       (data->data_ready ? CCS811_EMUL_STATUS_DATA_READY : 0) |
+	       (data->error_id ? CCS811_EMUL_STATUS_ERROR : 0);
+}
+
+static void ccs811_emul_reset(struct ccs811_emul_data *data)
+{
+	data->mailbox = CCS811_EMUL_STATUS;
+	data->app_mode = false;
+	data->meas_mode = 0;
+	data->error_id = 0;
+	data->data_ready = false;
+	sys_put_be16(CCS811_EMUL_BASELINE_VALUE, data->baseline);
+}
+
+static void ccs811_emul_measure(struct ccs811_emul_data *data, int64_t at_ms)
+{
+	const struct ccs811_emul_sample *sample;
+	k_spinlock_key_t key;
+	int64_t t;
+	size_t i = 0;
+
+	if (CCS811_EMUL_DRIVE_MODE(data->meas_mode) != CCS811_EMUL_DRIVE_MODE_RAW) {
+		key = k_spin_lock(&data->trace_lock);
+		t = at_ms - data->trace_start_ms;
+		if (data->trace_period_ms > 0) {
+			t %= data->trace_period_ms;
+		}
+		while (i + 1 < data->trace_len && data->trace[i + 1].ms <= t) {
+			i++;
+		}
+		sample = &data->trace[i];
+		data->eco2 = sample->eco2;
+		data->tvoc = sample->tvoc;
+		k_spin_unlock(&data->trace_lock, key);
+	}
+
+	data->data_ready = true;
+}
+
+/* Take the sample due by now, the ones missed in between are lost. */
+static void ccs811_emul_update(struct ccs811_emul_data *data, int64_t now)
+{
+	uint16_t interval = ccs811_emul_interval_ms[CCS811_EMUL_DRIVE_MODE(data->meas_mode)];
+
+	if (!data->app_mode || interval == 0 || now < data->next_ms) {
+		return;
+	}
+
+	data->next_ms += (now - data->next_ms) / interval * interval;
+	ccs811_emul_measure(data, data->next_ms);
+	data->next_ms += interval;
+}
+
+static void ccs811_emul_write(struct ccs811_emul_data *data, const uint8_t *buf, size_t len,
+			      int64_t now)
+{
+	uint8_t drive_mode;
+
+	data->mailbox = buf[0];
+	buf++;
+	len--;
+
+	/* A bare address selects the mailbox of the next read */
+	if (len == 0 && data->mailbox != CCS811_EMUL_APP_START) {
+		return;
+	}
+
+	switch (data->mailbox) {
+	case CCS811_EMUL_APP_START:
+		if (len == 0 && !data->app_mode) {
+			data->app_mode = true;
+			return;
+		}
+		break;
+	case CCS811_EMUL_SW_RESET:
+		if (len == sizeof(ccs811_emul_reset_key) &&
+		    memcmp(buf, ccs811_emul_reset_key, len) == 0) {
+			ccs811_emul_reset(data);
+		}
+		/* Anything else is ignored */
+		return;
+	case CCS811_EMUL_MEAS_MODE:
+		if (!data->app_mode || len != 1) {
+			break;
+		}
+		drive_mode = CCS811_EMUL_DRIVE_MODE(buf[0]);
+		if (drive_mode >= ARRAY_SIZE(ccs811_emul_interval_ms)) {
+			data->error_id |= CCS811_EMUL_ERROR_MEASMODE_INVALID;
+			return;
+		}
+		data->meas_mode = buf[0];
+		data->next_ms = now + ccs811_emul_interval_ms[drive_mode];
+		return;
+	case CCS811_EMUL_BASELINE:
+		if (!data->app_mode || len != sizeof(data->baseline)) {
+			break;
+		}
+		memcpy(data->baseline, buf, len);
+		return;
+	case CCS811_EMUL_ENV_DATA:
+	case CCS811_EMUL_THRESHOLDS:
+		/* Accepted, they do not change the trace */
+		if (data->app_mode && len == 4) {
+			return;
+		}
+		break;
+	default:
+		break;
+	}
+
+	LOG_DBG("Invalid write of %zu bytes to 0x%02x", len, data->mailbox);
+	data->error_id |= CCS811_EMUL_ERROR_WRITE_REG_INVALID;
+}
+
+static void ccs811_emul_read(struct ccs811_emul_data *data, uint8_t *buf, size_t len)
+{
+	uint8_t mailbox[8] = {0};
+
+	/* Application mailboxes do not exist in the boot loader */
+	if (!data->app_mode && data->mailbox != CCS811_EMUL_STATUS &&
+	    data->mailbox < CCS811_EMUL_HW_ID) {
+		LOG_DBG("Read of mailbox 0x%02x in boot mode", data->mailbox);
+		data->error_id |= CCS811_EMUL_ERROR_READ_REG_INVALID;
+		memset(buf, 0, len);
+		return;
+	}
+
+	switch (data->mailbox) {
+	case CCS811_EMUL_STATUS:
+		mailbox[0] = ccs811_emul_status(data);
+		break;
+	case CCS811_EMUL_HW_ID:
+		mailbox[0] = CCS811_EMUL_HW_ID_VALUE;
+		break;
+	case CCS811_EMUL_HW_VERSION:
+		mailbox[0] = CCS811_EMUL_HW_VERSION_VALUE;
+		break;
+	case CCS811_EMUL_FW_BOOT_VERSION:
+		sys_put_be16(CCS811_EMUL_FW_BOOT_VALUE, mailbox);
+		break;
+	case CCS811_EMUL_FW_APP_VERSION:
+		sys_put_be16(CCS811_EMUL_FW_APP_VALUE, mailbox);
+		break;
+	case CCS811_EMUL_ERROR_ID:
+		mailbox[0] = data->error_id;
+		data->error_id = 0;
+		break;
+	case CCS811_EMUL_MEAS_MODE:
+		mailbox[0] = data->meas_mode;
+		break;
+	case CCS811_EMUL_ALG_RESULT_DATA:
+		sys_put_be16(data->eco2, &mailbox[0]);
+		sys_put_be16(data->tvoc, &mailbox[2]);
+		mailbox[4] = ccs811_emul_status(data);
+		mailbox[5] = data->error_id;
+		sys_put_be16(CCS811_EMUL_RAW_VALUE, &mailbox[6]);
+		data->data_ready = false;
+		break;
+	case CCS811_EMUL_RAW_DATA:
+		sys_put_be16(CCS811_EMUL_RAW_VALUE, mailbox);
+		data->data_ready = false;
+		break;
+	case CCS811_EMUL_BASELINE:
+		memcpy(mailbox, data->baseline, sizeof(data->baseline));
+		break;
+	default:
+		LOG_DBG("Invalid read of mailbox 0x%02x", data->mailbox);
+		data->error_id |= CCS811_EMUL_ERROR_READ_REG_INVALID;
+		break;
+	}
+
+	memcpy(buf, mailbox, MIN(len, sizeof(mailbox)));
+	if (len > sizeof(mailbox)) {
+		memset(&buf[sizeof(mailbox)], 0, len - sizeof(mailbox));
+	}
+}
+
+static int ccs811_emul_transfer(const struct emul *target, struct i2c_msg *msgs, int num_msgs,
+				int addr)
+{
+	struct ccs811_emul_data *data = target->data;
+	int64_t now = k_uptime_get();
+
+	ARG_UNUSED(addr);
+
+	ccs811_emul_update(data, now);
+
+	for (int i = 0; i < num_msgs; i++) {
+		if (msgs[i].flags & I2C_MSG_READ) {
+			ccs811_emul_read(data, msgs[i].buf, msgs[i].len);
+		} else if (msgs[i].len > 0) {
+			ccs811_emul_write(data, msgs[i].buf, msgs[i].len, now);
+		}
+	}
+
+	return 0;
+}
+
+int ccs811_emul_set_trace(const struct emul *target, const struct ccs811_emul_sample *trace,
+			  size_t len, uint32_t period_ms)
+{
+	struct ccs811_emul_data *data = target->data;
+	k_spinlock_key_t key;
+
+	if (len == 0 || trace[0].ms != 0 || (period_ms > 0 && trace[len - 1].ms >= period_ms)) {
+		return -EINVAL;
+	}
+	for (size_t i = 1; i < len; i++) {
+		if (trace[i].ms < trace[i - 1].ms) {
+			return -EINVAL;
+		}
+	}
+
+	key = k_spin_lock(&data->trace_lock);
+	data->trace = trace;
+	data->trace_len = len;
+	data->trace_period_ms = period_ms;
+	data->trace_start_ms = k_uptime_get();
+	k_spin_unlock(&data->trace_lock, key);
+
+	return 0;
+}
+
+static int ccs811_emul_init(const struct emul *target, const struct device *parent)
+{
+	struct ccs811_emul_data *data = target->data;
+
+	ARG_UNUSED(parent);
+
+	ccs811_emul_reset(data);
+	data->trace = ccs811_emul_default_trace;
+	data->trace_len = ARRAY_SIZE(ccs811_emul_default_trace);
+
+	return 0;
+}
+
+static const struct i2c_emul_api ccs811_emul_api_i2c = {
+	.transfer = ccs811_emul_transfer,
+};
+
+#define CCS811_EMUL(n)                                                                             \
+	static struct ccs811_emul_data ccs811_emul_data_##n;                                       \
+	EMUL_DT_INST_DEFINE(n, ccs811_emul_init, &ccs811_emul_data_##n, NULL,                      \
+			    &ccs811_emul_api_i2c, NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(CCS811_EMUL)
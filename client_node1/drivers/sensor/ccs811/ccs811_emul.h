@@ -0,0 +1,53 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_DRIVERS_SENSOR_CCS811_EMUL_H_
+#define ZEPHYR_DRIVERS_SENSOR_CCS811_EMUL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/emul.h>
+
+/*
+ * CCS811 emulated on an I2C emulation controller, for the Zephyr driver.
+ *
+ * The emulator holds the mailboxes of the sensor: it boots into the boot
+ * loader, starts the application on APP_START and goes back on a
+ * SW_RESET with the right key. In application mode it measures at the
+ * drive mode set in MEAS_MODE and raises DATA_READY until the result is
+ * read. Accessing a mailbox that does not exist in the current mode sets
+ * the ERROR bit of STATUS and the matching ERROR_ID bit, like the sensor.
+ *
+ * eCO2 and TVOC are taken from a trace of the values over time, constant
+ * until one is set.
+ */
+
+struct ccs811_emul_sample {
+	/* Milliseconds since the start of the trace */
+	uint32_t ms;
+	/* Equivalent CO2 in ppm */
+	uint16_t eco2;
+	/* TVOC in ppb */
+	uint16_t tvoc;
+};
+
+/**
+ * @brief Play measurements back from a trace, starting now.
+ *
+ * A sample applies from its ms on until the next one, whatever the drive
+ * mode.
+ *
+ * @param target Emulator of the sensor, EMUL_DT_GET() of its node
+ * @param trace Samples sorted by ms, the first one at 0; not copied
+ * @param len Number of samples
+ * @param period_ms Length of the trace, which then starts over; 0 to keep
+ *                  the last sample
+ *
+ * @return 0 if successful, -EINVAL if the trace is empty, unsorted or
+ *         longer than period_ms.
+ */
+int ccs811_emul_set_trace(const struct emul *target, const struct ccs811_emul_sample *trace,
+			  size_t len, uint32_t period_ms);
+
+#endif /* ZEPHYR_DRIVERS_SENSOR_CCS811_EMUL_H_ */
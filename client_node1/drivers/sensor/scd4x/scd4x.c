@@ -13,9 +13,10 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/pm/device.h>
 #include <zephyr/sys/byteorder.h>
-#include <zephyr/sys/crc.h>
 // #include <zephyr/devicetree.h>
 
+#include <iaq/sensirion.h>
+
 #include "scd4x.h"
 
 // enum sensor_attribute_scd4x {
@@ -40,24 +41,22 @@ const struct cmds_t scd4x_cmds[] = {
 
 LOG_MODULE_REGISTER(SCD4X, CONFIG_SENSOR_LOG_LEVEL);
 
-static uint8_t scd4x_calc_crc(uint16_t value)
+void scd4x_temperature_offset_decode(uint16_t word, struct sensor_value *val)
 {
-	uint8_t buf[2];
-
-	sys_put_be16(value, buf);
+	int32_t temp;
 
-	return crc8(buf, 2, SCD4X_CRC_POLY, SCD4X_CRC_INIT, false);
+	/*Calculation from Datasheet*/
+	temp = word * SCD4X_MAX_TEMP;
+	val->val1 = (int32_t)(temp / 0xFFFF);
+	val->val2 = ((temp % 0xFFFF) * 1000000) / 0xFFFF;
 }
 
 static int scd4x_write_command(const struct device *dev, uint8_t cmd)
 {
 	const struct scd4x_config *cfg = dev->config;
-	uint8_t tx_buf[2];
 	int ret;
 
-	sys_put_be16(scd4x_cmds[cmd].cmd, tx_buf);
-
-	ret = i2c_write_dt(&cfg->bus, tx_buf, sizeof(tx_buf));
+	ret = iaq_sensirion_write(&cfg->bus, scd4x_cmds[cmd].cmd, NULL, 0);
 
 	if (scd4x_cmds[cmd].cmd_duration_ms) {
 		k_msleep(scd4x_cmds[cmd].cmd_duration_ms);
@@ -71,20 +70,13 @@ static int scd4x_read_reg(const struct device *dev, uint8_t *rx_buf, uint8_t rx_
 	const struct scd4x_config *cfg = dev->config;
 	int ret;
 
-	ret = i2c_read_dt(&cfg->bus, rx_buf, rx_buf_size);
+	/* CRCs are checked in place, words are decoded from rx_buf by the caller */
+	ret = iaq_sensirion_read(&cfg->bus, rx_buf, rx_buf_size / IAQ_SENSIRION_WORD_SIZE);
 	if (ret < 0) {
 		LOG_ERR("Failed to read i2c data.");
 		return ret;
 	}
 
-	for (uint8_t i = 0; i < (rx_buf_size / 3); i++) {
-		ret = scd4x_calc_crc(sys_get_be16(&rx_buf[i * 3]));
-		if (ret != rx_buf[(i * 3) + 2]) {
-			LOG_ERR("Invalid CRC.");
-			return -EIO;
-		}
-	}
-
 	return 0;
 }
 
@@ -92,19 +84,8 @@ static int scd4x_write_reg(const struct device *dev, uint8_t cmd, uint16_t *data
 {
 	const struct scd4x_config *cfg = dev->config;
 	int ret;
-	uint8_t tx_buf[((data_size * 3) + 2)];
 
-	sys_put_be16(scd4x_cmds[cmd].cmd, tx_buf);
-
-	uint8_t tx_buf_pos = 2;
-
-	for (uint8_t i = 0; i < data_size; i++) {
-		sys_put_be16(data[i], &tx_buf[tx_buf_pos]);
-		tx_buf_pos += 2;
-		tx_buf[tx_buf_pos++] = scd4x_calc_crc(data[i]);
-	}
-
-	ret = i2c_write_dt(&cfg->bus, tx_buf, sizeof(tx_buf));
+	ret = iaq_sensirion_write(&cfg->bus, scd4x_cmds[cmd].cmd, data, data_size);
 	if (ret < 0) {
 		LOG_ERR("Failed to write i2c data.");
 		return ret;
@@ -116,7 +97,7 @@ static int scd4x_write_reg(const struct device *dev, uint8_t cmd, uint16_t *data
 	return 0;
 }
 
-static int scd4x_data_ready(const struct device *dev, bool *is_data_ready)
+int scd4x_data_ready(const struct device *dev, bool *is_data_ready)
 {
 	uint8_t rx_data[3];
 	int ret;
@@ -161,19 +142,19 @@ static int scd4x_read_sample(const struct device *dev)
 		return ret;
 	}
 
-	data->co2_sample = sys_get_be16(rx_data);
-	data->temp_sample = sys_get_be16(&rx_data[3]);
-	data->humi_sample = sys_get_be16(&rx_data[6]);
+	data->co2_sample = iaq_sensirion_get_u16(rx_data, 0);
+	data->temp_sample = iaq_sensirion_get_u16(rx_data, 1);
+	data->humi_sample = iaq_sensirion_get_u16(rx_data, 2);
 
 	return 0;
 }
 
 static int scd4x_setup_measurement(const struct device *dev)
 {
-	const struct scd4x_config *cfg = dev->config;
+	struct scd4x_data *data = dev->data;
 	int ret;
 
-	switch ((enum scd4x_mode_t)cfg->mode) {
+	switch (data->mode) {
 	case SCD4X_MODE_NORMAL:
 		ret = scd4x_write_command(dev, SCD4X_CMD_START_PERIODIC_MEASUREMENT);
 		if (ret < 0) {
@@ -189,6 +170,9 @@ static int scd4x_setup_measurement(const struct device *dev)
 		}
 		break;
 	case SCD4X_MODE_SINGLE_SHOT:
+		/* Shots are started by sample_fetch */
+		break;
+	case SCD4X_MODE_POWER_DOWN:
 		ret = scd4x_write_command(dev, SCD4X_CMD_POWER_DOWN);
 		if (ret < 0) {
 			LOG_ERR("Failed to write power_down command.");
@@ -203,10 +187,14 @@ static int scd4x_setup_measurement(const struct device *dev)
 
 static int scd4x_set_idle_mode(const struct device *dev)
 {
-	const struct scd4x_config *cfg = dev->config;
+	struct scd4x_data *data = dev->data;
 	int ret;
 
-	if (cfg->mode == SCD4X_MODE_SINGLE_SHOT) {
+	if (scd4x_mode_is_single_shot(data->mode) && data->shot_pending) {
+		/* No command is acknowledged until the shot is done */
+		k_sleep(K_TIMEOUT_ABS_MS(data->shot_due_ms));
+		data->shot_pending = false;
+	} else if (data->mode == SCD4X_MODE_POWER_DOWN) {
 		/*send wake up command twice because of an expected nack return in power down mode*/
 		scd4x_write_command(dev, SCD4X_CMD_WAKE_UP);
 		ret = scd4x_write_command(dev, SCD4X_CMD_WAKE_UP);
@@ -214,7 +202,7 @@ static int scd4x_set_idle_mode(const struct device *dev)
 			LOG_ERR("Failed write wake_up command.");
 			return ret;
 		}
-	} else {
+	} else if (!scd4x_mode_is_single_shot(data->mode)) {
 		ret = scd4x_write_command(dev, SCD4X_CMD_STOP_PERIODIC_MEASUREMENT);
 		if (ret < 0) {
 			LOG_ERR("Failed to write stop_periodic_measurement command.");
@@ -225,6 +213,166 @@ static int scd4x_set_idle_mode(const struct device *dev)
 	return 0;
 }
 
+static int scd4x_shot_send(const struct device *dev)
+{
+	const struct scd4x_config *cfg = dev->config;
+	struct scd4x_data *data = dev->data;
+	int ret;
+
+	/* Not waited out here, see scd4x_shot_ready() */
+	ret = iaq_sensirion_write(&cfg->bus, scd4x_cmds[data->shot_cmd].cmd, NULL, 0);
+	if (ret < 0) {
+		LOG_ERR("Failed to write measure_single_shot command.");
+		data->shot_pending = false;
+		return ret;
+	}
+
+	data->shot_pending = true;
+	data->shot_due_ms = k_uptime_get() + scd4x_cmds[data->shot_cmd].cmd_duration_ms;
+
+	return 0;
+}
+
+int scd4x_shot_start(const struct device *dev, uint8_t cmd)
+{
+	struct scd4x_data *data = dev->data;
+	int ret;
+
+	if (data->shot_pending) {
+		return 0;
+	}
+
+	ret = scd4x_set_idle_mode(dev);
+	if (ret < 0) {
+		LOG_ERR("Failed to set idle mode.");
+		return ret;
+	}
+
+	data->shot_cmd = cmd;
+	/* The first reading after waking up the sensor is to be discarded */
+	data->shot_discard = data->mode == SCD4X_MODE_POWER_DOWN;
+
+	return scd4x_shot_send(dev);
+}
+
+/*
+ * Returns 0 once the pending shot can be read, -EAGAIN with the uptime to
+ * check again at while it is measured.
+ */
+int scd4x_shot_ready(const struct device *dev, int64_t *due_ms)
+{
+	struct scd4x_data *data = dev->data;
+	int ret;
+
+	if (k_uptime_get() < data->shot_due_ms) {
+		*due_ms = data->shot_due_ms;
+		return -EAGAIN;
+	}
+
+	if (data->shot_discard) {
+		data->shot_discard = false;
+
+		ret = scd4x_read_sample(dev);
+		if (ret < 0) {
+			data->shot_pending = false;
+			return ret;
+		}
+
+		ret = scd4x_shot_send(dev);
+		if (ret < 0) {
+			return ret;
+		}
+
+		*due_ms = data->shot_due_ms;
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
+static int scd4x_set_mode(const struct device *dev, const struct sensor_value *val)
+{
+	const struct scd4x_config *cfg = dev->config;
+	struct scd4x_data *data = dev->data;
+	int ret;
+
+	if (val->val1 < 0 || val->val1 >= SCD4X_MODE_COUNT) {
+		return -EINVAL;
+	}
+	if (cfg->model == SCD4X_MODEL_SCD40 && scd4x_mode_is_single_shot(val->val1)) {
+		LOG_ERR("Single shot modes not available for SCD40.");
+		return -ENOTSUP;
+	}
+	if (val->val1 == data->mode) {
+		return 0;
+	}
+
+	ret = scd4x_set_idle_mode(dev);
+	if (ret < 0) {
+		LOG_ERR("Failed to set idle mode.");
+		return ret;
+	}
+
+	data->mode = val->val1;
+
+	ret = scd4x_setup_measurement(dev);
+	if (ret < 0) {
+		LOG_ERR("Failed to setup measurement.");
+		return ret;
+	}
+
+	LOG_DBG("Mode %d", data->mode);
+
+	return 0;
+}
+
+/*
+ * Typical supply at 3.3 V from the SCD41 datasheet. Periodic modes draw
+ * their average current between samples. A single shot is the average
+ * current at one shot per 5 minutes less the idle current in between.
+ */
+static const struct {
+	/* Time the sensor needs for one sample */
+	uint32_t busy_ms;
+	/* Energy used during that time */
+	uint32_t busy_uj;
+	/* Power drawn for the rest of the interval */
+	uint32_t rest_uw;
+} scd4x_energy[SCD4X_MODE_COUNT] = {
+	/* 15 mA */
+	[SCD4X_MODE_NORMAL] = {SCD4X_PERIODIC_INTERVAL_MS, 247500, 49500},
+	/* 3.2 mA */
+	[SCD4X_MODE_LOW_POWER] = {SCD4X_LOW_POWER_INTERVAL_MS, 316800, 10560},
+	/* Two shots after two wake ups, 0.5 uA powered down */
+	[SCD4X_MODE_POWER_DOWN] = {10060, 600000, 2},
+	/* 0.45 mA at one shot per 5 min, 0.15 mA idle */
+	[SCD4X_MODE_SINGLE_SHOT] = {5000, 300000, 495},
+};
+
+int scd4x_sample_energy(const struct device *dev, enum scd4x_mode_t mode, uint32_t interval_ms,
+			uint32_t *energy_uj)
+{
+	const struct scd4x_config *cfg = dev->config;
+	uint64_t energy;
+
+	if (mode >= SCD4X_MODE_COUNT) {
+		return -EINVAL;
+	}
+	if (cfg->model == SCD4X_MODEL_SCD40 && scd4x_mode_is_single_shot(mode)) {
+		return -ENOTSUP;
+	}
+	if (interval_ms < scd4x_energy[mode].busy_ms) {
+		return -EINVAL;
+	}
+
+	energy = scd4x_energy[mode].busy_uj +
+		 (uint64_t)scd4x_energy[mode].rest_uw * (interval_ms - scd4x_energy[mode].busy_ms) /
+			 MSEC_PER_SEC;
+	*energy_uj = MIN(energy, UINT32_MAX);
+
+	return 0;
+}
+
 static int scd4x_set_temperature_offset(const struct device *dev, const struct sensor_value *val)
 {
 	int ret;
@@ -332,12 +480,7 @@ static int scd4x_get_temperature_offset(const struct device *dev, struct sensor_
 		return ret;
 	}
 
-	int32_t temp;
-
-	/*Calculation from Datasheet*/
-	temp = sys_get_be16(rx_buf) * SCD4X_MAX_TEMP;
-	val->val1 = (int32_t)(temp / 0xFFFF);
-	val->val2 = ((temp % 0xFFFF) * 1000000) / 0xFFFF;
+	scd4x_temperature_offset_decode(sys_get_be16(rx_buf), val);
 
 	return 0;
 }
@@ -591,8 +734,9 @@ int scd4x_factory_reset(const struct device *dev)
 
 static int scd4x_sample_fetch(const struct device *dev, enum sensor_channel chan)
 {
-	const struct scd4x_config *cfg = dev->config;
+	struct scd4x_data *data = dev->data;
 	bool is_data_ready;
+	int64_t due_ms;
 	int ret;
 
 	if (chan != SENSOR_CHAN_ALL && chan != SENSOR_CHAN_AMBIENT_TEMP &&
@@ -600,26 +744,24 @@ static int scd4x_sample_fetch(const struct device *dev, enum sensor_channel chan
 		return -ENOTSUP;
 	}
 
-	if (cfg->mode == SCD4X_MODE_SINGLE_SHOT) {
-		ret = scd4x_set_idle_mode(dev);
+	if (scd4x_mode_is_single_shot(data->mode)) {
+		/* Usually started by the trigger, which fired once it was done */
+		ret = scd4x_shot_start(dev, (chan == SENSOR_CHAN_HUMIDITY ||
+					     chan == SENSOR_CHAN_AMBIENT_TEMP)
+						    ? SCD4X_CMD_MEASURE_SINGLE_SHOT_RHT
+						    : SCD4X_CMD_MEASURE_SINGLE_SHOT);
 		if (ret < 0) {
-			LOG_ERR("Failed to set idle mode.");
 			return ret;
 		}
 
-		if (chan == SENSOR_CHAN_HUMIDITY || chan == SENSOR_CHAN_AMBIENT_TEMP) {
-			ret = scd4x_write_command(dev, SCD4X_CMD_MEASURE_SINGLE_SHOT_RHT);
-			if (ret < 0) {
-				LOG_ERR("Failed to write measure_single_shot_rht_only command.");
-				return ret;
-			}
-		} else {
-			ret = scd4x_write_command(dev, SCD4X_CMD_MEASURE_SINGLE_SHOT);
-			if (ret < 0) {
-				LOG_ERR("Failed to write measure_single_shot command.");
-				return ret;
-			}
+		while ((ret = scd4x_shot_ready(dev, &due_ms)) == -EAGAIN) {
+			k_sleep(K_TIMEOUT_ABS_MS(due_ms));
 		}
+		if (ret < 0) {
+			LOG_ERR("Failed to take single shot.");
+			return ret;
+		}
+		data->shot_pending = false;
 	} else {
 		ret = scd4x_data_ready(dev, &is_data_ready);
 		if (ret < 0) {
@@ -627,7 +769,8 @@ static int scd4x_sample_fetch(const struct device *dev, enum sensor_channel chan
 			return ret;
 		}
 		if (!is_data_ready) {
-			return 0;
+			/* Do not hand out the previous sample as a new one */
+			return -EAGAIN;
 		}
 	}
 
@@ -637,7 +780,7 @@ static int scd4x_sample_fetch(const struct device *dev, enum sensor_channel chan
 		return ret;
 	}
 
-	if (cfg->mode == SCD4X_MODE_SINGLE_SHOT) {
+	if (scd4x_mode_is_single_shot(data->mode)) {
 		ret = scd4x_setup_measurement(dev);
 		if (ret < 0) {
 			LOG_ERR("Failed to setup measurement.");
@@ -688,6 +831,10 @@ int scd4x_attr_set(const struct device *dev, enum sensor_channel chan, enum sens
 		return -ENOTSUP;
 	}
 
+	if ((enum sensor_attribute_scd4x)attr == SENSOR_ATTR_SCD4X_MODE) {
+		return scd4x_set_mode(dev, val);
+	}
+
 	if ((enum sensor_attribute_scd4x)attr != SENSOR_ATTR_SCD4X_AMBIENT_PRESSURE) {
 		ret = scd4x_set_idle_mode(dev);
 		if (ret < 0) {
@@ -787,6 +934,7 @@ static int scd4x_attr_get(const struct device *dev, enum sensor_channel chan,
 			  enum sensor_attribute attr, struct sensor_value *val)
 {
 	const struct scd4x_config *cfg = dev->config;
+	struct scd4x_data *data = dev->data;
 	int ret;
 
 	if (chan != SENSOR_CHAN_ALL && chan != SENSOR_CHAN_AMBIENT_TEMP &&
@@ -794,8 +942,14 @@ static int scd4x_attr_get(const struct device *dev, enum sensor_channel chan,
 		return -ENOTSUP;
 	}
 
+	if ((enum sensor_attribute_scd4x)attr == SENSOR_ATTR_SCD4X_MODE) {
+		val->val1 = data->mode;
+		val->val2 = 0;
+		return 0;
+	}
+
 	if ((enum sensor_attribute_scd4x)attr != SENSOR_ATTR_SCD4X_AMBIENT_PRESSURE ||
-	    cfg->mode == SCD4X_MODE_SINGLE_SHOT) {
+	    scd4x_mode_is_single_shot(data->mode)) {
 		ret = scd4x_set_idle_mode(dev);
 		if (ret < 0) {
 			LOG_ERR("Failed to set idle mode.");
@@ -824,8 +978,11 @@ static int scd4x_attr_get(const struct device *dev, enum sensor_channel chan,
 			LOG_ERR("Failed to get ambient pressure.");
 			return ret;
 		}
-		/* return 0 to not call scd4x_setup_measurement */
-		return 0;
+		/* Periodic measurements were not stopped for it */
+		if (!scd4x_mode_is_single_shot(data->mode)) {
+			return 0;
+		}
+		break;
 	case SENSOR_ATTR_SCD4X_AUTOMATIC_CALIB_ENABLE:
 		ret = scd4x_get_automatic_calib_enable(dev, val);
 		if (ret < 0) {
@@ -861,6 +1018,7 @@ static int scd4x_attr_get(const struct device *dev, enum sensor_channel chan,
 static int scd4x_init(const struct device *dev)
 {
 	const struct scd4x_config *cfg = dev->config;
+	struct scd4x_data *data = dev->data;
 	int ret;
 
 	if (!i2c_is_ready_dt(&cfg->bus)) {
@@ -868,6 +1026,8 @@ static int scd4x_init(const struct device *dev)
 		return -ENODEV;
 	}
 
+	data->mode = cfg->mode;
+
 	ret = scd4x_write_command(dev, SCD4X_CMD_STOP_PERIODIC_MEASUREMENT);
 	if (ret < 0) {
 		/*send wake up command twice because of an expected nack return in power down mode*/
@@ -890,6 +1050,18 @@ static int scd4x_init(const struct device *dev)
 		LOG_ERR("Failed to setup measurement.");
 		return ret;
 	}
+
+#ifdef CONFIG_SCD4X_ASYNC
+	scd4x_init_async(dev);
+#endif
+
+#ifdef CONFIG_SCD4X_TRIGGER
+	ret = scd4x_init_trigger(dev);
+	if (ret < 0) {
+		LOG_ERR("Failed to initialize trigger.");
+		return ret;
+	}
+#endif
 	return 0;
 }
 
@@ -898,6 +1070,9 @@ static const struct sensor_driver_api scd4x_api_funcs = {
 	.channel_get = scd4x_channel_get,
 	.attr_set = scd4x_attr_set,
 	.attr_get = scd4x_attr_get,
+#ifdef CONFIG_SCD4X_TRIGGER
+	.trigger_set = scd4x_trigger_set,
+#endif
 };
 
 #define SCD4X_INIT(inst, scd4x_model)                                                              \
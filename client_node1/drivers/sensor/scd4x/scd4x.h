@@ -38,11 +38,14 @@
 #define SCD4X_CMD_SET_SELF_CALIB_STANDARD_PERIOD 24
 #define SCD4X_CMD_GET_SELF_CALIB_STANDARD_PERIOD 25
 
-#define SCD4X_CRC_POLY 0x31
-#define SCD4X_CRC_INIT 0xFF
-
 #define SCD4X_STARTUP_TIME_MS 30
 
+/* Periodic measurement intervals */
+#define SCD4X_PERIODIC_INTERVAL_MS  5000
+#define SCD4X_LOW_POWER_INTERVAL_MS 30000
+/* Data ready status polling period while a measurement is late */
+#define SCD4X_DATA_READY_RETRY_MS   200
+
 #define SCD4X_TEMPERATURE_OFFSET_IDX_MAX 20
 #define SCD4X_SENSOR_ALTITUDE_IDX_MAX    3000
 #define SCD4X_AMBIENT_PRESSURE_IDX_MAX   1200
@@ -56,22 +59,92 @@ enum scd4x_model_t {
 	SCD4X_MODEL_SCD41,
 };
 
+/* Numbered like the mode property of the devicetree binding */
 enum scd4x_mode_t {
 	SCD4X_MODE_NORMAL,
 	SCD4X_MODE_LOW_POWER,
+	/* Single shot measurements on fetch, powered down in between; the first
+	 * shot after the wake up is discarded, so every sample takes two shots
+	 * (SCD41 only)
+	 */
+	SCD4X_MODE_POWER_DOWN,
+	/* Same, idle in between (SCD41 only) */
 	SCD4X_MODE_SINGLE_SHOT,
+	SCD4X_MODE_COUNT,
 };
 
 struct scd4x_config {
 	struct i2c_dt_spec bus;
 	enum scd4x_model_t model;
+	/* Mode at boot, see SENSOR_ATTR_SCD4X_MODE */
 	enum scd4x_mode_t mode;
 };
 
+#ifdef CONFIG_SCD4X_ASYNC
+/* Longest command chain: wake up twice, measure and read twice, power down */
+#define SCD4X_ASYNC_MAX_STEPS 7
+
+/**
+ * @brief Completion callback of an asynchronous command chain.
+ *
+ * Runs on the system work queue.
+ *
+ * @param dev Pointer to the sensor device
+ * @param result 0 if successful, negative errno code if failure.
+ * @param user_data Pointer passed when the chain was started
+ */
+typedef void (*scd4x_async_cb_t)(const struct device *dev, int result, void *user_data);
+
+struct scd4x_async_step {
+	uint8_t cmd;
+	/* Bytes read back after the command, 0 for none */
+	uint8_t rx_len;
+	/* The wake up command is expected to be NACKed once in power down */
+	bool ignore_error;
+	/* Ends the chain with its error code unless the response says to go on */
+	int (*check)(const uint8_t *rx_buf);
+};
+
+struct scd4x_async {
+	const struct device *dev;
+	struct k_work_delayable work;
+	atomic_t busy;
+	struct scd4x_async_step steps[SCD4X_ASYNC_MAX_STEPS];
+	uint8_t num_steps;
+	uint8_t step;
+	bool reading;
+	int error;
+	struct i2c_msg msg;
+	uint8_t tx_buf[2];
+	uint8_t rx_buf[9];
+	/* Decodes rx_buf into the caller's result once the chain is done */
+	int (*finish)(const struct device *dev);
+	void *result;
+	int attr;
+	scd4x_async_cb_t cb;
+	void *user_data;
+};
+#endif
+
 struct scd4x_data {
 	uint16_t temp_sample;
 	uint16_t humi_sample;
 	uint16_t co2_sample;
+	enum scd4x_mode_t mode;
+	/* Single shot in progress, readable from shot_due_ms on */
+	bool shot_pending;
+	bool shot_discard;
+	uint8_t shot_cmd;
+	int64_t shot_due_ms;
+#ifdef CONFIG_SCD4X_TRIGGER
+	const struct device *dev;
+	struct k_work_delayable trigger_work;
+	sensor_trigger_handler_t trigger_handler;
+	const struct sensor_trigger *trigger;
+#endif
+#ifdef CONFIG_SCD4X_ASYNC
+	struct scd4x_async async;
+#endif
 };
 
 struct cmds_t {
@@ -79,6 +152,8 @@ struct cmds_t {
 	uint16_t cmd_duration_ms;
 };
 
+extern const struct cmds_t scd4x_cmds[];
+
 
 
  enum sensor_attribute_scd4x {
@@ -107,6 +182,10 @@ struct cmds_t {
       * values are integer multiples of 4 hours. Default: 156
       */
      SENSOR_ATTR_SCD4X_SELF_CALIB_STANDARD_PERIOD,
+     /* Measurement mode, enum scd4x_mode_t. Changing it stops the current
+      * measurements and starts the ones of the new mode.
+      */
+     SENSOR_ATTR_SCD4X_MODE,
  };
  
  /**
@@ -161,4 +240,86 @@ struct cmds_t {
   */
  int scd4x_factory_reset(const struct device *dev);
 
+int scd4x_data_ready(const struct device *dev, bool *is_data_ready);
+
+/**
+ * @brief Energy the sensor uses per sample in a mode.
+ *
+ * Typical figures at 3.3 V from the SCD41 datasheet: the average supply
+ * currents Sensirion measured for each mode, with one sample every
+ * interval_ms. Periodic modes run between the samples, single shot modes
+ * idle or power down.
+ *
+ * @param dev Pointer to the sensor device
+ * @param mode Mode to rate, not necessarily the current one
+ * @param interval_ms Time between two samples
+ * @param energy_uj Set to the energy per sample in microjoules
+ *
+ * @return 0 if successful, -EINVAL if the mode cannot sample that often,
+ *         -ENOTSUP if the model has no such mode.
+ */
+int scd4x_sample_energy(const struct device *dev, enum scd4x_mode_t mode, uint32_t interval_ms,
+			uint32_t *energy_uj);
+
+/* Single shots, shared by sample_fetch and the trigger */
+int scd4x_shot_start(const struct device *dev, uint8_t cmd);
+int scd4x_shot_ready(const struct device *dev, int64_t *due_ms);
+
+static inline bool scd4x_mode_is_single_shot(enum scd4x_mode_t mode)
+{
+	return mode == SCD4X_MODE_SINGLE_SHOT || mode == SCD4X_MODE_POWER_DOWN;
+}
+
+void scd4x_temperature_offset_decode(uint16_t word, struct sensor_value *val);
+
+#ifdef CONFIG_SCD4X_ASYNC
+/*
+ * Asynchronous variants of the blocking calls. Each one queues the commands
+ * of the operation as a chain that runs from the system work queue; command
+ * execution times are waited out with timers instead of sleeping, so one
+ * thread can keep several sensors busy. Only one chain can be in flight per
+ * device, and the blocking API must not be used on the device meanwhile.
+ * All of them return 0 once the chain is queued, -EBUSY if another chain
+ * is still running, or a negative errno code for invalid arguments.
+ */
+
+/**
+ * @brief Check whether a new periodic measurement is available.
+ *
+ * @param dev Pointer to the sensor device
+ * @param is_data_ready Set before cb is called with a result of 0
+ * @param cb Called once the chain is done
+ * @param user_data Passed to cb
+ */
+int scd4x_data_ready_async(const struct device *dev, bool *is_data_ready, scd4x_async_cb_t cb,
+			   void *user_data);
+
+/**
+ * @brief Read the latest measurement into the driver, like sample_fetch.
+ *
+ * In single shot mode this also triggers the measurement. In the periodic
+ * modes it checks the data ready status first, like sample_fetch, and cb
+ * gets -EAGAIN when no new measurement is available. Read the values with
+ * sensor_channel_get() after cb reports success.
+ */
+int scd4x_read_sample_async(const struct device *dev, scd4x_async_cb_t cb, void *user_data);
+
+/**
+ * @brief Read a sensor attribute, like sensor_attr_get().
+ *
+ * @param val Set before cb is called with a result of 0
+ */
+int scd4x_attr_get_async(const struct device *dev, enum sensor_attribute attr,
+			 struct sensor_value *val, scd4x_async_cb_t cb, void *user_data);
+
+void scd4x_init_async(const struct device *dev);
+#endif
+
+#ifdef CONFIG_SCD4X_TRIGGER
+int scd4x_trigger_set(const struct device *dev, const struct sensor_trigger *trig,
+		      sensor_trigger_handler_t handler);
+
+int scd4x_init_trigger(const struct device *dev);
+#endif
+
 #endif /* ZEPHYR_DRIVERS_SENSOR_SCD4X_H_ */
@@ -0,0 +1,394 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <iaq/sensirion.h>
+
+#include "scd4x.h"
+
+LOG_MODULE_DECLARE(SCD4X, CONFIG_SENSOR_LOG_LEVEL);
+
+/*
+ * A chain is a list of commands, each optionally followed by a read of its
+ * response. The work item issues one I2C transfer per run and is scheduled
+ * again once the transfer is done, after the execution time of the command
+ * when one was written, so no thread ever sleeps on the sensor.
+ */
+
+static void scd4x_async_add(struct scd4x_async *async, uint8_t cmd, uint8_t rx_len,
+			    bool ignore_error)
+{
+	__ASSERT_NO_MSG(async->num_steps < SCD4X_ASYNC_MAX_STEPS);
+
+	async->steps[async->num_steps++] = (struct scd4x_async_step){
+		.cmd = cmd,
+		.rx_len = rx_len,
+		.ignore_error = ignore_error,
+	};
+}
+
+/* Decode the data ready status; a sample read ends with -EAGAIN when there
+ * is no new periodic measurement, so the previous one is not read again
+ */
+static int scd4x_data_ready_check(const uint8_t *rx_buf)
+{
+	int ret;
+
+	ret = iaq_sensirion_check_crc(rx_buf, 1);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Least significant 11 bits = 0 --> data not ready */
+	return (iaq_sensirion_get_u16(rx_buf, 0) & 0x07FF) > 0 ? 0 : -EAGAIN;
+}
+
+static void scd4x_async_add_data_ready(struct scd4x_async *async)
+{
+	scd4x_async_add(async, SCD4X_CMD_GET_DATA_READY_STATUS, 3, false);
+	async->steps[async->num_steps - 1].check = scd4x_data_ready_check;
+}
+
+/* Chains only start with no shot pending, so a single shot sensor is idle or
+ * powered down by then
+ */
+static void scd4x_async_add_idle_mode(struct scd4x_async *async, enum scd4x_mode_t mode)
+{
+	if (mode == SCD4X_MODE_POWER_DOWN) {
+		/*send wake up command twice because of an expected nack return in power down mode*/
+		scd4x_async_add(async, SCD4X_CMD_WAKE_UP, 0, true);
+		scd4x_async_add(async, SCD4X_CMD_WAKE_UP, 0, false);
+	} else if (!scd4x_mode_is_single_shot(mode)) {
+		scd4x_async_add(async, SCD4X_CMD_STOP_PERIODIC_MEASUREMENT, 0, false);
+	}
+}
+
+static void scd4x_async_add_setup_measurement(struct scd4x_async *async, enum scd4x_mode_t mode)
+{
+	switch (mode) {
+	case SCD4X_MODE_NORMAL:
+		scd4x_async_add(async, SCD4X_CMD_START_PERIODIC_MEASUREMENT, 0, false);
+		break;
+	case SCD4X_MODE_LOW_POWER:
+		scd4x_async_add(async, SCD4X_CMD_LOW_POWER_PERIODIC_MEASUREMENT, 0, false);
+		break;
+	case SCD4X_MODE_SINGLE_SHOT:
+		break;
+	case SCD4X_MODE_POWER_DOWN:
+		scd4x_async_add(async, SCD4X_CMD_POWER_DOWN, 0, false);
+		break;
+	default:
+		break;
+	}
+}
+
+static void scd4x_async_complete(struct scd4x_async *async, int result)
+{
+	scd4x_async_cb_t cb = async->cb;
+	void *user_data = async->user_data;
+
+	if (result == 0 && async->finish != NULL) {
+		result = async->finish(async->dev);
+	}
+
+	atomic_clear(&async->busy);
+	cb(async->dev, result, user_data);
+}
+
+/* Runs from the I2C driver's interrupt when transfers are interrupt driven */
+static void scd4x_async_transfer_done(const struct device *bus, int result, void *user_data)
+{
+	struct scd4x_async *async = user_data;
+	const struct scd4x_async_step *step = &async->steps[async->step];
+	k_timeout_t delay = K_NO_WAIT;
+
+	if (result < 0 && !step->ignore_error) {
+		async->error = result;
+	} else if (async->reading) {
+		async->reading = false;
+		async->step++;
+	} else {
+		delay = K_MSEC(scd4x_cmds[step->cmd].cmd_duration_ms);
+		if (step->rx_len > 0) {
+			async->reading = true;
+		} else {
+			async->step++;
+		}
+	}
+
+	k_work_reschedule(&async->work, delay);
+}
+
+static void scd4x_async_transfer(struct scd4x_async *async)
+{
+	const struct scd4x_config *cfg = async->dev->config;
+	int ret;
+
+#ifdef CONFIG_I2C_CALLBACK
+	ret = i2c_transfer_cb_dt(&cfg->bus, &async->msg, 1, scd4x_async_transfer_done, async);
+	if (ret != -ENOSYS) {
+		if (ret < 0) {
+			scd4x_async_transfer_done(cfg->bus.bus, ret, async);
+		}
+		return;
+	}
+	/* The bus driver has no callback support, the transfer blocks briefly */
+#endif
+	ret = i2c_transfer_dt(&cfg->bus, &async->msg, 1);
+	scd4x_async_transfer_done(cfg->bus.bus, ret, async);
+}
+
+static void scd4x_async_work_cb(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct scd4x_async *async = CONTAINER_OF(dwork, struct scd4x_async, work);
+	const struct scd4x_async_step *step;
+	int ret;
+
+	if (async->error < 0) {
+		LOG_ERR("Command chain failed at step %u (%d).", async->step, async->error);
+		scd4x_async_complete(async, async->error);
+		return;
+	}
+
+	if (async->step > 0 && !async->reading) {
+		/* Done with the previous step, its response is still in rx_buf */
+		step = &async->steps[async->step - 1];
+		ret = step->check != NULL ? step->check(async->rx_buf) : 0;
+		if (ret < 0) {
+			scd4x_async_complete(async, ret);
+			return;
+		}
+	}
+
+	if (async->step == async->num_steps) {
+		scd4x_async_complete(async, 0);
+		return;
+	}
+
+	step = &async->steps[async->step];
+	if (async->reading) {
+		async->msg.buf = async->rx_buf;
+		async->msg.len = step->rx_len;
+		async->msg.flags = I2C_MSG_READ | I2C_MSG_STOP;
+	} else {
+		sys_put_be16(scd4x_cmds[step->cmd].cmd, async->tx_buf);
+		async->msg.buf = async->tx_buf;
+		async->msg.len = sizeof(async->tx_buf);
+		async->msg.flags = I2C_MSG_WRITE | I2C_MSG_STOP;
+	}
+
+	scd4x_async_transfer(async);
+}
+
+/* Claim the device for a new chain; the caller adds the steps and submits */
+static struct scd4x_async *scd4x_async_claim(const struct device *dev,
+					     int (*finish)(const struct device *dev), void *result,
+					     scd4x_async_cb_t cb, void *user_data)
+{
+	struct scd4x_data *data = dev->data;
+	struct scd4x_async *async = &data->async;
+
+	if (!atomic_cas(&async->busy, 0, 1)) {
+		return NULL;
+	}
+
+	async->num_steps = 0;
+	async->step = 0;
+	async->reading = false;
+	async->error = 0;
+	async->finish = finish;
+	async->result = result;
+	async->cb = cb;
+	async->user_data = user_data;
+
+	return async;
+}
+
+static void scd4x_async_submit(struct scd4x_async *async)
+{
+	k_work_reschedule(&async->work, K_NO_WAIT);
+}
+
+static int scd4x_data_ready_finish(const struct device *dev)
+{
+	struct scd4x_data *data = dev->data;
+	bool *is_data_ready = data->async.result;
+	int ret;
+
+	ret = scd4x_data_ready_check(data->async.rx_buf);
+	if (ret < 0 && ret != -EAGAIN) {
+		return ret;
+	}
+
+	*is_data_ready = ret == 0;
+
+	return 0;
+}
+
+int scd4x_data_ready_async(const struct device *dev, bool *is_data_ready, scd4x_async_cb_t cb,
+			   void *user_data)
+{
+	struct scd4x_async *async;
+
+	async = scd4x_async_claim(dev, scd4x_data_ready_finish, is_data_ready, cb, user_data);
+	if (async == NULL) {
+		return -EBUSY;
+	}
+
+	scd4x_async_add(async, SCD4X_CMD_GET_DATA_READY_STATUS, 3, false);
+	scd4x_async_submit(async);
+
+	return 0;
+}
+
+static int scd4x_read_sample_finish(const struct device *dev)
+{
+	struct scd4x_data *data = dev->data;
+	const uint8_t *rx_data = data->async.rx_buf;
+	int ret;
+
+	ret = iaq_sensirion_check_crc(rx_data, 3);
+	if (ret < 0) {
+		return ret;
+	}
+
+	data->co2_sample = iaq_sensirion_get_u16(rx_data, 0);
+	data->temp_sample = iaq_sensirion_get_u16(rx_data, 1);
+	data->humi_sample = iaq_sensirion_get_u16(rx_data, 2);
+
+	return 0;
+}
+
+int scd4x_read_sample_async(const struct device *dev, scd4x_async_cb_t cb, void *user_data)
+{
+	struct scd4x_data *data = dev->data;
+	struct scd4x_async *async;
+
+	if (data->shot_pending) {
+		return -EBUSY;
+	}
+
+	async = scd4x_async_claim(dev, scd4x_read_sample_finish, NULL, cb, user_data);
+	if (async == NULL) {
+		return -EBUSY;
+	}
+
+	if (scd4x_mode_is_single_shot(data->mode)) {
+		scd4x_async_add_idle_mode(async, data->mode);
+		if (data->mode == SCD4X_MODE_POWER_DOWN) {
+			/* The first reading after waking up the sensor is discarded */
+			scd4x_async_add(async, SCD4X_CMD_MEASURE_SINGLE_SHOT, 0, false);
+			scd4x_async_add(async, SCD4X_CMD_READ_MEASUREMENT, 9, false);
+		}
+		scd4x_async_add(async, SCD4X_CMD_MEASURE_SINGLE_SHOT, 0, false);
+	} else {
+		scd4x_async_add_data_ready(async);
+	}
+	scd4x_async_add(async, SCD4X_CMD_READ_MEASUREMENT, 9, false);
+	if (data->mode == SCD4X_MODE_POWER_DOWN) {
+		scd4x_async_add(async, SCD4X_CMD_POWER_DOWN, 0, false);
+	}
+	scd4x_async_submit(async);
+
+	return 0;
+}
+
+static int scd4x_attr_get_finish(const struct device *dev)
+{
+	struct scd4x_data *data = dev->data;
+	struct sensor_value *val = data->async.result;
+	uint16_t word = iaq_sensirion_get_u16(data->async.rx_buf, 0);
+	int ret;
+
+	ret = iaq_sensirion_check_crc(data->async.rx_buf, 1);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if ((enum sensor_attribute_scd4x)data->async.attr == SENSOR_ATTR_SCD4X_TEMPERATURE_OFFSET) {
+		scd4x_temperature_offset_decode(word, val);
+	} else {
+		val->val1 = word;
+		val->val2 = 0;
+	}
+
+	return 0;
+}
+
+int scd4x_attr_get_async(const struct device *dev, enum sensor_attribute attr,
+			 struct sensor_value *val, scd4x_async_cb_t cb, void *user_data)
+{
+	const struct scd4x_config *cfg = dev->config;
+	struct scd4x_data *data = dev->data;
+	struct scd4x_async *async;
+	uint8_t cmd;
+
+	switch ((enum sensor_attribute_scd4x)attr) {
+	case SENSOR_ATTR_SCD4X_TEMPERATURE_OFFSET:
+		cmd = SCD4X_CMD_GET_TEMPERATURE_OFFSET;
+		break;
+	case SENSOR_ATTR_SCD4X_SENSOR_ALTITUDE:
+		cmd = SCD4X_CMD_GET_SENSOR_ALTITUDE;
+		break;
+	case SENSOR_ATTR_SCD4X_AMBIENT_PRESSURE:
+		cmd = SCD4X_CMD_GET_AMBIENT_PRESSURE;
+		break;
+	case SENSOR_ATTR_SCD4X_AUTOMATIC_CALIB_ENABLE:
+		cmd = SCD4X_CMD_GET_AUTOMATIC_CALIB_ENABLE;
+		break;
+	case SENSOR_ATTR_SCD4X_SELF_CALIB_INITIAL_PERIOD:
+		cmd = SCD4X_CMD_GET_SELF_CALIB_INITIAL_PERIOD;
+		break;
+	case SENSOR_ATTR_SCD4X_SELF_CALIB_STANDARD_PERIOD:
+		cmd = SCD4X_CMD_GET_SELF_CALIB_STANDARD_PERIOD;
+		break;
+	default:
+		return -ENOTSUP;
+	}
+
+	if (cfg->model == SCD4X_MODEL_SCD40 &&
+	    (cmd == SCD4X_CMD_GET_SELF_CALIB_INITIAL_PERIOD ||
+	     cmd == SCD4X_CMD_GET_SELF_CALIB_STANDARD_PERIOD)) {
+		LOG_ERR("Self calibration periods not available for SCD40.");
+		return -ENOTSUP;
+	}
+
+	if (data->shot_pending) {
+		return -EBUSY;
+	}
+
+	async = scd4x_async_claim(dev, scd4x_attr_get_finish, val, cb, user_data);
+	if (async == NULL) {
+		return -EBUSY;
+	}
+	async->attr = attr;
+
+	/* Same sequence as scd4x_attr_get(): only the ambient pressure can be
+	 * read while a periodic measurement is running
+	 */
+	if (cmd != SCD4X_CMD_GET_AMBIENT_PRESSURE || scd4x_mode_is_single_shot(data->mode)) {
+		scd4x_async_add_idle_mode(async, data->mode);
+	}
+	scd4x_async_add(async, cmd, 3, false);
+	if (cmd != SCD4X_CMD_GET_AMBIENT_PRESSURE || scd4x_mode_is_single_shot(data->mode)) {
+		scd4x_async_add_setup_measurement(async, data->mode);
+	}
+	scd4x_async_submit(async);
+
+	return 0;
+}
+
+void scd4x_init_async(const struct device *dev)
+{
+	struct scd4x_data *data = dev->data;
+
+	data->async.dev = dev;
+	k_work_init_delayable(&data->async.work, scd4x_async_work_cb);
+}
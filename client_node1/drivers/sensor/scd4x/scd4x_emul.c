@@ -0,0 +1,441 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT sensirion_scd41
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "scd4x.h"
+#include "scd4x_emul.h"
+
+LOG_MODULE_REGISTER(scd4x_emul, CONFIG_SENSOR_LOG_LEVEL);
+
+#define SCD4X_EMUL_NUM_CMDS (SCD4X_CMD_GET_SELF_CALIB_STANDARD_PERIOD + 1)
+
+/* get_data_ready_status, the low 11 bits are not 0 once a sample is ready */
+#define SCD4X_EMUL_DATA_READY     0x8006
+#define SCD4X_EMUL_DATA_NOT_READY 0x8000
+/* perform_forced_recalibration adds it to the correction */
+#define SCD4X_EMUL_FRC_OFFSET     0x8000
+
+/* Largest response: CO2, temperature and humidity */
+#define SCD4X_EMUL_MAX_WORDS 3
+#define SCD4X_EMUL_WORD_SIZE 3
+
+enum scd4x_emul_state {
+	SCD4X_EMUL_IDLE,
+	SCD4X_EMUL_PERIODIC,
+	SCD4X_EMUL_LOW_POWER,
+	SCD4X_EMUL_POWER_DOWN,
+};
+
+/* Settings written and read back by a pair of commands, with their factory value */
+static const struct {
+	uint8_t set;
+	uint8_t get;
+	uint16_t reset;
+} scd4x_emul_settings[] = {
+	/* 4 degrees Celsius */
+	{SCD4X_CMD_SET_TEMPERATURE_OFFSET, SCD4X_CMD_GET_TEMPERATURE_OFFSET, 0x05DA},
+	{SCD4X_CMD_SET_SENSOR_ALTITUDE, SCD4X_CMD_GET_SENSOR_ALTITUDE, 0},
+	/* hPa */
+	{SCD4X_CMD_SET_AMBIENT_PRESSURE, SCD4X_CMD_GET_AMBIENT_PRESSURE, 1013},
+	{SCD4X_CMD_SET_AUTOMATIC_CALIB_ENABLE, SCD4X_CMD_GET_AUTOMATIC_CALIB_ENABLE, 1},
+	/* Hours */
+	{SCD4X_CMD_SET_SELF_CALIB_INITIAL_PERIOD, SCD4X_CMD_GET_SELF_CALIB_INITIAL_PERIOD, 44},
+	{SCD4X_CMD_SET_SELF_CALIB_STANDARD_PERIOD, SCD4X_CMD_GET_SELF_CALIB_STANDARD_PERIOD, 156},
+};
+
+#define SCD4X_EMUL_NUM_SETTINGS ARRAY_SIZE(scd4x_emul_settings)
+
+static const struct scd4x_emul_sample scd4x_emul_default_trace[] = {
+	{.ms = 0, .co2 = 600, .temp = 22500, .humidity = 45000},
+};
+
+struct scd4x_emul_data {
+	enum scd4x_emul_state state;
+	/* Commands are NACKed until the one executing is done */
+	int64_t busy_until_ms;
+	/* Completion of the next periodic measurement or of the pending shot */
+	int64_t next_ms;
+	/* Single shot command executing, -1 if none */
+	int shot_cmd;
+	/* Latest measurement as sent on the bus, until it is read */
+	uint16_t sample[SCD4X_EMUL_MAX_WORDS];
+	bool sample_fresh;
+	uint16_t settings[SCD4X_EMUL_NUM_SETTINGS];
+	/* Copy in EEPROM, restored by reinit */
+	uint16_t persisted[SCD4X_EMUL_NUM_SETTINGS];
+	/* Response to the last command, for the next read */
+	uint8_t rx_buf[SCD4X_EMUL_MAX_WORDS * SCD4X_EMUL_WORD_SIZE];
+	size_t rx_len;
+	/* Set from another thread than the one sampling the sensor */
+	struct k_spinlock trace_lock;
+	const struct scd4x_emul_sample *trace;
+	size_t trace_len;
+	uint32_t trace_period_ms;
+	int64_t trace_start_ms;
+};
+
+/* Bitwise CRC-8 of the datasheet, independent of the driver's lookup table */
+static uint8_t scd4x_emul_crc(uint16_t word)
+{
+	uint8_t crc = 0xFF;
+
+	for (int i = 8; i >= 0; i -= 8) {
+		crc ^= (uint8_t)(word >> i);
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+static void scd4x_emul_respond(struct scd4x_emul_data *data, const uint16_t *words,
+			       size_t num_words)
+{
+	for (size_t i = 0; i < num_words; i++) {
+		sys_put_be16(words[i], &data->rx_buf[i * SCD4X_EMUL_WORD_SIZE]);
+		data->rx_buf[i * SCD4X_EMUL_WORD_SIZE + 2] = scd4x_emul_crc(words[i]);
+	}
+	data->rx_len = num_words * SCD4X_EMUL_WORD_SIZE;
+}
+
+static const struct scd4x_emul_sample *scd4x_emul_trace_at(struct scd4x_emul_data *data,
+							   int64_t at_ms)
+{
+	const struct scd4x_emul_sample *sample;
+	k_spinlock_key_t key;
+	int64_t t;
+	size_t i = 0;
+
+	key = k_spin_lock(&data->trace_lock);
+	t = at_ms - data->trace_start_ms;
+	if (data->trace_period_ms > 0) {
+		t %= data->trace_period_ms;
+	}
+	while (i + 1 < data->trace_len && data->trace[i + 1].ms <= t) {
+		i++;
+	}
+	sample = &data->trace[i];
+	k_spin_unlock(&data->trace_lock, key);
+
+	return sample;
+}
+
+/* Encode the trace at at_ms the way scd4x_channel_get() decodes it. */
+static void scd4x_emul_measure(struct scd4x_emul_data *data, int64_t at_ms, bool with_co2)
+{
+	const struct scd4x_emul_sample *sample = scd4x_emul_trace_at(data, at_ms);
+	int64_t temp = ((int64_t)sample->temp - SCD4X_MIN_TEMP * 1000) * 0xFFFF;
+	int64_t humidity = (int64_t)sample->humidity * 0xFFFF;
+
+	/* measure_single_shot_rht_only reports 0 ppm */
+	data->sample[0] = with_co2 ? sample->co2 : 0;
+	data->sample[1] = CLAMP((temp + SCD4X_MAX_TEMP * 500) / (SCD4X_MAX_TEMP * 1000), 0, 0xFFFF);
+	data->sample[2] = CLAMP((humidity + 50000) / 100000, 0, 0xFFFF);
+	data->sample_fresh = true;
+}
+
+/* Complete the measurements due by now. */
+static void scd4x_emul_update(struct scd4x_emul_data *data, int64_t now)
+{
+	int64_t interval;
+
+	switch (data->state) {
+	case SCD4X_EMUL_PERIODIC:
+	case SCD4X_EMUL_LOW_POWER:
+		interval = data->state == SCD4X_EMUL_LOW_POWER ? SCD4X_LOW_POWER_INTERVAL_MS
+							       : SCD4X_PERIODIC_INTERVAL_MS;
+		if (now < data->next_ms) {
+			break;
+		}
+		/* Only the latest of the measurements done since is kept */
+		data->next_ms += (now - data->next_ms) / interval * interval;
+		scd4x_emul_measure(data, data->next_ms, true);
+		data->next_ms += interval;
+		break;
+	case SCD4X_EMUL_IDLE:
+		if (data->shot_cmd >= 0 && now >= data->next_ms) {
+			scd4x_emul_measure(data, data->next_ms,
+					   data->shot_cmd == SCD4X_CMD_MEASURE_SINGLE_SHOT);
+			data->shot_cmd = -1;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static bool scd4x_emul_takes_arg(int cmd)
+{
+	switch (cmd) {
+	case SCD4X_CMD_SET_TEMPERATURE_OFFSET:
+	case SCD4X_CMD_SET_SENSOR_ALTITUDE:
+	case SCD4X_CMD_SET_AMBIENT_PRESSURE:
+	case SCD4X_CMD_FORCED_RECALIB:
+	case SCD4X_CMD_SET_AUTOMATIC_CALIB_ENABLE:
+	case SCD4X_CMD_SET_SELF_CALIB_INITIAL_PERIOD:
+	case SCD4X_CMD_SET_SELF_CALIB_STANDARD_PERIOD:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Index in scd4x_cmds[], set and get ambient pressure share their code. */
+static int scd4x_emul_find_cmd(uint16_t code, bool has_arg)
+{
+	for (int cmd = 0; cmd < SCD4X_EMUL_NUM_CMDS; cmd++) {
+		if (scd4x_cmds[cmd].cmd == code && scd4x_emul_takes_arg(cmd) == has_arg) {
+			return cmd;
+		}
+	}
+
+	return -ENOENT;
+}
+
+static bool scd4x_emul_cmd_allowed(const struct scd4x_emul_data *data, int cmd)
+{
+	switch (data->state) {
+	case SCD4X_EMUL_PERIODIC:
+	case SCD4X_EMUL_LOW_POWER:
+		return cmd == SCD4X_CMD_READ_MEASUREMENT || cmd == SCD4X_CMD_GET_DATA_READY_STATUS ||
+		       cmd == SCD4X_CMD_STOP_PERIODIC_MEASUREMENT ||
+		       cmd == SCD4X_CMD_SET_AMBIENT_PRESSURE ||
+		       cmd == SCD4X_CMD_GET_AMBIENT_PRESSURE;
+	case SCD4X_EMUL_POWER_DOWN:
+		return cmd == SCD4X_CMD_WAKE_UP;
+	default:
+		return true;
+	}
+}
+
+static void scd4x_emul_factory_reset(struct scd4x_emul_data *data)
+{
+	for (size_t i = 0; i < SCD4X_EMUL_NUM_SETTINGS; i++) {
+		data->settings[i] = scd4x_emul_settings[i].reset;
+		data->persisted[i] = scd4x_emul_settings[i].reset;
+	}
+}
+
+static int scd4x_emul_setting(struct scd4x_emul_data *data, int cmd, uint16_t arg)
+{
+	for (size_t i = 0; i < SCD4X_EMUL_NUM_SETTINGS; i++) {
+		if (cmd == scd4x_emul_settings[i].set) {
+			data->settings[i] = arg;
+			return 0;
+		}
+		if (cmd == scd4x_emul_settings[i].get) {
+			scd4x_emul_respond(data, &data->settings[i], 1);
+			return 0;
+		}
+	}
+
+	return -EIO;
+}
+
+static int scd4x_emul_execute(struct scd4x_emul_data *data, int cmd, uint16_t arg, int64_t now)
+{
+	uint16_t word;
+
+	switch (cmd) {
+	case SCD4X_CMD_START_PERIODIC_MEASUREMENT:
+		data->state = SCD4X_EMUL_PERIODIC;
+		data->next_ms = now + SCD4X_PERIODIC_INTERVAL_MS;
+		break;
+	case SCD4X_CMD_LOW_POWER_PERIODIC_MEASUREMENT:
+		data->state = SCD4X_EMUL_LOW_POWER;
+		data->next_ms = now + SCD4X_LOW_POWER_INTERVAL_MS;
+		break;
+	case SCD4X_CMD_STOP_PERIODIC_MEASUREMENT:
+		data->state = SCD4X_EMUL_IDLE;
+		break;
+	case SCD4X_CMD_READ_MEASUREMENT:
+		/* Nothing to respond, so the read is NACKed */
+		if (data->sample_fresh) {
+			scd4x_emul_respond(data, data->sample, SCD4X_EMUL_MAX_WORDS);
+			data->sample_fresh = false;
+		}
+		break;
+	case SCD4X_CMD_GET_DATA_READY_STATUS:
+		word = data->sample_fresh ? SCD4X_EMUL_DATA_READY : SCD4X_EMUL_DATA_NOT_READY;
+		scd4x_emul_respond(data, &word, 1);
+		break;
+	case SCD4X_CMD_FORCED_RECALIB:
+		word = SCD4X_EMUL_FRC_OFFSET + (arg - scd4x_emul_trace_at(data, now)->co2);
+		scd4x_emul_respond(data, &word, 1);
+		break;
+	case SCD4X_CMD_SELF_TEST:
+		/* No malfunction */
+		word = 0;
+		scd4x_emul_respond(data, &word, 1);
+		break;
+	case SCD4X_CMD_PERSIST_SETTINGS:
+		memcpy(data->persisted, data->settings, sizeof(data->persisted));
+		break;
+	case SCD4X_CMD_REINIT:
+		memcpy(data->settings, data->persisted, sizeof(data->settings));
+		break;
+	case SCD4X_CMD_FACTORY_RESET:
+		scd4x_emul_factory_reset(data);
+		break;
+	case SCD4X_CMD_MEASURE_SINGLE_SHOT:
+	case SCD4X_CMD_MEASURE_SINGLE_SHOT_RHT:
+		data->shot_cmd = cmd;
+		data->next_ms = data->busy_until_ms;
+		break;
+	case SCD4X_CMD_POWER_DOWN:
+		data->state = SCD4X_EMUL_POWER_DOWN;
+		data->sample_fresh = false;
+		break;
+	case SCD4X_CMD_WAKE_UP:
+		if (data->state == SCD4X_EMUL_POWER_DOWN) {
+			/* The sensor wakes up without acknowledging it */
+			data->state = SCD4X_EMUL_IDLE;
+			return -EIO;
+		}
+		break;
+	default:
+		return scd4x_emul_setting(data, cmd, arg);
+	}
+
+	return 0;
+}
+
+static int scd4x_emul_write(struct scd4x_emul_data *data, const struct i2c_msg *msg, int64_t now)
+{
+	bool has_arg;
+	uint16_t code;
+	int cmd;
+
+	if (msg->len != 2 && msg->len != 2 + SCD4X_EMUL_WORD_SIZE) {
+		LOG_WRN("Write of %u bytes", msg->len);
+		return -EIO;
+	}
+
+	code = sys_get_be16(msg->buf);
+	has_arg = msg->len > 2;
+	if (has_arg && scd4x_emul_crc(sys_get_be16(&msg->buf[2])) != msg->buf[4]) {
+		LOG_WRN("CRC mismatch in argument of 0x%04x", code);
+		return -EIO;
+	}
+
+	cmd = scd4x_emul_find_cmd(code, has_arg);
+	if (cmd < 0) {
+		LOG_WRN("Unknown command 0x%04x", code);
+		return -EIO;
+	}
+	if (!scd4x_emul_cmd_allowed(data, cmd)) {
+		LOG_DBG("Command 0x%04x not allowed in state %d", code, data->state);
+		return -EIO;
+	}
+
+	data->rx_len = 0;
+	data->busy_until_ms = now + scd4x_cmds[cmd].cmd_duration_ms;
+
+	return scd4x_emul_execute(data, cmd, has_arg ? sys_get_be16(&msg->buf[2]) : 0, now);
+}
+
+static int scd4x_emul_read(struct scd4x_emul_data *data, struct i2c_msg *msg)
+{
+	/* Reading less than the response is fine, the controller NACKs early */
+	if (msg->len > data->rx_len) {
+		return -EIO;
+	}
+
+	memcpy(msg->buf, data->rx_buf, msg->len);
+	data->rx_len = 0;
+
+	return 0;
+}
+
+static int scd4x_emul_transfer(const struct emul *target, struct i2c_msg *msgs, int num_msgs,
+			       int addr)
+{
+	struct scd4x_emul_data *data = target->data;
+	int64_t now = k_uptime_get();
+	int ret = 0;
+
+	ARG_UNUSED(addr);
+
+	scd4x_emul_update(data, now);
+
+	for (int i = 0; i < num_msgs && ret == 0; i++) {
+		if (now < data->busy_until_ms) {
+			/* Still executing the previous command */
+			return -EIO;
+		}
+
+		if (msgs[i].flags & I2C_MSG_READ) {
+			ret = scd4x_emul_read(data, &msgs[i]);
+		} else {
+			ret = scd4x_emul_write(data, &msgs[i], now);
+		}
+	}
+
+	return ret;
+}
+
+int scd4x_emul_set_trace(const struct emul *target, const struct scd4x_emul_sample *trace,
+			 size_t len, uint32_t period_ms)
+{
+	struct scd4x_emul_data *data = target->data;
+	k_spinlock_key_t key;
+
+	if (len == 0 || trace[0].ms != 0 || (period_ms > 0 && trace[len - 1].ms >= period_ms)) {
+		return -EINVAL;
+	}
+	for (size_t i = 1; i < len; i++) {
+		if (trace[i].ms < trace[i - 1].ms) {
+			return -EINVAL;
+		}
+	}
+
+	key = k_spin_lock(&data->trace_lock);
+	data->trace = trace;
+	data->trace_len = len;
+	data->trace_period_ms = period_ms;
+	data->trace_start_ms = k_uptime_get();
+	k_spin_unlock(&data->trace_lock, key);
+
+	return 0;
+}
+
+static int scd4x_emul_init(const struct emul *target, const struct device *parent)
+{
+	struct scd4x_emul_data *data = target->data;
+
+	ARG_UNUSED(parent);
+
+	/* Powered up in idle mode */
+	data->state = SCD4X_EMUL_IDLE;
+	data->shot_cmd = -1;
+	scd4x_emul_factory_reset(data);
+	data->trace = scd4x_emul_default_trace;
+	data->trace_len = ARRAY_SIZE(scd4x_emul_default_trace);
+
+	return 0;
+}
+
+static const struct i2c_emul_api scd4x_emul_api_i2c = {
+	.transfer = scd4x_emul_transfer,
+};
+
+#define SCD4X_EMUL(n)                                                                              \
+	static struct scd4x_emul_data scd4x_emul_data_##n;                                         \
+	EMUL_DT_INST_DEFINE(n, scd4x_emul_init, &scd4x_emul_data_##n, NULL, &scd4x_emul_api_i2c,   \
+			    NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(SCD4X_EMUL)
@@ -0,0 +1,55 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_DRIVERS_SENSOR_SCD4X_EMUL_H_
+#define ZEPHYR_DRIVERS_SENSOR_SCD4X_EMUL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/emul.h>
+
+/*
+ * SCD41 emulated on an I2C emulation controller, as found on native_sim.
+ *
+ * It answers the commands of scd4x_cmds[] the way the sensor does: words
+ * are sent with their CRC and arguments with a wrong one are NACKed, as
+ * are commands sent before the previous one finished executing, commands
+ * the current mode does not accept and anything but wake_up while powered
+ * down. Reading a measurement that was already read is NACKed too.
+ *
+ * Measurements are taken from a trace of the values the sensor reports
+ * over time, constant until one is set.
+ */
+
+struct scd4x_emul_sample {
+	/* Milliseconds since the start of the trace */
+	uint32_t ms;
+	/* CO2 in ppm */
+	uint16_t co2;
+	/* Temperature in milli-degrees Celsius */
+	int32_t temp;
+	/* Relative humidity in milli-percent */
+	int32_t humidity;
+};
+
+/**
+ * @brief Play measurements back from a trace, starting now.
+ *
+ * A sample applies from its ms on until the next one. Periodic modes
+ * sample the trace every measurement interval, single shots when they
+ * complete, so changing the mode does not change the air.
+ *
+ * @param target Emulator of the sensor, EMUL_DT_GET() of its node
+ * @param trace Samples sorted by ms, the first one at 0; not copied
+ * @param len Number of samples
+ * @param period_ms Length of the trace, which then starts over; 0 to keep
+ *                  the last sample
+ *
+ * @return 0 if successful, -EINVAL if the trace is empty, unsorted or
+ *         longer than period_ms.
+ */
+int scd4x_emul_set_trace(const struct emul *target, const struct scd4x_emul_sample *trace,
+			 size_t len, uint32_t period_ms);
+
+#endif /* ZEPHYR_DRIVERS_SENSOR_SCD4X_EMUL_H_ */
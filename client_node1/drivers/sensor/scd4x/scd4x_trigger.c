@@ -0,0 +1,129 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "scd4x.h"
+
+LOG_MODULE_DECLARE(SCD4X, CONFIG_SENSOR_LOG_LEVEL);
+
+/*
+ * The SCD4x has no data ready pin. Once a fresh sample has been seen the
+ * next one is due a full measurement interval later, so the status register
+ * is only read around that time instead of being polled continuously.
+ *
+ * In single shot modes arming the trigger starts a shot, and it fires once
+ * when the shot can be read. The caller is free in the meantime instead of
+ * sleeping through the measurement in sample_fetch.
+ */
+static uint32_t scd4x_interval_ms(const struct device *dev)
+{
+	const struct scd4x_data *data = dev->data;
+
+	return data->mode == SCD4X_MODE_LOW_POWER ? SCD4X_LOW_POWER_INTERVAL_MS
+						  : SCD4X_PERIODIC_INTERVAL_MS;
+}
+
+static void scd4x_trigger_shot(struct scd4x_data *data)
+{
+	sensor_trigger_handler_t handler = data->trigger_handler;
+	int64_t due_ms;
+	int ret;
+
+	ret = scd4x_shot_ready(data->dev, &due_ms);
+	if (ret == -EAGAIN) {
+		k_work_reschedule(&data->trigger_work, K_TIMEOUT_ABS_MS(due_ms));
+		return;
+	}
+	if (ret < 0) {
+		/* sample_fetch starts another shot and reports the error */
+		LOG_WRN("Failed to take single shot.");
+	}
+
+	handler(data->dev, data->trigger);
+}
+
+static void scd4x_trigger_work_cb(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct scd4x_data *data = CONTAINER_OF(dwork, struct scd4x_data, trigger_work);
+	sensor_trigger_handler_t handler = data->trigger_handler;
+	bool is_data_ready;
+	int ret;
+
+	if (handler == NULL) {
+		return;
+	}
+
+	if (scd4x_mode_is_single_shot(data->mode)) {
+		scd4x_trigger_shot(data);
+		return;
+	}
+
+	ret = scd4x_data_ready(data->dev, &is_data_ready);
+	if (ret < 0 || !is_data_ready) {
+		if (ret < 0) {
+			LOG_WRN("Failed to check data ready.");
+		}
+		k_work_reschedule(dwork, K_MSEC(SCD4X_DATA_READY_RETRY_MS));
+		return;
+	}
+
+	handler(data->dev, data->trigger);
+
+	/* The handler may have disarmed the trigger */
+	if (data->trigger_handler != NULL) {
+		k_work_reschedule(dwork, K_MSEC(scd4x_interval_ms(data->dev)));
+	}
+}
+
+int scd4x_trigger_set(const struct device *dev, const struct sensor_trigger *trig,
+		      sensor_trigger_handler_t handler)
+{
+	struct scd4x_data *data = dev->data;
+	int ret;
+
+	if (trig->type != SENSOR_TRIG_DATA_READY) {
+		return -ENOTSUP;
+	}
+
+	data->trigger_handler = NULL;
+	if (k_current_get() != k_work_queue_thread_get(&k_sys_work_q)) {
+		struct k_work_sync sync;
+
+		k_work_cancel_delayable_sync(&data->trigger_work, &sync);
+	} else {
+		k_work_cancel_delayable(&data->trigger_work);
+	}
+
+	if (handler == NULL) {
+		return 0;
+	}
+
+	if (scd4x_mode_is_single_shot(data->mode)) {
+		ret = scd4x_shot_start(dev, SCD4X_CMD_MEASURE_SINGLE_SHOT);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	data->trigger = trig;
+	data->trigger_handler = handler;
+	k_work_reschedule(&data->trigger_work, K_NO_WAIT);
+
+	return 0;
+}
+
+int scd4x_init_trigger(const struct device *dev)
+{
+	struct scd4x_data *data = dev->data;
+
+	data->dev = dev;
+	k_work_init_delayable(&data->trigger_work, scd4x_trigger_work_cb);
+
+	return 0;
+}
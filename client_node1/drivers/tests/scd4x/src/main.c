@@ -0,0 +1,89 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/ztest.h>
+
+#include "sensor/scd4x/scd4x.h"
+#include "sensor/scd4x/scd4x_emul.h"
+
+static const struct device *const scd41 = DEVICE_DT_GET(DT_NODELABEL(scd41));
+
+static const struct scd4x_emul_sample trace[] = {
+	{.ms = 0, .co2 = 800, .temp = 21000, .humidity = 40000},
+};
+
+static K_SEM_DEFINE(chain_done, 0, 1);
+static int chain_result;
+
+static void chain_cb(const struct device *dev, int result, void *user_data)
+{
+	chain_result = result;
+	k_sem_give(&chain_done);
+}
+
+/* Command execution times follow simulated time, a chain is done well within it */
+static int chain_wait(void)
+{
+	zassert_ok(k_sem_take(&chain_done, K_SECONDS(2)));
+	return chain_result;
+}
+
+static int read_sample(void)
+{
+	zassert_ok(scd4x_read_sample_async(scd41, chain_cb, NULL));
+	return chain_wait();
+}
+
+static void wait_data_ready(void)
+{
+	bool ready = false;
+
+	for (int i = 0; i < 2 * SCD4X_PERIODIC_INTERVAL_MS / 100 && !ready; i++) {
+		zassert_ok(scd4x_data_ready_async(scd41, &ready, chain_cb, NULL));
+		zassert_ok(chain_wait());
+		if (!ready) {
+			k_sleep(K_MSEC(100));
+		}
+	}
+	zassert_true(ready, "no periodic measurement");
+}
+
+ZTEST(scd4x_async, test_periodic_read_needs_new_sample)
+{
+	struct sensor_value co2;
+
+	wait_data_ready();
+	zassert_ok(read_sample());
+	zassert_ok(sensor_channel_get(scd41, SENSOR_CHAN_CO2, &co2));
+	zassert_equal(co2.val1, 800);
+
+	/* Nothing new yet, the chain stops before reading the measurement again */
+	zassert_equal(read_sample(), -EAGAIN);
+
+	k_sleep(K_MSEC(SCD4X_PERIODIC_INTERVAL_MS));
+	zassert_ok(read_sample());
+}
+
+ZTEST(scd4x_async, test_one_chain_at_a_time)
+{
+	bool ready;
+
+	zassert_ok(scd4x_data_ready_async(scd41, &ready, chain_cb, NULL));
+	zassert_equal(scd4x_read_sample_async(scd41, chain_cb, NULL), -EBUSY);
+	zassert_ok(chain_wait());
+}
+
+static void *scd4x_async_setup(void)
+{
+	zassert_true(device_is_ready(scd41));
+	zassert_ok(scd4x_emul_set_trace(EMUL_DT_GET(DT_NODELABEL(scd41)), trace,
+					ARRAY_SIZE(trace), 0));
+	return NULL;
+}
+
+ZTEST_SUITE(scd4x_async, NULL, scd4x_async_setup, NULL, NULL, NULL);
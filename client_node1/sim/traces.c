@@ -0,0 +1,54 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/drivers/emul.h>
+#include "sensor/ccs811/ccs811_emul.h"
+#include "sensor/scd4x/scd4x_emul.h"
+
+// Air of a meeting room over an hour, played back by the emulated sensors
+// on native_sim. It covers every band of the dashboard and a send-on-delta
+// event per step, with one out of bounds CCS811 reading for the validity
+// checks.
+#define TRACE_PERIOD_MS (60 * 60 * 1000)
+
+static const struct scd4x_emul_sample scd41_trace[] = {
+    // Empty room
+    { .ms = 0, .co2 = 450, .temp = 21000, .humidity = 40000 },
+    // People coming in
+    { .ms = 5 * 60 * 1000, .co2 = 700, .temp = 21500, .humidity = 42000 },
+    { .ms = 15 * 60 * 1000, .co2 = 1100, .temp = 22500, .humidity = 46000 },
+    { .ms = 25 * 60 * 1000, .co2 = 1600, .temp = 23500, .humidity = 50000 },
+    { .ms = 35 * 60 * 1000, .co2 = 2100, .temp = 24000, .humidity = 53000 },
+    // Windows opened
+    { .ms = 45 * 60 * 1000, .co2 = 900, .temp = 20500, .humidity = 44000 },
+    { .ms = 50 * 60 * 1000, .co2 = 500, .temp = 19500, .humidity = 41000 },
+};
+
+static const struct ccs811_emul_sample ccs811_trace[] = {
+    { .ms = 0, .eco2 = 420, .tvoc = 30 },
+    { .ms = 5 * 60 * 1000, .eco2 = 680, .tvoc = 120 },
+    { .ms = 15 * 60 * 1000, .eco2 = 1050, .tvoc = 260 },
+    // Saturated for a minute, rejected by the validity bounds
+    { .ms = 20 * 60 * 1000, .eco2 = 8192, .tvoc = 1187 },
+    { .ms = 21 * 60 * 1000, .eco2 = 1200, .tvoc = 330 },
+    { .ms = 25 * 60 * 1000, .eco2 = 1550, .tvoc = 480 },
+    { .ms = 35 * 60 * 1000, .eco2 = 2000, .tvoc = 650 },
+    { .ms = 45 * 60 * 1000, .eco2 = 850, .tvoc = 200 },
+    { .ms = 50 * 60 * 1000, .eco2 = 480, .tvoc = 60 },
+};
+
+static int traces_init(void)
+{
+    int ret;
+
+    ret = scd4x_emul_set_trace(EMUL_DT_GET(DT_NODELABEL(scd41)), scd41_trace,
+                               ARRAY_SIZE(scd41_trace), TRACE_PERIOD_MS);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return ccs811_emul_set_trace(EMUL_DT_GET(DT_NODELABEL(ccs811)), ccs811_trace,
+                                 ARRAY_SIZE(ccs811_trace), TRACE_PERIOD_MS);
+}
+
+// Before main() so the first window already samples the trace
+SYS_INIT(traces_init, APPLICATION, 0);
@@ -6,114 +6,14 @@
 #include <stdio.h>
 #include <zephyr/logging/log.h>
 #include "sensor/scd4x/scd4x.h"
-#include <openthread/coap.h>
-#include <openthread/thread.h>
-#include <zephyr/net/openthread.h> 
+#include <iaq/accum.h>
+#include <iaq/delta.h>
+#include <iaq/filter.h>
+#include <iaq/param.h>
+#include <iaq/report.h>
+#include <iaq/timesync.h>
+#include <iaq/uplink.h>
 
-// THREAD NETWORK CONFIGURATION //
-void coap_init(void)
-{
-	otInstance *p_instance = openthread_get_default_instance();
-	otError error = otCoapStart(p_instance, OT_DEFAULT_COAP_PORT);
-	if (error != OT_ERROR_NONE)
-		printk("Failed to start Coap: %d\n", error);
-	else
-	{
-		printk("Coap started successfully.\n");
-	}
-}
-static void coap_send_data_response_cb(void *p_context, otMessage *p_message,
-									   const otMessageInfo *p_message_info, otError result)
-{
-	if (result == OT_ERROR_NONE)
-	{
-		printk("Delivery confirmed.\n");
-	}
-	else
-	{
-		printk("Delivery not confirmed: %d\n", result);
-	}
-}
-static void send_coap_message(const char *uri_path, const char *payload)
-{
-	otError error = OT_ERROR_NONE;
-	otMessage *message;
-	otMessageInfo message_info;
-	otInstance *instance = openthread_get_default_instance();
-	const otMeshLocalPrefix *mesh_prefix = otThreadGetMeshLocalPrefix(instance);
-	uint8_t server_interface_id[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01};
-
-	do
-	{
-		// Allocate a new CoAP message
-		message = otCoapNewMessage(instance, NULL);
-		if (message == NULL)
-		{
-			printk("Failed to allocate CoAP message\n");
-			return;
-		}
-
-		// Initialize the CoAP message
-		otCoapMessageInit(message, OT_COAP_TYPE_CONFIRMABLE, OT_COAP_CODE_PUT);
-
-		// Append URI path
-		error = otCoapMessageAppendUriPathOptions(message, uri_path);
-		if (error != OT_ERROR_NONE)
-		{
-			printk("Failed to append URI path: %d\n", error);
-			otMessageFree(message);
-			return;
-		}
-
-		// Append content format option (JSON)
-		error = otCoapMessageAppendContentFormatOption(message, OT_COAP_OPTION_CONTENT_FORMAT_JSON);
-		if (error != OT_ERROR_NONE)
-		{
-			printk("Failed to append content format option: %d\n", error);
-			otMessageFree(message);
-			return;
-		}
-
-		// Set payload marker
-		error = otCoapMessageSetPayloadMarker(message);
-		if (error != OT_ERROR_NONE)
-		{
-			printk("Failed to set payload marker: %d\n", error);
-			otMessageFree(message);
-			return;
-		}
-
-		// Append payload
-		error = otMessageAppend(message, payload, strlen(payload));
-		if (error != OT_ERROR_NONE)
-		{
-			printk("Failed to append payload: %d\n", error);
-			otMessageFree(message);
-			return;
-		}
-
-		// Set up message info
-		memset(&message_info, 0, sizeof(message_info));
-		memcpy(&message_info.mPeerAddr.mFields.m8[0], mesh_prefix, 8);
-		memcpy(&message_info.mPeerAddr.mFields.m8[8], server_interface_id, 8);
-		message_info.mPeerPort = OT_DEFAULT_COAP_PORT;
-
-		// Send the CoAP request
-		error = otCoapSendRequest(instance, message, &message_info, coap_send_data_response_cb, NULL);
-	} while (false);
-
-	if (error != OT_ERROR_NONE)
-	{
-		printk("Failed to send CoAP request: %d\n", error);
-		otMessageFree(message);
-	}
-	else
-	{
-		printk("CoAP message sent successfully.\n");
-	}
-}
-
-// THREAD NETWORK CONFIGURATION ENDS //
 #if !DT_HAS_COMPAT_STATUS_OKAY(sensirion_scd41)
 #error "No sensirion,scd4x compatible node found in the device tree"
 #endif
@@ -125,79 +25,241 @@ static void send_coap_message(const char *uri_path, const char *payload)
 const struct device *scd41 = DEVICE_DT_GET_ANY(sensirion_scd41);
 const struct device *ccs811 = DEVICE_DT_GET_ANY(ams_ccs811);
 
-// Function to send data in JSON format to CoAP Server
-void send_error_message(const char *message, bool *scd41_ok, bool *ccs811_ok)
+// Default sampling schedule: 3 readings 15 s apart, one report window per minute
+#define SAMPLE_INTERVAL_MS      15000
+#define SAMPLES_PER_WINDOW      3
+#define WINDOW_MS               60000
+// Longest wait for a data ready event (one SCD41 low power interval + margin)
+#define DATA_READY_TIMEOUT_MS   35000
+// SCD41 mode parameter picking the cheapest mode for the sample interval
+#define SCD41_MODE_AUTO         -1
+// The SCD41 keeps the mode of its devicetree node until the server sets one
+#define SCD41_MODE_DEFAULT      DT_ENUM_IDX_OR(DT_INST(0, sensirion_scd41), mode, SCD41_MODE_AUTO)
+
+// Send-on-delta rules, the band edges are those of get_air_quality_status()
+// in the dashboard so every change of the displayed status is reported
+static const struct iaq_delta_rule co2_rule = {
+    .delta = IAQ_DELTA_UNITS(CONFIG_APP_DELTA_CO2_PPM),
+    .bands = { IAQ_DELTA_UNITS(800), IAQ_DELTA_UNITS(1000) },
+    .num_bands = 2,
+};
+static const struct iaq_delta_rule temp_rule = {
+    .delta = IAQ_DELTA_UNITS(CONFIG_APP_DELTA_TEMP_DECI_C) / 10,
+    .bands = { IAQ_DELTA_UNITS(16), IAQ_DELTA_UNITS(19), IAQ_DELTA_UNITS(25), IAQ_DELTA_UNITS(28) },
+    .num_bands = 4,
+};
+static const struct iaq_delta_rule humi_rule = {
+    .delta = IAQ_DELTA_UNITS(CONFIG_APP_DELTA_HUMIDITY_PCT),
+    .bands = { IAQ_DELTA_UNITS(25), IAQ_DELTA_UNITS(30), IAQ_DELTA_UNITS(60), IAQ_DELTA_UNITS(70) },
+    .num_bands = 4,
+};
+static const struct iaq_delta_rule tvoc_rule = {
+    .delta = IAQ_DELTA_UNITS(CONFIG_APP_DELTA_TVOC_PPB),
+    .bands = { IAQ_DELTA_UNITS(250), IAQ_DELTA_UNITS(500) },
+    .num_bands = 2,
+};
+
+// Parameters the server node can change at runtime, see iaq/param.h.
+// Bounds are inclusive, in milli-units, within the range of the sensor.
+static struct iaq_param params[] = {
+    // id, min, max, default
+    { IAQ_PARAM_SAMPLE_INTERVAL, 1000, 600000, SAMPLE_INTERVAL_MS },
+    { IAQ_PARAM_SAMPLES_PER_WINDOW, 1, 60, SAMPLES_PER_WINDOW },
+    { IAQ_PARAM_WINDOW, 1000, 86400000, WINDOW_MS },
+#ifdef CONFIG_IAQ_UPLINK
+    { IAQ_PARAM_BATCH_WINDOWS, 1, 255, CONFIG_IAQ_UPLINK_BATCH_WINDOWS },
+#endif
+    { IAQ_PARAM_SCD41_MODE, SCD41_MODE_AUTO, SCD4X_MODE_COUNT - 1, SCD41_MODE_DEFAULT },
+    // 0 ppm is what the SCD41 reads before its first measurement
+    { IAQ_PARAM_MIN(IAQ_FIELD_CO2), 0, 40000000, 1000 },
+    { IAQ_PARAM_MAX(IAQ_FIELD_CO2), 0, 40000000, 5000000 },
+    { IAQ_PARAM_MIN(IAQ_FIELD_TEMPERATURE), -40000, 85000, -40000 },
+    { IAQ_PARAM_MAX(IAQ_FIELD_TEMPERATURE), -40000, 85000, 85000 },
+    { IAQ_PARAM_MIN(IAQ_FIELD_HUMIDITY), 0, 100000, 0 },
+    { IAQ_PARAM_MAX(IAQ_FIELD_HUMIDITY), 0, 100000, 100000 },
+    // The CCS811 reads 400 ppm eCO2 while warming up, 8192 ppm and 1187 ppb when saturated
+    { IAQ_PARAM_MIN(IAQ_FIELD_ECO2), 400000, 8192000, 401000 },
+    { IAQ_PARAM_MAX(IAQ_FIELD_ECO2), 400000, 8192000, 8191000 },
+    { IAQ_PARAM_MIN(IAQ_FIELD_TVOC), 0, 1187000, 0 },
+    { IAQ_PARAM_MAX(IAQ_FIELD_TVOC), 0, 1187000, 1186000 },
+};
+
+// Last reported value of every metric
+static struct iaq_delta co2_41_delta, temp_delta, humi_delta, co2_811_delta, tvoc_delta;
+static int64_t last_report_ms;
+
+static enum iaq_delta_event check_delta(const struct iaq_delta *state, const struct iaq_delta_rule *rule,
+                                        const struct sensor_value *val, enum iaq_delta_event event)
 {
-	char payload[256]; // Buffer to hold the JSON payload
+    return MAX(event, iaq_delta_check(state, rule, sensor_value_to_micro(val)));
+}
 
-	// Construct the JSON payload
-	snprintf(payload, sizeof(payload), "{\"error\":\"%s\",\"SCD41_OK\":%s,\"CCS811_OK\":%s}\n", message, (*scd41_ok) ? "true" : "false", (*ccs811_ok) ? "true" : "false");
+static K_SEM_DEFINE(scd41_ready, 0, 1);
+static K_SEM_DEFINE(ccs811_ready, 0, 1);
 
-	// Send the CoAP message
-	send_coap_message("sensor_data", payload);
+static void scd41_data_ready(const struct device *dev, const struct sensor_trigger *trig)
+{
+    k_sem_give(&scd41_ready);
 }
 
-void send_scd41_data(struct sensor_value co2_41, struct sensor_value temo, struct sensor_value humi, bool *scd41_ok)
+static void ccs811_data_ready(const struct device *dev, const struct sensor_trigger *trig)
 {
-	char payload[256]; // Buffer to hold the JSON payload
+    k_sem_give(&ccs811_ready);
+}
 
-	// Construct the JSON payload
-	snprintf(payload, sizeof(payload),
-			 "{\"sensor\":\"scd41\",\"data\":{\"CO2\":%d.%02d,\"Temperature\":%d.%02d,\"Humidity\":%d.%02d, \"SCD41_OK\":%s}}\n",
-			 co2_41.val1, co2_41.val2, temo.val1, temo.val2, humi.val1, humi.val2,
-			 (*scd41_ok) ? "true" : "false");
+// Block until the sensor reports a new measurement, then fetch it. The
+// trigger is only armed while waiting so the sensor is not serviced
+// between the readings of a window. Falls back to a plain fetch for
+// drivers built without trigger support.
+static int fetch_when_ready(const struct device *dev, struct k_sem *ready,
+                            sensor_trigger_handler_t handler)
+{
+    static const struct sensor_trigger trig = {
+        .type = SENSOR_TRIG_DATA_READY,
+        .chan = SENSOR_CHAN_ALL,
+    };
+    int ret;
+
+    k_sem_reset(ready);
+    ret = sensor_trigger_set(dev, &trig, handler);
+    if (ret == 0) {
+        ret = k_sem_take(ready, K_MSEC(DATA_READY_TIMEOUT_MS));
+        sensor_trigger_set(dev, &trig, NULL);
+        if (ret < 0) {
+            printk("Timed out waiting for %s data\n", dev->name);
+            return ret;
+        }
+    } else if (ret != -ENOSYS && ret != -ENOTSUP) {
+        return ret;
+    }
 
-	// Send the CoAP message
-	send_coap_message("sensor_data", payload);
+    return sensor_sample_fetch(dev);
 }
 
-void send_ccs811_data(struct sensor_value co2_881, struct sensor_value tvoc, bool *ccs881_ok)
+// Put the SCD41 in the mode set by the server, or in the one using the
+// least energy per sample that still delivers a sample every interval.
+static void scd41_set_mode(int32_t setting, int32_t sample_interval_ms)
 {
-	char payload[256]; // Buffer to hold the JSON payload
+    static int32_t current = SCD41_MODE_AUTO;
+    struct sensor_value mode = { .val1 = setting, .val2 = 0 };
+    uint32_t energy_uj, best_uj = UINT32_MAX;
+
+    if (setting == SCD41_MODE_AUTO) {
+        mode.val1 = SCD4X_MODE_NORMAL;
+        for (int i = 0; i < SCD4X_MODE_COUNT; i++) {
+            if (scd4x_sample_energy(scd41, i, sample_interval_ms, &energy_uj) == 0 &&
+                energy_uj < best_uj) {
+                mode.val1 = i;
+                best_uj = energy_uj;
+            }
+        }
+    }
+    if (mode.val1 == current) {
+        return;
+    }
 
-	// Construct the JSON payload
-	snprintf(payload, sizeof(payload),
-			 "{\"sensor\":\"ccs811\",\"data\":{\"eCO2\":%d.%02d,\"TVOC\":%d.%02d, \"CCS811_OK\":%s}}\n",
-			 co2_881.val1, co2_881.val2, tvoc.val1, tvoc.val2, (*ccs881_ok) ? "true" : "false");
+    if (sensor_attr_set(scd41, SENSOR_CHAN_ALL, SENSOR_ATTR_SCD4X_MODE, &mode) < 0) {
+        printk("Failed to set SCD41 mode %d\n", mode.val1);
+        return;
+    }
+    current = mode.val1;
+    if (scd4x_sample_energy(scd41, current, sample_interval_ms, &energy_uj) == 0) {
+        printk("SCD41 mode %d %s, %u uJ per sample\n", current,
+            setting == SCD41_MODE_AUTO ? "picked for the interval" : "as set", energy_uj);
+    }
+}
 
-	// Send the CoAP message
-	send_coap_message("sensor_data", payload);
+static uint8_t node_status(bool *scd41_ok, bool *ccs811_ok)
+{
+	return ((*scd41_ok) ? IAQ_STATUS_SCD41_OK : 0) | ((*ccs811_ok) ? IAQ_STATUS_CCS811_OK : 0);
+}
+
+// Function to queue an error report for the CoAP Server
+void send_error_message(enum iaq_sensor sensor, enum iaq_error code, bool *scd41_ok, bool *ccs811_ok)
+{
+	struct iaq_report report;
+
+	iaq_report_init(&report, sensor, node_status(scd41_ok, ccs811_ok));
+	iaq_report_put(&report, IAQ_FIELD_ERROR, code);
+
+	// Queue the report for the next batch
+	iaq_uplink_queue(&report);
+}
+
+void send_scd41_data(const struct iaq_accum *co2_41, const struct iaq_accum *temp,
+                     const struct iaq_accum *humi, bool *scd41_ok)
+{
+	struct iaq_report report;
+
+	iaq_report_init(&report, IAQ_SENSOR_SCD41, (*scd41_ok) ? IAQ_STATUS_SCD41_OK : 0);
+	iaq_report_put_micro(&report, IAQ_FIELD_CO2, iaq_accum_mean(co2_41));
+	iaq_report_put_micro(&report, IAQ_FIELD_TEMPERATURE, iaq_accum_mean(temp));
+	iaq_report_put_micro(&report, IAQ_FIELD_HUMIDITY, iaq_accum_mean(humi));
+
+	// Queue the report for the next batch
+	iaq_uplink_queue(&report);
+
+	iaq_delta_update(&co2_41_delta, iaq_accum_mean(co2_41));
+	iaq_delta_update(&temp_delta, iaq_accum_mean(temp));
+	iaq_delta_update(&humi_delta, iaq_accum_mean(humi));
+	last_report_ms = k_uptime_get();
+}
+
+void send_ccs811_data(const struct iaq_accum *co2_881, const struct iaq_accum *tvoc, bool *ccs881_ok)
+{
+	struct iaq_report report;
+
+	iaq_report_init(&report, IAQ_SENSOR_CCS811, (*ccs881_ok) ? IAQ_STATUS_CCS811_OK : 0);
+	iaq_report_put_micro(&report, IAQ_FIELD_ECO2, iaq_accum_mean(co2_881));
+	iaq_report_put_micro(&report, IAQ_FIELD_TVOC, iaq_accum_mean(tvoc));
+
+	// Queue the report for the next batch
+	iaq_uplink_queue(&report);
+
+	iaq_delta_update(&co2_811_delta, iaq_accum_mean(co2_881));
+	iaq_delta_update(&tvoc_delta, iaq_accum_mean(tvoc));
+	last_report_ms = k_uptime_get();
 }
 
 bool is_scd41_data_valid(struct sensor_value co2, struct sensor_value temp, struct sensor_value hum) {
-	return (co2.val1 > 0 && co2.val1 < 5000) &&
-           (temp.val1 > -40 && temp.val1 < 85) &&
-           (hum.val1 >= 0 && hum.val1 <= 100);
+	return iaq_param_in_bounds(IAQ_FIELD_CO2, &co2) &&
+           iaq_param_in_bounds(IAQ_FIELD_TEMPERATURE, &temp) &&
+           iaq_param_in_bounds(IAQ_FIELD_HUMIDITY, &hum);
 }
 
 bool is_ccs811_data_valid(struct sensor_value co2, struct sensor_value voc) {
-    return (co2.val1 > 400 && co2.val1 < 8192) &&
-           (voc.val1 >= 0 && voc.val1 < 1187); 
+    return iaq_param_in_bounds(IAQ_FIELD_ECO2, &co2) &&
+           iaq_param_in_bounds(IAQ_FIELD_TVOC, &voc);
 }
 
 int main(void)
 {
     bool SCD41_OK = false;
     bool CCS811_OK = false;
-    coap_init();
+    iaq_uplink_init();
+    iaq_timesync_init();
+    iaq_param_init(params, ARRAY_SIZE(params));
 
     if (!device_is_ready(scd41) && !device_is_ready(ccs811)) {
         printk("SCD41 and CCS811 device is not ready\n");
-        send_error_message("SCD41 and CCS811 not ready - Sensors not connected or Sensor's PINs mis-configured.", &SCD41_OK, &CCS811_OK);
+        send_error_message(IAQ_SENSOR_NONE, IAQ_ERROR_NOT_READY, &SCD41_OK, &CCS811_OK);
+        iaq_uplink_flush();
         return -1;
     }
 
     if (!device_is_ready(scd41) && device_is_ready(ccs811)) {
         CCS811_OK = true;
         printk("SCD41 device is not ready\n");
-        send_error_message("SCD41 not ready - Sensor not connected or Sensor's PINs mis-configured.", &SCD41_OK, &CCS811_OK);
+        send_error_message(IAQ_SENSOR_SCD41, IAQ_ERROR_NOT_READY, &SCD41_OK, &CCS811_OK);
+        iaq_uplink_flush();
         return -1;
     }
 
     if (!device_is_ready(ccs811) && device_is_ready(scd41)) {
         SCD41_OK = true;
         printk("CCS811 device is not ready\n");
-        send_error_message("CCS811 not ready - Sensor not connected or Sensor's PINs mis-configured.", &SCD41_OK, &CCS811_OK);
+        send_error_message(IAQ_SENSOR_CCS811, IAQ_ERROR_NOT_READY, &SCD41_OK, &CCS811_OK);
+        iaq_uplink_flush();
         return -1;
     }
 
@@ -206,98 +268,129 @@ int main(void)
     printk("SCD41 and CCS811 devices are ready\n");
 
     struct sensor_value co2_41, temp, humi, co2_811, tvoc;
-    struct sensor_value co2_41_sum = {0}, temp_sum = {0}, humi_sum = {0};
-    struct sensor_value co2_811_sum = {0}, tvoc_sum = {0};
+    // Averages of the valid readings of the window, in micro-units
+    struct iaq_accum co2_41_acc, temp_acc, humi_acc, co2_811_acc, tvoc_acc;
+    // Spike rejection over the most recent samples, kept across windows
+    struct iaq_filter co2_41_filt, temp_filt, humi_filt, co2_811_filt, tvoc_filt;
 
-    int valid_scd41_readings = 0;
-    int valid_ccs811_readings = 0;
+    iaq_filter_reset(&co2_41_filt);
+    iaq_filter_reset(&temp_filt);
+    iaq_filter_reset(&humi_filt);
+    iaq_filter_reset(&co2_811_filt);
+    iaq_filter_reset(&tvoc_filt);
+
+    // Readings run on an absolute schedule so time spent waiting for the
+    // sensors does not make the report windows drift
+    int64_t window_start = k_uptime_get();
 
     while (true) {
-        // Reset sums and counters for averaging
-        co2_41_sum = (struct sensor_value){0};
-        temp_sum = (struct sensor_value){0};
-        humi_sum = (struct sensor_value){0};
-        co2_811_sum = (struct sensor_value){0};
-        tvoc_sum = (struct sensor_value){0};
-        valid_scd41_readings = 0;
-        valid_ccs811_readings = 0;
-
-        // Collect 3 readings over 15 seconds
-        for (int i = 0; i < 3; i++) {
-            // Fetch data from SCD41
-            if (sensor_sample_fetch(scd41) == 0) {
+        // Parameters changed by the server apply from the next window on
+        int32_t sample_interval_ms = iaq_param_get(IAQ_PARAM_SAMPLE_INTERVAL);
+        int32_t samples_per_window = iaq_param_get(IAQ_PARAM_SAMPLES_PER_WINDOW);
+        int32_t window_ms = iaq_param_get(IAQ_PARAM_WINDOW);
+
+        iaq_uplink_set_batch_windows(iaq_param_get(IAQ_PARAM_BATCH_WINDOWS));
+        scd41_set_mode(iaq_param_get(IAQ_PARAM_SCD41_MODE), sample_interval_ms);
+
+        // Start a new averaging window
+        iaq_accum_reset(&co2_41_acc);
+        iaq_accum_reset(&temp_acc);
+        iaq_accum_reset(&humi_acc);
+        iaq_accum_reset(&co2_811_acc);
+        iaq_accum_reset(&tvoc_acc);
+
+        // Worst change since the last report among the samples taken
+        enum iaq_delta_event event = IAQ_DELTA_NONE;
+        int taken = 0;
+
+        // Collect the readings of the window until something changes
+        while (taken < samples_per_window && event == IAQ_DELTA_NONE) {
+            int i = taken++;
+
+            if (i > 0) {
+                k_sleep(K_TIMEOUT_ABS_MS(window_start + (int64_t)i * sample_interval_ms));
+            }
+
+            // Fetch data from SCD41 as soon as a new measurement is ready
+            if (fetch_when_ready(scd41, &scd41_ready, scd41_data_ready) == 0) {
                 sensor_channel_get(scd41, SENSOR_CHAN_CO2, &co2_41);
                 sensor_channel_get(scd41, SENSOR_CHAN_AMBIENT_TEMP, &temp);
                 sensor_channel_get(scd41, SENSOR_CHAN_HUMIDITY, &humi);
 
                 if (is_scd41_data_valid(co2_41, temp, humi)) {
-                    co2_41_sum.val1 += co2_41.val1;
-                    co2_41_sum.val2 += co2_41.val2;
-                    temp_sum.val1 += temp.val1;
-                    temp_sum.val2 += temp.val2;
-                    humi_sum.val1 += humi.val1;
-                    humi_sum.val2 += humi.val2;
-                    valid_scd41_readings++;
+                    iaq_filter_apply(&co2_41_filt, &co2_41);
+                    iaq_filter_apply(&temp_filt, &temp);
+                    iaq_filter_apply(&humi_filt, &humi);
+                    iaq_accum_add(&co2_41_acc, &co2_41);
+                    iaq_accum_add(&temp_acc, &temp);
+                    iaq_accum_add(&humi_acc, &humi);
+                    event = check_delta(&co2_41_delta, &co2_rule, &co2_41, event);
+                    event = check_delta(&temp_delta, &temp_rule, &temp, event);
+                    event = check_delta(&humi_delta, &humi_rule, &humi, event);
                 }
             } else {
                 printk("Failed to fetch sample from SCD41\n");
             }
 
             // Fetch data from CCS811
-            if (sensor_sample_fetch(ccs811) == 0) {
+            if (fetch_when_ready(ccs811, &ccs811_ready, ccs811_data_ready) == 0) {
                 sensor_channel_get(ccs811, SENSOR_CHAN_CO2, &co2_811);
                 sensor_channel_get(ccs811, SENSOR_CHAN_VOC, &tvoc);
 
                 if (is_ccs811_data_valid(co2_811, tvoc)) {
-                    co2_811_sum.val1 += co2_811.val1;
-                    co2_811_sum.val2 += co2_811.val2;
-                    tvoc_sum.val1 += tvoc.val1;
-                    tvoc_sum.val2 += tvoc.val2;
-                    valid_ccs811_readings++;
+                    iaq_filter_apply(&co2_811_filt, &co2_811);
+                    iaq_filter_apply(&tvoc_filt, &tvoc);
+                    iaq_accum_add(&co2_811_acc, &co2_811);
+                    iaq_accum_add(&tvoc_acc, &tvoc);
+                    event = check_delta(&co2_811_delta, &co2_rule, &co2_811, event);
+                    event = check_delta(&tvoc_delta, &tvoc_rule, &tvoc, event);
                 }
             } else {
                 printk("Failed to fetch sample from CCS811\n");
             }
-
-            k_sleep(K_SECONDS(15)); // Wait 5 seconds before the next reading
         }
 
-        // Calculate averages
-        if (valid_scd41_readings > 0) {
-            co2_41_sum.val1 /= valid_scd41_readings;
-            co2_41_sum.val2 /= valid_scd41_readings;
-            temp_sum.val1 /= valid_scd41_readings;
-            temp_sum.val2 /= valid_scd41_readings;
-            humi_sum.val1 /= valid_scd41_readings;
-            humi_sum.val2 /= valid_scd41_readings;
-        }
+        // Every channel of a sensor is added together, so they share a count
+        uint32_t valid_scd41_readings = co2_41_acc.count;
+        uint32_t valid_ccs811_readings = co2_811_acc.count;
 
-        if (valid_ccs811_readings > 0) {
-            co2_811_sum.val1 /= valid_ccs811_readings;
-            co2_811_sum.val2 /= valid_ccs811_readings;
-            tvoc_sum.val1 /= valid_ccs811_readings;
-            tvoc_sum.val2 /= valid_ccs811_readings;
-        }
+        bool heartbeat = k_uptime_get() - last_report_ms >= CONFIG_IAQ_DELTA_HEARTBEAT * MSEC_PER_SEC;
 
         // Send averaged data conditionally
-        if (valid_scd41_readings > 0 && valid_ccs811_readings > 0) {
+        if (valid_scd41_readings > 0 && valid_ccs811_readings > 0 &&
+            event == IAQ_DELTA_NONE && !heartbeat) {
+            // Steady conditions, not worth a transmission
+            printk("No significant change, report skipped\n");
+        } else if (valid_scd41_readings > 0 && valid_ccs811_readings > 0) {
             printk("Sending averaged data from both sensors...\n");
-            send_scd41_data(co2_41_sum, temp_sum, humi_sum, &SCD41_OK);
-            send_ccs811_data(co2_811_sum, tvoc_sum, &CCS811_OK);
+            send_scd41_data(&co2_41_acc, &temp_acc, &humi_acc, &SCD41_OK);
+            send_ccs811_data(&co2_811_acc, &tvoc_acc, &CCS811_OK);
         } else if (valid_scd41_readings > 0) {
             printk("Sending averaged data from SCD41 only...\n");
-            send_scd41_data(co2_41_sum, temp_sum, humi_sum, &SCD41_OK);
-            send_error_message("CCS811 data invalid, sending SCD41 data only.", &SCD41_OK, &CCS811_OK);
+            send_scd41_data(&co2_41_acc, &temp_acc, &humi_acc, &SCD41_OK);
+            send_error_message(IAQ_SENSOR_CCS811, IAQ_ERROR_INVALID_DATA, &SCD41_OK, &CCS811_OK);
         } else if (valid_ccs811_readings > 0) {
             printk("Sending averaged data from CCS811 only...\n");
-            send_ccs811_data(co2_811_sum, tvoc_sum, &CCS811_OK);
-            send_error_message("SCD41 data invalid, sending CCS811 data only.", &SCD41_OK, &CCS811_OK);
+            send_ccs811_data(&co2_811_acc, &tvoc_acc, &CCS811_OK);
+            send_error_message(IAQ_SENSOR_SCD41, IAQ_ERROR_INVALID_DATA, &SCD41_OK, &CCS811_OK);
         } else {
             printk("No valid data to send (Sensor Data out of bound).\n");
-            send_error_message("INVALID DATA SENT FROM SCD41 and CCS811", &SCD41_OK, &CCS811_OK);
+            send_error_message(IAQ_SENSOR_NONE, IAQ_ERROR_INVALID_DATA, &SCD41_OK, &CCS811_OK);
+        }
+        iaq_uplink_commit();
+        if (event == IAQ_DELTA_BAND) {
+            // The air quality status changed, do not wait for the batch
+            iaq_uplink_flush();
         }
 
-        k_sleep(K_SECONDS(15)); // Sleep for the remaining time to complete 60 seconds
+        // Sleep for the remaining time of the window. A change ends the
+        // window early and the next one starts at the following sample.
+        window_start += (event != IAQ_DELTA_NONE) ? (int64_t)taken * sample_interval_ms : window_ms;
+        if (window_start < k_uptime_get()) {
+            // Fell behind (sensor timeouts), restart the schedule from now
+            window_start = k_uptime_get();
+        }
+        k_sleep(K_TIMEOUT_ABS_MS(window_start));
     }
 
     return 0;
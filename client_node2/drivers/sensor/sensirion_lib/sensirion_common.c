@@ -38,6 +38,7 @@
 #include "sensirion_common.h"
 #include "sensirion_i2c.h"
 #include <zephyr/drivers/i2c.h>
+#include <iaq/sensirion.h>
 
 uint16_t sensirion_bytes_to_uint16_t(const uint8_t* bytes) {
     return (uint16_t)bytes[0] << 8 | (uint16_t)bytes[1];
@@ -59,21 +60,8 @@ float sensirion_bytes_to_float(const uint8_t* bytes) {
 }
 
 uint8_t sensirion_common_generate_crc(const uint8_t* data, uint16_t count) {
-    uint16_t current_byte;
-    uint8_t crc = CRC8_INIT;
-    uint8_t crc_bit;
-
-    /* calculates 8-Bit checksum with given polynomial */
-    for (current_byte = 0; current_byte < count; ++current_byte) {
-        crc ^= (data[current_byte]);
-        for (crc_bit = 8; crc_bit > 0; --crc_bit) {
-            if (crc & 0x80)
-                crc = (crc << 1) ^ CRC8_POLYNOMIAL;
-            else
-                crc = (crc << 1);
-        }
-    }
-    return crc;
+    /* table driven, shared with the SCD4x driver */
+    return iaq_sensirion_crc8(data, count);
 }
 
 int8_t sensirion_common_check_crc(const uint8_t* data, uint16_t count,
@@ -110,26 +98,21 @@ uint16_t sensirion_fill_cmd_send_buf(uint8_t* buf, uint16_t cmd,
 
 int16_t sensirion_i2c_read_words_as_bytes(const struct i2c_dt_spec *dev_bus, uint8_t* data,
                                           uint16_t num_words) {
+    uint8_t buf[IAQ_SENSIRION_BUF_SIZE(SENSIRION_MAX_BUFFER_WORDS)];
     int16_t ret;
-    uint16_t i, j;
-    uint16_t size = num_words * (SENSIRION_WORD_SIZE + CRC8_LEN);
-    uint16_t word_buf[SENSIRION_MAX_BUFFER_WORDS];
-    uint8_t* const buf8 = (uint8_t*)word_buf;
+    uint16_t i;
+
+    if (num_words > SENSIRION_MAX_BUFFER_WORDS)
+        return STATUS_FAIL;
 
-    ret = sensirion_i2c_read(dev_bus, buf8, size);
+    /* reads and checks the CRC of each word in place */
+    ret = iaq_sensirion_read(dev_bus, buf, num_words);
     if (ret != NO_ERROR)
         return ret;
 
-    /* check the CRC for each word */
-    for (i = 0, j = 0; i < size; i += SENSIRION_WORD_SIZE + CRC8_LEN) {
-
-        ret = sensirion_common_check_crc(&buf8[i], SENSIRION_WORD_SIZE,
-                                         buf8[i + SENSIRION_WORD_SIZE]);
-        if (ret != NO_ERROR)
-            return ret;
-
-        data[j++] = buf8[i];
-        data[j++] = buf8[i + 1];
+    for (i = 0; i < num_words; ++i) {
+        data[2 * i] = buf[i * IAQ_SENSIRION_WORD_SIZE];
+        data[2 * i + 1] = buf[i * IAQ_SENSIRION_WORD_SIZE + 1];
     }
 
     return NO_ERROR;
@@ -137,48 +120,40 @@ int16_t sensirion_i2c_read_words_as_bytes(const struct i2c_dt_spec *dev_bus, uin
 
 int16_t sensirion_i2c_read_words(const struct i2c_dt_spec *dev_bus, uint16_t* data_words,
                                  uint16_t num_words) {
+    uint8_t buf[IAQ_SENSIRION_BUF_SIZE(SENSIRION_MAX_BUFFER_WORDS)];
     int16_t ret;
-    uint8_t i;
-    const uint8_t* word_bytes;
+    uint16_t i;
 
-    ret = sensirion_i2c_read_words_as_bytes(dev_bus, (uint8_t*)data_words,
-                                            num_words);
+    if (num_words > SENSIRION_MAX_BUFFER_WORDS)
+        return STATUS_FAIL;
+
+    ret = iaq_sensirion_read(dev_bus, buf, num_words);
     if (ret != NO_ERROR)
         return ret;
 
-    for (i = 0; i < num_words; ++i) {
-        word_bytes = (uint8_t*)&data_words[i];
-        data_words[i] = ((uint16_t)word_bytes[0] << 8) | word_bytes[1];
-    }
+    /* decoded straight from the receive buffer, no intermediate copy */
+    for (i = 0; i < num_words; ++i)
+        data_words[i] = iaq_sensirion_get_u16(buf, i);
 
     return NO_ERROR;
 }
 
 int16_t sensirion_i2c_write_cmd(const struct i2c_dt_spec *dev_bus, uint16_t command) {
-    uint8_t buf[SENSIRION_COMMAND_SIZE];
-
-    sensirion_fill_cmd_send_buf(buf, command, NULL, 0);
-    return sensirion_i2c_write(dev_bus, buf, SENSIRION_COMMAND_SIZE);
+    return iaq_sensirion_write(dev_bus, command, NULL, 0);
 }
 
 int16_t sensirion_i2c_write_cmd_with_args(const struct i2c_dt_spec *dev_bus, uint16_t command,
                                           const uint16_t* data_words,
                                           uint16_t num_words) {
-    uint8_t buf[SENSIRION_MAX_BUFFER_WORDS];
-    uint16_t buf_size;
-
-    buf_size = sensirion_fill_cmd_send_buf(buf, command, data_words, num_words);
-    return sensirion_i2c_write(dev_bus, buf, buf_size);
+    return iaq_sensirion_write(dev_bus, command, data_words, num_words);
 }
 
 int16_t sensirion_i2c_delayed_read_cmd(const struct i2c_dt_spec *dev_bus, uint16_t cmd,
                                        uint32_t delay_us, uint16_t* data_words,
                                        uint16_t num_words) {
     int16_t ret;
-    uint8_t buf[SENSIRION_COMMAND_SIZE];
 
-    sensirion_fill_cmd_send_buf(buf, cmd, NULL, 0);
-    ret = sensirion_i2c_write(dev_bus, buf, SENSIRION_COMMAND_SIZE);
+    ret = iaq_sensirion_write(dev_bus, cmd, NULL, 0);
     if (ret != NO_ERROR)
         return ret;
 
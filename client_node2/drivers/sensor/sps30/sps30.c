@@ -35,25 +35,7 @@
 #include "sensirion_arch_config.h"
 #include "sensirion_common.h"
 #include "sensirion_i2c.h"
-
-#define SPS_CMD_START_MEASUREMENT 0x0010
-#define SPS_CMD_START_MEASUREMENT_ARG 0x0300
-#define SPS_CMD_STOP_MEASUREMENT 0x0104
-#define SPS_CMD_READ_MEASUREMENT 0x0300
-#define SPS_CMD_START_STOP_DELAY_USEC 20000
-#define SPS_CMD_GET_DATA_READY 0x0202
-#define SPS_CMD_AUTOCLEAN_INTERVAL 0x8004
-#define SPS_CMD_GET_FIRMWARE_VERSION 0xd100
-#define SPS_CMD_GET_SERIAL 0xd033
-#define SPS_CMD_RESET 0xd304
-#define SPS_CMD_SLEEP 0x1001
-#define SPS_CMD_READ_DEVICE_STATUS_REG 0xd206
-#define SPS_CMD_START_MANUAL_FAN_CLEANING 0x5607
-#define SPS_CMD_WAKE_UP 0x1103
-#define SPS_CMD_DELAY_USEC 5000
-#define SPS_CMD_DELAY_WRITE_FLASH_USEC 20000
-
-#define SPS30_SERIAL_NUM_WORDS ((SPS30_MAX_SERIAL_LEN) / 2)
+#include <iaq/sensirion.h>
 
 int16_t sps30_probe(const struct i2c_dt_spec *dev_bus)
 {
@@ -129,7 +111,8 @@ int16_t sps30_read_data_ready(const struct i2c_dt_spec *dev_bus, uint16_t *data_
 int16_t sps30_read_measurement(const struct i2c_dt_spec *dev_bus, struct sps30_measurement *measurement)
 {
     int16_t error;
-    uint8_t data[10][4];
+    /* 10 floats of 2 words each, decoded in place */
+    uint8_t buf[IAQ_SENSIRION_BUF_SIZE(20)];
 
     error =
         sensirion_i2c_write_cmd(dev_bus, SPS_CMD_READ_MEASUREMENT);
@@ -138,31 +121,30 @@ int16_t sps30_read_measurement(const struct i2c_dt_spec *dev_bus, struct sps30_m
         return error;
     }
 
-    error = sensirion_i2c_read_words_as_bytes(dev_bus, &data[0][0],
-                                              SENSIRION_NUM_WORDS(data));
+    error = iaq_sensirion_read(dev_bus, buf, 20);
 
     if (error != NO_ERROR)
     {
         return error;
     }
 
-    measurement->mc_1p0 = sensirion_bytes_to_float(data[0]);
-    measurement->mc_2p5 = sensirion_bytes_to_float(data[1]);
-    measurement->mc_4p0 = sensirion_bytes_to_float(data[2]);
-    measurement->mc_10p0 = sensirion_bytes_to_float(data[3]);
-    measurement->nc_0p5 = sensirion_bytes_to_float(data[4]);
-    measurement->nc_1p0 = sensirion_bytes_to_float(data[5]);
-    measurement->nc_2p5 = sensirion_bytes_to_float(data[6]);
-    measurement->nc_4p0 = sensirion_bytes_to_float(data[7]);
-    measurement->nc_10p0 = sensirion_bytes_to_float(data[8]);
-    measurement->typical_particle_size = sensirion_bytes_to_float(data[9]);
+    measurement->mc_1p0 = iaq_sensirion_get_float(buf, 0);
+    measurement->mc_2p5 = iaq_sensirion_get_float(buf, 2);
+    measurement->mc_4p0 = iaq_sensirion_get_float(buf, 4);
+    measurement->mc_10p0 = iaq_sensirion_get_float(buf, 6);
+    measurement->nc_0p5 = iaq_sensirion_get_float(buf, 8);
+    measurement->nc_1p0 = iaq_sensirion_get_float(buf, 10);
+    measurement->nc_2p5 = iaq_sensirion_get_float(buf, 12);
+    measurement->nc_4p0 = iaq_sensirion_get_float(buf, 14);
+    measurement->nc_10p0 = iaq_sensirion_get_float(buf, 16);
+    measurement->typical_particle_size = iaq_sensirion_get_float(buf, 18);
 
     return 0;
 }
 
 int16_t sps30_get_fan_auto_cleaning_interval(const struct i2c_dt_spec *dev_bus, uint32_t *interval_seconds)
 {
-    uint8_t data[4];
+    uint8_t buf[IAQ_SENSIRION_BUF_SIZE(2)];
     int16_t error;
 
     error =
@@ -174,14 +156,13 @@ int16_t sps30_get_fan_auto_cleaning_interval(const struct i2c_dt_spec *dev_bus,
 
     sensirion_sleep_usec(SPS_CMD_DELAY_USEC);
 
-    error = sensirion_i2c_read_words_as_bytes(dev_bus, data,
-                                              SENSIRION_NUM_WORDS(data));
+    error = iaq_sensirion_read(dev_bus, buf, 2);
     if (error != NO_ERROR)
     {
         return error;
     }
 
-    *interval_seconds = sensirion_bytes_to_uint32_t(data);
+    *interval_seconds = iaq_sensirion_get_u32(buf, 0);
 
     return 0;
 }
@@ -306,29 +287,82 @@ static int sps30_sample_fetch(const struct device *dev, enum sensor_channel chan
 static int sps30_channel_get(const struct device *dev, enum sensor_channel chan, struct sensor_value *val)
 {
     const struct sps30_data *data = dev->data;
+    float value;
 
-    if (chan == SENSOR_CHAN_PM_1_0)
+    switch ((int)chan)
     {
-        sensor_value_from_float(val, data->mc_1p0);
-        return 0;
-    }
-    if (chan == SENSOR_CHAN_PM_2_5)
-    {
-        sensor_value_from_float(val, data->mc_2p5);
-        return 0;
+    case SENSOR_CHAN_PM_1_0:
+        value = data->mc_1p0;
+        break;
+    case SENSOR_CHAN_PM_2_5:
+        value = data->mc_2p5;
+        break;
+    case SENSOR_CHAN_SPS30_MC_4P0:
+        value = data->mc_4p0;
+        break;
+    case SENSOR_CHAN_PM_10:
+        value = data->mc_10p0;
+        break;
+    case SENSOR_CHAN_SPS30_NC_0P5:
+        value = data->nc_0p5;
+        break;
+    case SENSOR_CHAN_SPS30_NC_1P0:
+        value = data->nc_1p0;
+        break;
+    case SENSOR_CHAN_SPS30_NC_2P5:
+        value = data->nc_2p5;
+        break;
+    case SENSOR_CHAN_SPS30_NC_4P0:
+        value = data->nc_4p0;
+        break;
+    case SENSOR_CHAN_SPS30_NC_10P0:
+        value = data->nc_10p0;
+        break;
+    case SENSOR_CHAN_SPS30_TYPICAL_PARTICLE_SIZE:
+        value = data->typical_particle_size;
+        break;
+    default:
+        return -EINVAL;
     }
-    if (chan == SENSOR_CHAN_PM_10)
-    {
-        sensor_value_from_float(val, data->mc_10p0);
-        return 0;
-    }
-    return -EINVAL;
+
+    sensor_value_from_float(val, value);
+    return 0;
 }
 
 #if defined(CONFIG_PM_DEVICE)
 static int sps30_pm_action(const struct device *dev, enum pm_device_action action)
 {
-    return -ENOTSUP;
+    struct sps30_data *data = dev->data;
+    const struct sps30_config *cfg = dev->config;
+    int16_t ret;
+
+    switch (action)
+    {
+    case PM_DEVICE_ACTION_SUSPEND:
+        // Fan and laser off first, the sensor only accepts sleep when idle
+        ret = sps30_stop_measurement(&cfg->bus);
+        if (ret != NO_ERROR)
+        {
+            return -EIO;
+        }
+        // Sleep needs firmware 2.0, older sensors just stay idle
+        data->asleep = (sps30_sleep(&cfg->bus) == NO_ERROR);
+        return 0;
+    case PM_DEVICE_ACTION_RESUME:
+        if (data->asleep)
+        {
+            ret = sps30_wake_up(&cfg->bus);
+            if (ret != NO_ERROR)
+            {
+                return -EIO;
+            }
+            data->asleep = false;
+        }
+        ret = sps30_start_measurement(&cfg->bus);
+        return (ret == NO_ERROR) ? 0 : -EIO;
+    default:
+        return -ENOTSUP;
+    }
 }
 #endif /* CONFIG_PM_DEVICE */
 
@@ -363,7 +397,7 @@ static const struct sensor_driver_api sps30_api = {
                                                           \
     DEVICE_DT_INST_DEFINE(n,                              \
                           sps30_init,                     \
-                          NULL,                           \
+                          PM_DEVICE_DT_INST_GET(n),       \
                           &sps30_data_##n,                \
                           &sps30_config_##n,              \
                           POST_KERNEL,                    \
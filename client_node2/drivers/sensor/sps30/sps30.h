@@ -59,6 +59,26 @@ extern "C" {
 /** The fan speed is out of range */
 #define SPS30_DEVICE_STATUS_FAN_SPEED_WARNING (1 << 21)
 
+/* Commands of the I2C interface, also answered by sps30_emul.c */
+#define SPS_CMD_START_MEASUREMENT 0x0010
+#define SPS_CMD_START_MEASUREMENT_ARG 0x0300
+#define SPS_CMD_STOP_MEASUREMENT 0x0104
+#define SPS_CMD_READ_MEASUREMENT 0x0300
+#define SPS_CMD_START_STOP_DELAY_USEC 20000
+#define SPS_CMD_GET_DATA_READY 0x0202
+#define SPS_CMD_AUTOCLEAN_INTERVAL 0x8004
+#define SPS_CMD_GET_FIRMWARE_VERSION 0xd100
+#define SPS_CMD_GET_SERIAL 0xd033
+#define SPS_CMD_RESET 0xd304
+#define SPS_CMD_SLEEP 0x1001
+#define SPS_CMD_READ_DEVICE_STATUS_REG 0xd206
+#define SPS_CMD_START_MANUAL_FAN_CLEANING 0x5607
+#define SPS_CMD_WAKE_UP 0x1103
+#define SPS_CMD_DELAY_USEC 5000
+#define SPS_CMD_DELAY_WRITE_FLASH_USEC 20000
+
+#define SPS30_SERIAL_NUM_WORDS ((SPS30_MAX_SERIAL_LEN) / 2)
+
 struct sps30_measurement {
     float mc_1p0;
     float mc_2p5;
@@ -275,6 +295,21 @@ int16_t sps30_wake_up(const struct i2c_dt_spec *dev_bus);
  */
 int16_t sps30_read_device_status_register(const struct i2c_dt_spec *dev_bus, uint32_t* device_status_flags);
 
+/* Channels beyond the standard PM1.0/2.5/10 mass concentrations */
+enum sensor_channel_sps30
+{
+    /* Mass concentration of PM4.0 in ug/m3 */
+    SENSOR_CHAN_SPS30_MC_4P0 = SENSOR_CHAN_PRIV_START,
+    /* Number concentrations of PM0.5 to PM10 in #/cm3 */
+    SENSOR_CHAN_SPS30_NC_0P5,
+    SENSOR_CHAN_SPS30_NC_1P0,
+    SENSOR_CHAN_SPS30_NC_2P5,
+    SENSOR_CHAN_SPS30_NC_4P0,
+    SENSOR_CHAN_SPS30_NC_10P0,
+    /* Typical particle size in um */
+    SENSOR_CHAN_SPS30_TYPICAL_PARTICLE_SIZE,
+};
+
 enum sps30_model
 {
     SPS30_MODEL_SPS30,
@@ -298,6 +333,8 @@ struct sps30_data
     float nc_4p0;
     float nc_10p0;
     float typical_particle_size;
+    /* Put to sleep by the last PM suspend */
+    bool asleep;
 };
 
 #ifdef __cplusplus
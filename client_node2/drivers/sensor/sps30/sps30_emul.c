@@ -0,0 +1,438 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT sensirion_sps30
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "sps30.h"
+#include "sps30_emul.h"
+
+LOG_MODULE_REGISTER(sps30_emul, CONFIG_SENSOR_LOG_LEVEL);
+
+#define SPS30_EMUL_WORD_SIZE 3
+/* Largest response: the measurement, 10 floats of 2 words each */
+#define SPS30_EMUL_MAX_WORDS 20
+/* Largest argument: the auto cleaning interval */
+#define SPS30_EMUL_MAX_ARGS 2
+#define SPS30_EMUL_INTERVAL_MS 1000
+/* Once a week out of the factory */
+#define SPS30_EMUL_AUTOCLEAN_S (7 * 24 * 60 * 60)
+/* 2.3, recent enough for sleep and the device status register */
+#define SPS30_EMUL_FIRMWARE_VERSION 0x0203
+
+enum sps30_emul_state
+{
+    SPS30_EMUL_IDLE,
+    SPS30_EMUL_MEASURING,
+    SPS30_EMUL_SLEEP,
+};
+
+#define SPS30_EMUL_IN(state) BIT(SPS30_EMUL_##state)
+#define SPS30_EMUL_AWAKE     (SPS30_EMUL_IN(IDLE) | SPS30_EMUL_IN(MEASURING))
+#define SPS30_EMUL_MS(usec)  ((usec) / USEC_PER_MSEC)
+
+/* Commands with their arguments, the modes accepting them and their execution time */
+static const struct
+{
+    uint16_t code;
+    uint8_t num_args;
+    uint8_t modes;
+    uint32_t duration_ms;
+} sps30_emul_cmds[] = {
+    {SPS_CMD_START_MEASUREMENT, 1, SPS30_EMUL_IN(IDLE), SPS30_EMUL_MS(SPS_CMD_START_STOP_DELAY_USEC)},
+    {SPS_CMD_STOP_MEASUREMENT, 0, SPS30_EMUL_IN(MEASURING), SPS30_EMUL_MS(SPS_CMD_START_STOP_DELAY_USEC)},
+    {SPS_CMD_READ_MEASUREMENT, 0, SPS30_EMUL_IN(MEASURING), 0},
+    {SPS_CMD_GET_DATA_READY, 0, SPS30_EMUL_IN(MEASURING), 0},
+    {SPS_CMD_AUTOCLEAN_INTERVAL, 0, SPS30_EMUL_AWAKE, 0},
+    {SPS_CMD_AUTOCLEAN_INTERVAL, 2, SPS30_EMUL_AWAKE, SPS30_EMUL_MS(SPS_CMD_DELAY_WRITE_FLASH_USEC)},
+    {SPS_CMD_GET_FIRMWARE_VERSION, 0, SPS30_EMUL_AWAKE, 0},
+    {SPS_CMD_GET_SERIAL, 0, SPS30_EMUL_AWAKE, 0},
+    {SPS_CMD_RESET, 0, SPS30_EMUL_AWAKE, SPS30_EMUL_MS(SPS30_RESET_DELAY_USEC)},
+    {SPS_CMD_SLEEP, 0, SPS30_EMUL_IN(IDLE), SPS30_EMUL_MS(SPS_CMD_DELAY_USEC)},
+    {SPS_CMD_READ_DEVICE_STATUS_REG, 0, SPS30_EMUL_AWAKE, 0},
+    {SPS_CMD_START_MANUAL_FAN_CLEANING, 0, SPS30_EMUL_IN(MEASURING), SPS30_EMUL_MS(SPS_CMD_DELAY_USEC)},
+    {SPS_CMD_WAKE_UP, 0, SPS30_EMUL_IN(SLEEP), SPS30_EMUL_MS(SPS_CMD_DELAY_USEC)},
+};
+
+/* NUL padded to the SPS30_SERIAL_NUM_WORDS the sensor sends */
+static const char sps30_emul_serial[SPS30_MAX_SERIAL_LEN] = "EMUL00000000SPS30";
+
+/* A quiet office */
+static const struct sps30_emul_sample sps30_emul_default_trace[] = {
+    {.ms = 0,
+     .values = {.mc_1p0 = 4.2f,
+                .mc_2p5 = 5.1f,
+                .mc_4p0 = 5.6f,
+                .mc_10p0 = 5.8f,
+                .nc_0p5 = 28.0f,
+                .nc_1p0 = 33.1f,
+                .nc_2p5 = 33.4f,
+                .nc_4p0 = 33.5f,
+                .nc_10p0 = 33.5f,
+                .typical_particle_size = 0.52f}},
+};
+
+struct sps30_emul_data
+{
+    enum sps30_emul_state state;
+    /* Asleep, the first wake-up only wakes the interface */
+    bool interface_awake;
+    /* Commands are NACKed until the one executing is done */
+    int64_t busy_until_ms;
+    /* Completion of the next measurement */
+    int64_t next_ms;
+    /* Latest measurement as sent on the bus, zeros until the first one */
+    uint16_t sample[SPS30_EMUL_MAX_WORDS];
+    bool data_ready;
+    uint32_t autoclean_s;
+    /* Response to the last command, for the next read */
+    uint8_t rx_buf[SPS30_EMUL_MAX_WORDS * SPS30_EMUL_WORD_SIZE];
+    size_t rx_len;
+    /* Set from another thread than the one sampling the sensor */
+    struct k_spinlock trace_lock;
+    const struct sps30_emul_sample *trace;
+    size_t trace_len;
+    uint32_t trace_period_ms;
+    int64_t trace_start_ms;
+};
+
+/* Bitwise CRC-8 of the datasheet, independent of the driver's lookup table */
+static uint8_t sps30_emul_crc(uint16_t word)
+{
+    uint8_t crc = 0xFF;
+
+    for (int i = 8; i >= 0; i -= 8)
+    {
+        crc ^= (uint8_t)(word >> i);
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+static void sps30_emul_respond(struct sps30_emul_data *data, const uint16_t *words,
+                               size_t num_words)
+{
+    for (size_t i = 0; i < num_words; i++)
+    {
+        sys_put_be16(words[i], &data->rx_buf[i * SPS30_EMUL_WORD_SIZE]);
+        data->rx_buf[i * SPS30_EMUL_WORD_SIZE + 2] = sps30_emul_crc(words[i]);
+    }
+    data->rx_len = num_words * SPS30_EMUL_WORD_SIZE;
+}
+
+static const struct sps30_emul_sample *sps30_emul_trace_at(struct sps30_emul_data *data,
+                                                           int64_t at_ms)
+{
+    const struct sps30_emul_sample *sample;
+    k_spinlock_key_t key;
+    int64_t t;
+    size_t i = 0;
+
+    key = k_spin_lock(&data->trace_lock);
+    t = at_ms - data->trace_start_ms;
+    if (data->trace_period_ms > 0)
+    {
+        t %= data->trace_period_ms;
+    }
+    while (i + 1 < data->trace_len && data->trace[i + 1].ms <= t)
+    {
+        i++;
+    }
+    sample = &data->trace[i];
+    k_spin_unlock(&data->trace_lock, key);
+
+    return sample;
+}
+
+static void sps30_emul_put_float(uint16_t *words, float value)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    words[0] = (uint16_t)(bits >> 16);
+    words[1] = (uint16_t)(bits & 0xFFFF);
+}
+
+/* Encode the trace at at_ms the way sps30_read_measurement() decodes it. */
+static void sps30_emul_measure(struct sps30_emul_data *data, int64_t at_ms)
+{
+    const struct sps30_measurement *m = &sps30_emul_trace_at(data, at_ms)->values;
+    const float values[] = {
+        m->mc_1p0, m->mc_2p5, m->mc_4p0, m->mc_10p0, m->nc_0p5,
+        m->nc_1p0, m->nc_2p5, m->nc_4p0, m->nc_10p0, m->typical_particle_size,
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(values); i++)
+    {
+        sps30_emul_put_float(&data->sample[2 * i], values[i]);
+    }
+    data->data_ready = true;
+}
+
+/* Complete the measurement due by now. */
+static void sps30_emul_update(struct sps30_emul_data *data, int64_t now)
+{
+    if (data->state != SPS30_EMUL_MEASURING || now < data->next_ms)
+    {
+        return;
+    }
+
+    /* Only the latest of the measurements done since is kept */
+    data->next_ms += (now - data->next_ms) / SPS30_EMUL_INTERVAL_MS * SPS30_EMUL_INTERVAL_MS;
+    sps30_emul_measure(data, data->next_ms);
+    data->next_ms += SPS30_EMUL_INTERVAL_MS;
+}
+
+static int sps30_emul_find_cmd(uint16_t code, size_t num_args)
+{
+    for (int cmd = 0; cmd < (int)ARRAY_SIZE(sps30_emul_cmds); cmd++)
+    {
+        if (sps30_emul_cmds[cmd].code == code && sps30_emul_cmds[cmd].num_args == num_args)
+        {
+            return cmd;
+        }
+    }
+
+    return -ENOENT;
+}
+
+static void sps30_emul_execute(struct sps30_emul_data *data, uint16_t code, const uint16_t *args,
+                               int64_t now)
+{
+    uint16_t words[SPS30_SERIAL_NUM_WORDS];
+
+    switch (code)
+    {
+    case SPS_CMD_START_MEASUREMENT:
+        data->state = SPS30_EMUL_MEASURING;
+        data->next_ms = now + SPS30_EMUL_INTERVAL_MS;
+        memset(data->sample, 0, sizeof(data->sample));
+        data->data_ready = false;
+        break;
+    case SPS_CMD_STOP_MEASUREMENT:
+    case SPS_CMD_RESET:
+        data->state = SPS30_EMUL_IDLE;
+        data->data_ready = false;
+        break;
+    case SPS_CMD_READ_MEASUREMENT:
+        /* The previous measurement again if there is no new one */
+        sps30_emul_respond(data, data->sample, SPS30_EMUL_MAX_WORDS);
+        data->data_ready = false;
+        break;
+    case SPS_CMD_GET_DATA_READY:
+        words[0] = data->data_ready;
+        sps30_emul_respond(data, words, 1);
+        break;
+    case SPS_CMD_AUTOCLEAN_INTERVAL:
+        if (args != NULL)
+        {
+            data->autoclean_s = ((uint32_t)args[0] << 16) | args[1];
+            break;
+        }
+        words[0] = (uint16_t)(data->autoclean_s >> 16);
+        words[1] = (uint16_t)(data->autoclean_s & 0xFFFF);
+        sps30_emul_respond(data, words, 2);
+        break;
+    case SPS_CMD_GET_FIRMWARE_VERSION:
+        words[0] = SPS30_EMUL_FIRMWARE_VERSION;
+        sps30_emul_respond(data, words, 1);
+        break;
+    case SPS_CMD_GET_SERIAL:
+        for (size_t i = 0; i < SPS30_SERIAL_NUM_WORDS; i++)
+        {
+            words[i] = sys_get_be16((const uint8_t *)&sps30_emul_serial[2 * i]);
+        }
+        sps30_emul_respond(data, words, SPS30_SERIAL_NUM_WORDS);
+        break;
+    case SPS_CMD_SLEEP:
+        data->state = SPS30_EMUL_SLEEP;
+        data->interface_awake = false;
+        break;
+    case SPS_CMD_READ_DEVICE_STATUS_REG:
+        /* Fan and laser fine */
+        words[0] = 0;
+        words[1] = 0;
+        sps30_emul_respond(data, words, 2);
+        break;
+    case SPS_CMD_WAKE_UP:
+        data->state = SPS30_EMUL_IDLE;
+        break;
+    default:
+        break;
+    }
+}
+
+static int sps30_emul_write(struct sps30_emul_data *data, const struct i2c_msg *msg, int64_t now)
+{
+    uint16_t args[SPS30_EMUL_MAX_ARGS];
+    size_t num_args;
+    uint16_t code;
+    int cmd;
+
+    data->rx_len = 0;
+
+    if (msg->len < 2 || (msg->len - 2) % SPS30_EMUL_WORD_SIZE != 0 ||
+        (msg->len - 2) / SPS30_EMUL_WORD_SIZE > SPS30_EMUL_MAX_ARGS)
+    {
+        LOG_WRN("Write of %u bytes", msg->len);
+        return -EIO;
+    }
+
+    code = sys_get_be16(msg->buf);
+    num_args = (msg->len - 2) / SPS30_EMUL_WORD_SIZE;
+    for (size_t i = 0; i < num_args; i++)
+    {
+        const uint8_t *word = &msg->buf[2 + i * SPS30_EMUL_WORD_SIZE];
+
+        args[i] = sys_get_be16(word);
+        if (sps30_emul_crc(args[i]) != word[2])
+        {
+            LOG_WRN("CRC mismatch in argument of 0x%04x", code);
+            return -EIO;
+        }
+    }
+
+    if (data->state == SPS30_EMUL_SLEEP && !data->interface_awake)
+    {
+        /* Any command wakes the interface up, none is executed */
+        data->interface_awake = true;
+        return -EIO;
+    }
+
+    cmd = sps30_emul_find_cmd(code, num_args);
+    if (cmd < 0)
+    {
+        LOG_WRN("Unknown command 0x%04x with %zu arguments", code, num_args);
+        return -EIO;
+    }
+    if (!(sps30_emul_cmds[cmd].modes & BIT(data->state)))
+    {
+        LOG_DBG("Command 0x%04x not allowed in state %d", code, data->state);
+        return -EIO;
+    }
+    if (code == SPS_CMD_START_MEASUREMENT && args[0] != SPS_CMD_START_MEASUREMENT_ARG)
+    {
+        LOG_WRN("Only the float output format is emulated");
+        return -EIO;
+    }
+
+    data->busy_until_ms = now + sps30_emul_cmds[cmd].duration_ms;
+    sps30_emul_execute(data, code, num_args > 0 ? args : NULL, now);
+
+    return 0;
+}
+
+static int sps30_emul_read(struct sps30_emul_data *data, struct i2c_msg *msg)
+{
+    /* Reading less than the response is fine, the controller NACKs early */
+    if (msg->len > data->rx_len)
+    {
+        return -EIO;
+    }
+
+    memcpy(msg->buf, data->rx_buf, msg->len);
+    data->rx_len = 0;
+
+    return 0;
+}
+
+static int sps30_emul_transfer(const struct emul *target, struct i2c_msg *msgs, int num_msgs,
+                               int addr)
+{
+    struct sps30_emul_data *data = target->data;
+    int64_t now = k_uptime_get();
+    int ret = 0;
+
+    ARG_UNUSED(addr);
+
+    sps30_emul_update(data, now);
+
+    for (int i = 0; i < num_msgs && ret == 0; i++)
+    {
+        if (now < data->busy_until_ms)
+        {
+            /* Still executing the previous command */
+            return -EIO;
+        }
+
+        if (msgs[i].flags & I2C_MSG_READ)
+        {
+            ret = sps30_emul_read(data, &msgs[i]);
+        }
+        else
+        {
+            ret = sps30_emul_write(data, &msgs[i], now);
+        }
+    }
+
+    return ret;
+}
+
+int sps30_emul_set_trace(const struct emul *target, const struct sps30_emul_sample *trace,
+                         size_t len, uint32_t period_ms)
+{
+    struct sps30_emul_data *data = target->data;
+    k_spinlock_key_t key;
+
+    if (len == 0 || trace[0].ms != 0 || (period_ms > 0 && trace[len - 1].ms >= period_ms))
+    {
+        return -EINVAL;
+    }
+    for (size_t i = 1; i < len; i++)
+    {
+        if (trace[i].ms < trace[i - 1].ms)
+        {
+            return -EINVAL;
+        }
+    }
+
+    key = k_spin_lock(&data->trace_lock);
+    data->trace = trace;
+    data->trace_len = len;
+    data->trace_period_ms = period_ms;
+    data->trace_start_ms = k_uptime_get();
+    k_spin_unlock(&data->trace_lock, key);
+
+    return 0;
+}
+
+static int sps30_emul_init(const struct emul *target, const struct device *parent)
+{
+    struct sps30_emul_data *data = target->data;
+
+    ARG_UNUSED(parent);
+
+    /* Powered up in idle mode */
+    data->state = SPS30_EMUL_IDLE;
+    data->autoclean_s = SPS30_EMUL_AUTOCLEAN_S;
+    data->trace = sps30_emul_default_trace;
+    data->trace_len = ARRAY_SIZE(sps30_emul_default_trace);
+
+    return 0;
+}
+
+static const struct i2c_emul_api sps30_emul_api_i2c = {
+    .transfer = sps30_emul_transfer,
+};
+
+#define SPS30_EMUL(n)                                                                      \
+    static struct sps30_emul_data sps30_emul_data_##n;                                     \
+    EMUL_DT_INST_DEFINE(n, sps30_emul_init, &sps30_emul_data_##n, NULL, &sps30_emul_api_i2c, \
+                        NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(SPS30_EMUL)
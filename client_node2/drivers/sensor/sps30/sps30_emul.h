@@ -0,0 +1,52 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SPS30_EMUL_H
+#define SPS30_EMUL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/emul.h>
+
+#include "sps30.h"
+
+/*
+ * SPS30 emulated on an I2C emulation controller, as found on native_sim.
+ *
+ * It answers the SPS_CMD_* commands the way the sensor does: words are
+ * sent with their CRC and arguments with a wrong one are NACKed, as are
+ * commands sent before the previous one finished executing and commands
+ * the current mode does not accept. While asleep the first wake-up only
+ * wakes the interface and is NACKed, the second one wakes the sensor.
+ * Measurements are sent in the big-endian float format only.
+ *
+ * A measurement is taken every second from a trace of the values the
+ * sensor reports over time, constant until one is set.
+ */
+
+struct sps30_emul_sample
+{
+    /* Milliseconds since the start of the trace */
+    uint32_t ms;
+    /* What sps30_read_measurement() returns while this sample applies */
+    struct sps30_measurement values;
+};
+
+/**
+ * sps30_emul_set_trace() - play measurements back from a trace, starting now
+ *
+ * A sample applies from its ms on until the next one.
+ *
+ * @target:     Emulator of the sensor, EMUL_DT_GET() of its node
+ * @trace:      Samples sorted by ms, the first one at 0; not copied
+ * @len:        Number of samples
+ * @period_ms:  Length of the trace, which then starts over; 0 to keep the
+ *              last sample
+ * Return:      0 on success, -EINVAL if the trace is empty, unsorted or
+ *              longer than period_ms
+ */
+int sps30_emul_set_trace(const struct emul *target, const struct sps30_emul_sample *trace,
+                         size_t len, uint32_t period_ms);
+
+#endif /* SPS30_EMUL_H */
@@ -0,0 +1,40 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/drivers/emul.h>
+#include "sensor/sps30/sps30_emul.h"
+
+// Particles in a kitchen over an hour, played back by the emulated SPS30
+// on native_sim. Cooking takes PM2.5 through every band of the dashboard
+// and back.
+#define TRACE_PERIOD_MS (60 * 60 * 1000)
+
+#define PM(mc1, mc25, mc4, mc10, nc05, nc1, nc25, nc4, nc10, size) \
+    { .mc_1p0 = mc1, .mc_2p5 = mc25, .mc_4p0 = mc4, .mc_10p0 = mc10, \
+      .nc_0p5 = nc05, .nc_1p0 = nc1, .nc_2p5 = nc25, .nc_4p0 = nc4, \
+      .nc_10p0 = nc10, .typical_particle_size = size }
+
+static const struct sps30_emul_sample sps30_trace[] = {
+    // Clean air
+    { .ms = 0, .values = PM(3.1f, 4.0f, 4.4f, 4.6f, 20.5f, 24.3f, 24.6f, 24.7f, 24.7f, 0.48f) },
+    // Frying
+    { .ms = 10 * 60 * 1000,
+      .values = PM(14.8f, 22.0f, 26.1f, 28.0f, 95.2f, 112.4f, 114.0f, 114.3f, 114.4f, 0.61f) },
+    { .ms = 15 * 60 * 1000,
+      .values = PM(38.5f, 56.3f, 66.9f, 71.2f, 240.7f, 286.1f, 290.2f, 291.0f, 291.1f, 0.74f) },
+    { .ms = 20 * 60 * 1000,
+      .values = PM(95.0f, 160.2f, 190.5f, 204.8f, 590.3f, 712.6f, 722.9f, 724.8f, 725.1f, 0.92f) },
+    // Hood on
+    { .ms = 30 * 60 * 1000,
+      .values = PM(20.1f, 30.4f, 35.7f, 38.0f, 130.8f, 154.2f, 156.4f, 156.8f, 156.9f, 0.66f) },
+    { .ms = 40 * 60 * 1000,
+      .values = PM(6.0f, 8.2f, 9.1f, 9.5f, 40.3f, 47.6f, 48.3f, 48.4f, 48.4f, 0.53f) },
+};
+
+static int traces_init(void)
+{
+    return sps30_emul_set_trace(EMUL_DT_GET(DT_NODELABEL(sps30)), sps30_trace,
+                                ARRAY_SIZE(sps30_trace), TRACE_PERIOD_MS);
+}
+
+// Before main() so the first window already samples the trace
+SYS_INIT(traces_init, APPLICATION, 0);
@@ -3,218 +3,270 @@
 #include <stdio.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/drivers/sensor.h>
+#include <zephyr/pm/device.h>
 #include "sensor/sps30/sps30.h"
-#include <openthread/coap.h>
-#include <zephyr/net/openthread.h> 
-#include <openthread/thread.h>
+#include <iaq/accum.h>
+#include <iaq/delta.h>
+#include <iaq/filter.h>
+#include <iaq/param.h>
+#include <iaq/report.h>
+#include <iaq/timesync.h>
+#include <iaq/uplink.h>
 #include <zephyr/logging/log.h>
 
 #if !DT_HAS_COMPAT_STATUS_OKAY(sensirion_sps30)
 #error "No sensirion,sps30 compatible node found in the device tree"
 #endif
 
-// THREAD NETWORK CONFIGURATION //
-void coap_init(void)
-{
-	otInstance *p_instance = openthread_get_default_instance();
-	otError error = otCoapStart(p_instance, OT_DEFAULT_COAP_PORT);
-	if (error != OT_ERROR_NONE)
-		printk("Failed to start Coap: %d\n", error);
-	else
-	{
-		printk("Coap started successfully.\n");
-	}
-}
-static void coap_send_data_response_cb(void *p_context, otMessage *p_message,
-									   const otMessageInfo *p_message_info, otError result)
-{
-	if (result == OT_ERROR_NONE)
-	{
-		printk("Delivery confirmed.\n");
-	}
-	else
-	{
-		printk("Delivery not confirmed: %d\n", result);
-	}
-}
-static void send_coap_message(const char *uri_path, const char *payload)
-{
-	otError error = OT_ERROR_NONE;
-	otMessage *message;
-	otMessageInfo message_info;
-	otInstance *instance = openthread_get_default_instance();
-	const otMeshLocalPrefix *mesh_prefix = otThreadGetMeshLocalPrefix(instance);
-	uint8_t server_interface_id[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01};
-
-	do
-	{
-		// Allocate a new CoAP message
-		message = otCoapNewMessage(instance, NULL);
-		if (message == NULL)
-		{
-			printk("Failed to allocate CoAP message\n");
-			return;
-		}
+const struct device *sps30 = DEVICE_DT_GET_ANY(sensirion_sps30);
 
-		// Initialize the CoAP message
-		otCoapMessageInit(message, OT_COAP_TYPE_CONFIRMABLE, OT_COAP_CODE_PUT);
+// Default sampling schedule
+#define SAMPLES_PER_WINDOW 3
+#ifdef CONFIG_APP_SPS30_DUTY_CYCLE
+// Warm up, take 3 readings 2 s apart, then sleep until the next period
+#define WINDOW_MS           (CONFIG_APP_SPS30_DUTY_CYCLE_PERIOD * MSEC_PER_SEC)
+#define WARMUP_MS           (CONFIG_APP_SPS30_WARMUP_SECONDS * MSEC_PER_SEC)
+#define SAMPLE_INTERVAL_MS  2000
+#else
+// Measure continuously, 3 readings 15 s apart in every 60 s window
+#define WINDOW_MS           60000
+#define WARMUP_MS           0
+#define SAMPLE_INTERVAL_MS  15000
+#endif
 
-		// Append URI path
-		error = otCoapMessageAppendUriPathOptions(message, uri_path);
-		if (error != OT_ERROR_NONE)
-		{
-			printk("Failed to append URI path: %d\n", error);
-			otMessageFree(message);
-			return;
-		}
+// Start or stop the fan and laser, a no-op when measuring continuously
+static int sps30_set_active(bool active)
+{
+#ifdef CONFIG_APP_SPS30_DUTY_CYCLE
+    int ret = pm_device_action_run(sps30, active ? PM_DEVICE_ACTION_RESUME
+                                                 : PM_DEVICE_ACTION_SUSPEND);
 
-		// Append content format option (JSON)
-		error = otCoapMessageAppendContentFormatOption(message, OT_COAP_OPTION_CONTENT_FORMAT_JSON);
-		if (error != OT_ERROR_NONE)
-		{
-			printk("Failed to append content format option: %d\n", error);
-			otMessageFree(message);
-			return;
-		}
+    return (ret == -EALREADY) ? 0 : ret;
+#else
+    return 0;
+#endif
+}
 
-		// Set payload marker
-		error = otCoapMessageSetPayloadMarker(message);
-		if (error != OT_ERROR_NONE)
-		{
-			printk("Failed to set payload marker: %d\n", error);
-			otMessageFree(message);
-			return;
-		}
+// Send-on-delta rules, the band edges are those of get_air_quality_status()
+// in the dashboard so every change of the displayed status is reported
+static const struct iaq_delta_rule pm_1_0_rule = {
+    .delta = IAQ_DELTA_UNITS(CONFIG_APP_DELTA_PM_UG),
+    .bands = { IAQ_DELTA_UNITS(10), IAQ_DELTA_UNITS(25) },
+    .num_bands = 2,
+};
+static const struct iaq_delta_rule pm_2_5_rule = {
+    .delta = IAQ_DELTA_UNITS(CONFIG_APP_DELTA_PM_UG),
+    .bands = { IAQ_DELTA_UNITS(25), IAQ_DELTA_UNITS(35) },
+    .num_bands = 2,
+};
+static const struct iaq_delta_rule pm_10_rule = {
+    .delta = IAQ_DELTA_UNITS(CONFIG_APP_DELTA_PM_UG),
+    .bands = { IAQ_DELTA_UNITS(45), IAQ_DELTA_UNITS(100) },
+    .num_bands = 2,
+};
+static const struct iaq_delta_rule pm_4_0_rule = {
+    .delta = IAQ_DELTA_UNITS(CONFIG_APP_DELTA_PM_UG),
+};
+static const struct iaq_delta_rule nc_rule = {
+    .delta = IAQ_DELTA_UNITS(CONFIG_APP_DELTA_NC_PER_CM3),
+};
+// The typical particle size is only reported along with the other channels
+static const struct iaq_delta_rule size_rule = { 0 };
 
-		// Append payload
-		error = otMessageAppend(message, payload, strlen(payload));
-		if (error != OT_ERROR_NONE)
-		{
-			printk("Failed to append payload: %d\n", error);
-			otMessageFree(message);
-			return;
-		}
+// Channels read on every sample, the report field each one goes to and
+// when it is worth reporting. The mass concentrations, bounded in params,
+// come first.
+static const struct {
+    int chan;
+    enum iaq_field field;
+    const struct iaq_delta_rule *rule;
+} sps30_channels[] = {
+    { SENSOR_CHAN_PM_1_0, IAQ_FIELD_PM_1_0, &pm_1_0_rule },
+    { SENSOR_CHAN_PM_2_5, IAQ_FIELD_PM_2_5, &pm_2_5_rule },
+    { SENSOR_CHAN_PM_10, IAQ_FIELD_PM_10, &pm_10_rule },
+    { SENSOR_CHAN_SPS30_MC_4P0, IAQ_FIELD_PM_4_0, &pm_4_0_rule },
+    { SENSOR_CHAN_SPS30_NC_0P5, IAQ_FIELD_NC_0_5, &nc_rule },
+    { SENSOR_CHAN_SPS30_NC_1P0, IAQ_FIELD_NC_1_0, &nc_rule },
+    { SENSOR_CHAN_SPS30_NC_2P5, IAQ_FIELD_NC_2_5, &nc_rule },
+    { SENSOR_CHAN_SPS30_NC_4P0, IAQ_FIELD_NC_4_0, &nc_rule },
+    { SENSOR_CHAN_SPS30_NC_10P0, IAQ_FIELD_NC_10, &nc_rule },
+    { SENSOR_CHAN_SPS30_TYPICAL_PARTICLE_SIZE, IAQ_FIELD_PARTICLE_SIZE, &size_rule },
+};
 
-		// Set up message info
-		memset(&message_info, 0, sizeof(message_info));
-		memcpy(&message_info.mPeerAddr.mFields.m8[0], mesh_prefix, 8);
-		memcpy(&message_info.mPeerAddr.mFields.m8[8], server_interface_id, 8);
-		message_info.mPeerPort = OT_DEFAULT_COAP_PORT;
+#define SPS30_NUM_CHANNELS ARRAY_SIZE(sps30_channels)
 
-		// Send the CoAP request
-		error = otCoapSendRequest(instance, message, &message_info, coap_send_data_response_cb, NULL);
-	} while (false);
+// Parameters the server node can change at runtime, see iaq/param.h.
+// Bounds are inclusive, in milli-units, within the range of the sensor.
+static struct iaq_param params[] = {
+    // id, min, max, default
+    { IAQ_PARAM_SAMPLE_INTERVAL, 1000, 600000, SAMPLE_INTERVAL_MS },
+    { IAQ_PARAM_SAMPLES_PER_WINDOW, 1, 60, SAMPLES_PER_WINDOW },
+    { IAQ_PARAM_WINDOW, 1000, 86400000, WINDOW_MS },
+#ifdef CONFIG_IAQ_UPLINK
+    { IAQ_PARAM_BATCH_WINDOWS, 1, 255, CONFIG_IAQ_UPLINK_BATCH_WINDOWS },
+#endif
+    { IAQ_PARAM_MIN(IAQ_FIELD_PM_1_0), 0, 1000000, 1000 },
+    { IAQ_PARAM_MAX(IAQ_FIELD_PM_1_0), 0, 1000000, 999000 },
+    { IAQ_PARAM_MIN(IAQ_FIELD_PM_2_5), 0, 1000000, 1000 },
+    { IAQ_PARAM_MAX(IAQ_FIELD_PM_2_5), 0, 1000000, 999000 },
+    { IAQ_PARAM_MIN(IAQ_FIELD_PM_10), 0, 1000000, 1000 },
+    { IAQ_PARAM_MAX(IAQ_FIELD_PM_10), 0, 1000000, 999000 },
+};
 
-	if (error != OT_ERROR_NONE)
-	{
-		printk("Failed to send CoAP request: %d\n", error);
-		otMessageFree(message);
-	}
-	else
-	{
-		printk("CoAP message sent successfully.\n");
+// Last reported value of every channel
+static struct iaq_delta deltas[SPS30_NUM_CHANNELS];
+static int64_t last_report_ms;
+
+bool is_sps30_data_valid(const struct sensor_value values[]) {
+	// Only the mass concentrations have bounds in params, the others always pass
+	for (size_t c = 0; c < SPS30_NUM_CHANNELS; c++) {
+		if (!iaq_param_in_bounds(sps30_channels[c].field, &values[c])) {
+			return false;
+		}
 	}
+	return true;
 }
 
-// THREAD NETWORK CONFIGURATION ENDS //
-
-const struct device *sps30 = DEVICE_DT_GET_ANY(sensirion_sps30);
-
-bool is_sps30_data_valid(struct sensor_value pm_1p0, struct sensor_value pm_2p5, struct sensor_value pm_10p0) {
-	return (pm_1p0.val1 > 0 && pm_1p0.val1 < 1000) &&
-           (pm_2p5.val1 > 0 && pm_2p5.val1 < 1000) &&
-           (pm_10p0.val1 > 0 && pm_10p0.val1 < 1000);
-}
+void send_sps30_data(const struct iaq_accum accs[], bool *sps30_ok) {
+	struct iaq_report report;
 
-void send_sps30_data(struct sensor_value pm_1p0, struct sensor_value pm_2p5, struct sensor_value pm_10p0, bool *sps30_ok) {
-	char payload[256]; // Buffer to hold the JSON payload
+	iaq_report_init(&report, IAQ_SENSOR_SPS30, (*sps30_ok) ? IAQ_STATUS_SPS30_OK : 0);
+	for (size_t i = 0; i < SPS30_NUM_CHANNELS; i++) {
+		iaq_report_put_micro(&report, sps30_channels[i].field, iaq_accum_mean(&accs[i]));
+	}
 
-	// Construct the JSON payload
-	snprintf(payload, sizeof(payload),
-			 "{\"sensor\":\"sps30\",\"data\":{\"PM1.0\":%d.%02d,\"PM2.5\":%d.%02d,\"PM10.0\":%d.%02d, \"SPS30_OK\":%s}}\n",
-			 pm_1p0.val1, pm_1p0.val2, pm_2p5.val1, pm_2p5.val2, pm_10p0.val1, pm_10p0.val2,
-			 (*sps30_ok) ? "true" : "false");
+	// Queue the report for the next batch
+	iaq_uplink_queue(&report);
 
-	// Send the CoAP message
-	send_coap_message("sensor_data", payload);
+	for (size_t i = 0; i < SPS30_NUM_CHANNELS; i++) {
+		iaq_delta_update(&deltas[i], iaq_accum_mean(&accs[i]));
+	}
+	last_report_ms = k_uptime_get();
 }
 
-void send_error_message(const char *message, bool *sps30_ok)
+void send_error_message(enum iaq_error code, bool *sps30_ok)
 {
-	char payload[256]; // Buffer to hold the JSON payload
+	struct iaq_report report;
 
-	// Construct the JSON payload
-	snprintf(payload, sizeof(payload), "{\"error\":\"%s\",\"SPS30_OK\":%s}\n", message, (*sps30_ok) ? "true" : "false");
+	iaq_report_init(&report, IAQ_SENSOR_SPS30, (*sps30_ok) ? IAQ_STATUS_SPS30_OK : 0);
+	iaq_report_put(&report, IAQ_FIELD_ERROR, code);
 
-	// Send the CoAP message
-	send_coap_message("sensor_data", payload);
+	// Queue the report for the next batch
+	iaq_uplink_queue(&report);
 }
 int main(void)
 {
     bool SPS30_OK = false;
-    coap_init();
+    iaq_uplink_init();
+    iaq_timesync_init();
+    iaq_param_init(params, ARRAY_SIZE(params));
 
     if (!device_is_ready(sps30)) {
         printk("SPS30 device not ready\n");
-        send_error_message("SPS30 not ready - Sensor not connected or Sensor's PINs mis-configured.", &SPS30_OK);
+        send_error_message(IAQ_ERROR_NOT_READY, &SPS30_OK);
+        iaq_uplink_flush();
         return -1;
     }
     printk("SPS30 device is ready\n");
     SPS30_OK = true;
 
-    struct sensor_value pm_1p0, pm_2p5, pm_10p0;
-    struct sensor_value pm_1p0_sum = {0}, pm_2p5_sum = {0}, pm_10p0_sum = {0};
-    int valid_readings = 0;
+    struct sensor_value values[SPS30_NUM_CHANNELS];
+    // Averages of the valid readings of the window, in micro-units
+    struct iaq_accum accs[SPS30_NUM_CHANNELS];
+    // Spike rejection over the most recent samples, kept across windows
+    struct iaq_filter filters[SPS30_NUM_CHANNELS];
+
+    for (size_t c = 0; c < SPS30_NUM_CHANNELS; c++) {
+        iaq_filter_reset(&filters[c]);
+    }
+    int64_t window_start = k_uptime_get();
 
     while (true) {
-        // Reset sums and counters for averaging
-        pm_1p0_sum = (struct sensor_value){0};
-        pm_2p5_sum = (struct sensor_value){0};
-        pm_10p0_sum = (struct sensor_value){0};
-        valid_readings = 0;
-
-        // Collect 3 readings over 15 seconds
-        for (int i = 0; i < 3; i++) {
+        // Parameters changed by the server apply from the next window on
+        int32_t sample_interval_ms = iaq_param_get(IAQ_PARAM_SAMPLE_INTERVAL);
+        int32_t samples_per_window = iaq_param_get(IAQ_PARAM_SAMPLES_PER_WINDOW);
+        int32_t window_ms = iaq_param_get(IAQ_PARAM_WINDOW);
+
+        iaq_uplink_set_batch_windows(iaq_param_get(IAQ_PARAM_BATCH_WINDOWS));
+
+        // Start a new averaging window
+        for (size_t c = 0; c < SPS30_NUM_CHANNELS; c++) {
+            iaq_accum_reset(&accs[c]);
+        }
+
+        if (sps30_set_active(true) < 0) {
+            printk("Failed to wake up SPS30 sensor\n");
+        }
+        k_sleep(K_MSEC(WARMUP_MS));
+
+        // Worst change since the last report among the samples taken
+        enum iaq_delta_event event = IAQ_DELTA_NONE;
+        int taken = 0;
+
+        // Collect the readings of the window until something changes
+        while (taken < samples_per_window && event == IAQ_DELTA_NONE) {
+            int i = taken++;
+
+            if (i > 0) {
+                k_sleep(K_MSEC(sample_interval_ms));
+            }
+
             if (sensor_sample_fetch(sps30) < 0) {
                 printk("Failed to fetch sample from SPS30 sensor\n");
                 SPS30_OK = false;
             } else {
                 SPS30_OK = true;
-                sensor_channel_get(sps30, SENSOR_CHAN_PM_1_0, &pm_1p0);
-                sensor_channel_get(sps30, SENSOR_CHAN_PM_2_5, &pm_2p5);
-                sensor_channel_get(sps30, SENSOR_CHAN_PM_10, &pm_10p0);
-
-                if (is_sps30_data_valid(pm_1p0, pm_2p5, pm_10p0)) {
-                    pm_1p0_sum.val1 += pm_1p0.val1;
-                    pm_1p0_sum.val2 += pm_1p0.val2;
-                    pm_2p5_sum.val1 += pm_2p5.val1;
-                    pm_2p5_sum.val2 += pm_2p5.val2;
-                    pm_10p0_sum.val1 += pm_10p0.val1;
-                    pm_10p0_sum.val2 += pm_10p0.val2;
-                    valid_readings++;
+                for (size_t c = 0; c < SPS30_NUM_CHANNELS; c++) {
+                    sensor_channel_get(sps30, sps30_channels[c].chan, &values[c]);
+                }
+
+                if (is_sps30_data_valid(values)) {
+                    for (size_t c = 0; c < SPS30_NUM_CHANNELS; c++) {
+                        iaq_filter_apply(&filters[c], &values[c]);
+                        iaq_accum_add(&accs[c], &values[c]);
+                        event = MAX(event, iaq_delta_check(&deltas[c], sps30_channels[c].rule,
+                                                           sensor_value_to_micro(&values[c])));
+                    }
                 }
             }
+        }
 
-            k_sleep(K_SECONDS(15)); // Wait 15 seconds before the next reading
+        if (sps30_set_active(false) < 0) {
+            printk("Failed to put SPS30 sensor to sleep\n");
         }
 
-        // Calculate averages
-        if (valid_readings > 0) {
-            pm_1p0_sum.val1 /= valid_readings;
-            pm_1p0_sum.val2 /= valid_readings;
-            pm_2p5_sum.val1 /= valid_readings;
-            pm_2p5_sum.val2 /= valid_readings;
-            pm_10p0_sum.val1 /= valid_readings;
-            pm_10p0_sum.val2 /= valid_readings;
+        bool heartbeat = k_uptime_get() - last_report_ms >= CONFIG_IAQ_DELTA_HEARTBEAT * MSEC_PER_SEC;
 
+        // Every channel is added together, so they share a count
+        if (accs[0].count > 0 && event == IAQ_DELTA_NONE && !heartbeat) {
+            // Steady conditions, not worth a transmission
+            printk("No significant change, report skipped\n");
+        } else if (accs[0].count > 0) {
             printk("Sending averaged SPS30 data...\n");
-            send_sps30_data(pm_1p0_sum, pm_2p5_sum, pm_10p0_sum, &SPS30_OK);
+            send_sps30_data(accs, &SPS30_OK);
         } else {
             printk("No valid data to send (Sensor Data out of bound).\n");
-            send_error_message("SPS30 - No valid data to send (Sensor Data out of bound)", &SPS30_OK);
+            send_error_message(IAQ_ERROR_INVALID_DATA, &SPS30_OK);
+        }
+        iaq_uplink_commit();
+        if (event == IAQ_DELTA_BAND) {
+            // The air quality status changed, do not wait for the batch
+            iaq_uplink_flush();
         }
 
-        k_sleep(K_SECONDS(15)); // Sleep for the remaining time to complete 60 seconds
+        // Sleep for the remaining time of the window. When measuring
+        // continuously a change ends the window early and the next one
+        // starts at the following sample; a duty cycled sensor keeps its
+        // period and only saves the remaining fan time.
+        if (event != IAQ_DELTA_NONE && !IS_ENABLED(CONFIG_APP_SPS30_DUTY_CYCLE)) {
+            window_start += (int64_t)taken * sample_interval_ms;
+        } else {
+            window_start += window_ms;
+        }
+        if (window_start < k_uptime_get()) {
+            window_start = k_uptime_get();
+        }
+        k_sleep(K_TIMEOUT_ABS_MS(window_start));
     }
 
     return 0;
@@ -0,0 +1,50 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/sys/util.h>
+
+#include <iaq/accum.h>
+
+void iaq_accum_reset(struct iaq_accum *acc)
+{
+	acc->sum = 0;
+	acc->min = INT64_MAX;
+	acc->max = INT64_MIN;
+	acc->count = 0;
+}
+
+void iaq_accum_add_micro(struct iaq_accum *acc, int64_t micro)
+{
+	acc->sum += micro;
+	acc->min = MIN(acc->min, micro);
+	acc->max = MAX(acc->max, micro);
+	acc->count++;
+}
+
+void iaq_accum_add(struct iaq_accum *acc, const struct sensor_value *val)
+{
+	iaq_accum_add_micro(acc, sensor_value_to_micro(val));
+}
+
+int64_t iaq_accum_mean(const struct iaq_accum *acc)
+{
+	int64_t half;
+
+	if (acc->count == 0) {
+		return 0;
+	}
+
+	/* Round half away from zero instead of truncating towards it */
+	half = (acc->sum < 0) ? -(int64_t)(acc->count / 2) : (int64_t)(acc->count / 2);
+
+	return (acc->sum + half) / (int64_t)acc->count;
+}
+
+void iaq_accum_mean_value(const struct iaq_accum *acc, struct sensor_value *val)
+{
+	int64_t mean = iaq_accum_mean(acc);
+
+	val->val1 = (int32_t)(mean / 1000000);
+	val->val2 = (int32_t)(mean % 1000000);
+}
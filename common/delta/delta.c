@@ -0,0 +1,44 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iaq/delta.h>
+
+void iaq_delta_reset(struct iaq_delta *state)
+{
+	state->last = 0;
+	state->reported = false;
+}
+
+enum iaq_delta_event iaq_delta_check(const struct iaq_delta *state,
+				     const struct iaq_delta_rule *rule, int64_t micro)
+{
+	int64_t hysteresis = rule->delta / 4;
+	int64_t diff;
+
+	if (!state->reported) {
+		return IAQ_DELTA_BAND;
+	}
+
+	for (uint8_t i = 0; i < rule->num_bands; i++) {
+		int64_t edge = rule->bands[i];
+
+		if ((state->last <= edge && micro > edge + hysteresis) ||
+		    (state->last > edge && micro <= edge - hysteresis)) {
+			return IAQ_DELTA_BAND;
+		}
+	}
+
+	diff = micro - state->last;
+	if (rule->delta > 0 && (diff >= rule->delta || diff <= -rule->delta)) {
+		return IAQ_DELTA_MOVED;
+	}
+
+	return IAQ_DELTA_NONE;
+}
+
+void iaq_delta_update(struct iaq_delta *state, int64_t micro)
+{
+	state->last = micro;
+	state->reported = true;
+}
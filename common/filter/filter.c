@@ -0,0 +1,115 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/sys/util.h>
+
+#include <iaq/filter.h>
+
+#if defined(CONFIG_IAQ_FILTER_TRIMMED_MEAN)
+BUILD_ASSERT(2 * CONFIG_IAQ_FILTER_TRIM < CONFIG_IAQ_FILTER_WINDOW,
+	     "IAQ_FILTER_TRIM must leave at least one sample");
+#endif
+
+void iaq_filter_reset(struct iaq_filter *filter)
+{
+	filter->head = 0;
+	filter->len = 0;
+}
+
+/* The buffers hold at most 15 samples, an insertion sort is the cheapest */
+static void sort(int64_t *v, size_t n)
+{
+	for (size_t i = 1; i < n; i++) {
+		int64_t x = v[i];
+		size_t j = i;
+
+		for (; j > 0 && v[j - 1] > x; j--) {
+			v[j] = v[j - 1];
+		}
+		v[j] = x;
+	}
+}
+
+#if !defined(CONFIG_IAQ_FILTER_TRIMMED_MEAN)
+/* Median of sorted values, the two middle ones averaged for even counts */
+static int64_t median(const int64_t *v, size_t n)
+{
+	if (n % 2) {
+		return v[n / 2];
+	}
+
+	return v[n / 2 - 1] + (v[n / 2] - v[n / 2 - 1]) / 2;
+}
+#endif
+
+#if defined(CONFIG_IAQ_FILTER_HAMPEL)
+static int64_t abs64(int64_t x)
+{
+	return (x < 0) ? -x : x;
+}
+#endif
+
+int64_t iaq_filter_apply_micro(struct iaq_filter *filter, int64_t micro)
+{
+	int64_t sorted[CONFIG_IAQ_FILTER_WINDOW];
+	size_t n;
+
+	filter->samples[filter->head] = micro;
+	filter->head = (filter->head + 1) % CONFIG_IAQ_FILTER_WINDOW;
+	if (filter->len < CONFIG_IAQ_FILTER_WINDOW) {
+		filter->len++;
+	}
+
+	/* Too few samples to tell an outlier apart */
+	n = filter->len;
+	if (n < 3) {
+		return micro;
+	}
+
+	memcpy(sorted, filter->samples, n * sizeof(sorted[0]));
+	sort(sorted, n);
+
+#if defined(CONFIG_IAQ_FILTER_MEDIAN)
+	return median(sorted, n);
+#elif defined(CONFIG_IAQ_FILTER_HAMPEL)
+	int64_t med = median(sorted, n);
+	int64_t mad;
+
+	for (size_t i = 0; i < n; i++) {
+		sorted[i] = abs64(sorted[i] - med);
+	}
+	sort(sorted, n);
+	mad = median(sorted, n);
+
+	/*
+	 * 1.4826 * MAD estimates the standard deviation of normal noise. With
+	 * a MAD of 0 (a flat signal) any change would be an outlier, so only
+	 * reject samples once there is some spread to compare against.
+	 */
+	if (mad > 0 &&
+	    abs64(micro - med) * 10000 > (int64_t)CONFIG_IAQ_FILTER_HAMPEL_THRESHOLD * 1483 * mad) {
+		return med;
+	}
+
+	return micro;
+#else
+	size_t trim = MIN((size_t)CONFIG_IAQ_FILTER_TRIM, (n - 1) / 2);
+	int64_t sum = 0;
+
+	for (size_t i = trim; i < n - trim; i++) {
+		sum += sorted[i];
+	}
+
+	return sum / (int64_t)(n - 2 * trim);
+#endif
+}
+
+void iaq_filter_apply(struct iaq_filter *filter, struct sensor_value *val)
+{
+	int64_t micro = iaq_filter_apply_micro(filter, sensor_value_to_micro(val));
+
+	val->val1 = (int32_t)(micro / 1000000);
+	val->val2 = (int32_t)(micro % 1000000);
+}
@@ -0,0 +1,50 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IAQ_ACCUM_H_
+#define IAQ_ACCUM_H_
+
+#include <stdint.h>
+#include <zephyr/drivers/sensor.h>
+
+/*
+ * Windowed statistics of one sensor channel. Samples are kept as int64
+ * micro-units, so sums carry correctly between the integer and fractional
+ * parts of a sensor_value and cannot overflow for any realistic window.
+ */
+struct iaq_accum {
+	int64_t sum;
+	int64_t min;
+	int64_t max;
+	uint32_t count;
+};
+
+/**
+ * @brief Start a new window.
+ */
+void iaq_accum_reset(struct iaq_accum *acc);
+
+/**
+ * @brief Add a sample in micro-units.
+ */
+void iaq_accum_add_micro(struct iaq_accum *acc, int64_t micro);
+
+/**
+ * @brief Add a sample read from a sensor channel.
+ */
+void iaq_accum_add(struct iaq_accum *acc, const struct sensor_value *val);
+
+/**
+ * @brief Mean of the window in micro-units, rounded to nearest.
+ *
+ * @return The mean, 0 if the window is empty.
+ */
+int64_t iaq_accum_mean(const struct iaq_accum *acc);
+
+/**
+ * @brief Mean of the window as a sensor_value.
+ */
+void iaq_accum_mean_value(const struct iaq_accum *acc, struct sensor_value *val);
+
+#endif /* IAQ_ACCUM_H_ */
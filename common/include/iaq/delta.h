@@ -0,0 +1,64 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IAQ_DELTA_H_
+#define IAQ_DELTA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IAQ_DELTA_MAX_BANDS 4
+
+/* Whole units of a metric in the micro-units the rules are expressed in */
+#define IAQ_DELTA_UNITS(x) ((int64_t)(x) * 1000000)
+
+/*
+ * When a metric is worth reporting. Band edges are in ascending order,
+ * e.g. the 800 and 1000 ppm CO2 limits. A delta of 0 never triggers a
+ * report on its own; the metric is then only sent along with the others.
+ */
+struct iaq_delta_rule {
+	int64_t delta;
+	int64_t bands[IAQ_DELTA_MAX_BANDS];
+	uint8_t num_bands;
+};
+
+/* Last reported value of one metric */
+struct iaq_delta {
+	int64_t last;
+	bool reported;
+};
+
+enum iaq_delta_event {
+	IAQ_DELTA_NONE,
+	/* Moved by at least the delta since the last report */
+	IAQ_DELTA_MOVED,
+	/* Crossed a band edge since the last report */
+	IAQ_DELTA_BAND,
+};
+
+/**
+ * @brief Forget the last reported value so the next check triggers.
+ */
+void iaq_delta_reset(struct iaq_delta *state);
+
+/**
+ * @brief Compare a value in micro-units with the last reported one.
+ *
+ * A band edge only counts as crossed once the value is a quarter of the
+ * delta past it, so noise around an edge does not report every sample.
+ *
+ * @return IAQ_DELTA_BAND if nothing was reported yet or a band edge was
+ *         crossed, IAQ_DELTA_MOVED if it moved by at least the delta,
+ *         IAQ_DELTA_NONE otherwise.
+ */
+enum iaq_delta_event iaq_delta_check(const struct iaq_delta *state,
+				     const struct iaq_delta_rule *rule, int64_t micro);
+
+/**
+ * @brief Record a value in micro-units as reported.
+ */
+void iaq_delta_update(struct iaq_delta *state, int64_t micro);
+
+#endif /* IAQ_DELTA_H_ */
@@ -0,0 +1,37 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IAQ_FILTER_H_
+#define IAQ_FILTER_H_
+
+#include <stdint.h>
+#include <zephyr/drivers/sensor.h>
+
+/*
+ * Outlier filter of one sensor channel, over a ring buffer of its most
+ * recent samples in micro-units. The buffer spans report windows, so the
+ * first samples of a window are judged against the previous ones.
+ */
+struct iaq_filter {
+	int64_t samples[CONFIG_IAQ_FILTER_WINDOW];
+	uint8_t head;
+	uint8_t len;
+};
+
+/**
+ * @brief Forget every sample, e.g. after the sensor was restarted.
+ */
+void iaq_filter_reset(struct iaq_filter *filter);
+
+/**
+ * @brief Add a sample in micro-units and return its filtered value.
+ */
+int64_t iaq_filter_apply_micro(struct iaq_filter *filter, int64_t micro);
+
+/**
+ * @brief Filter a sample read from a sensor channel in place.
+ */
+void iaq_filter_apply(struct iaq_filter *filter, struct sensor_value *val);
+
+#endif /* IAQ_FILTER_H_ */
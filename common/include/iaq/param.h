@@ -0,0 +1,98 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IAQ_PARAM_H_
+#define IAQ_PARAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/sensor.h>
+#include <iaq/report.h>
+
+/*
+ * Runtime parameters of a client node.
+ *
+ * The application declares its parameters in a table, with their range
+ * and build-time default. With CONFIG_IAQ_PARAM_COAP they are served on
+ * IAQ_CONFIG_URI_PATH:
+ *   GET      every parameter; with Observe 0 the requester is notified
+ *            whenever one changes (RFC 7641)
+ *   PUT/POST change some parameters, all or none of them (4.00 if one is
+ *            unknown or out of range)
+ *
+ * Payload (IAQ_CONFIG_CONTENT_FORMAT, multi-byte values are big-endian):
+ *   [0]      IAQ_PARAM_VERSION
+ *   [1..]    parameters, each one id byte (enum iaq_param_id) followed by
+ *            an int32 value
+ *
+ * Changed values are saved under "iaq/param/<id>" with the settings
+ * subsystem and restored by iaq_param_init().
+ */
+
+#define IAQ_PARAM_VERSION    1
+#define IAQ_PARAM_SIZE       5
+#define IAQ_PARAM_MAX_PARAMS 16
+#define IAQ_PARAM_MAX_SIZE   (1 + (IAQ_PARAM_MAX_PARAMS * IAQ_PARAM_SIZE))
+
+enum iaq_param_id {
+	/* Milliseconds between the samples of a window */
+	IAQ_PARAM_SAMPLE_INTERVAL = 1,
+	/* Samples averaged into one report */
+	IAQ_PARAM_SAMPLES_PER_WINDOW,
+	/* Milliseconds between the starts of two windows */
+	IAQ_PARAM_WINDOW,
+	/* Windows committed before a batch is sent */
+	IAQ_PARAM_BATCH_WINDOWS,
+	/* SCD41 measurement mode (enum scd4x_mode_t), -1 for the one using
+	 * the least energy at the sample interval
+	 */
+	IAQ_PARAM_SCD41_MODE,
+	/*
+	 * Inclusive validity bounds of a report field in milli-units,
+	 * see IAQ_PARAM_MIN() and IAQ_PARAM_MAX()
+	 */
+	IAQ_PARAM_MIN_BASE = 0x40,
+	IAQ_PARAM_MAX_BASE = 0x80,
+};
+
+#define IAQ_PARAM_MIN(field) (IAQ_PARAM_MIN_BASE + (field))
+#define IAQ_PARAM_MAX(field) (IAQ_PARAM_MAX_BASE + (field))
+
+struct iaq_param {
+	uint8_t id;
+	int32_t min;
+	int32_t max;
+	/* Build-time default until restored or changed */
+	int32_t value;
+};
+
+/**
+ * @brief Restore the saved values and serve the parameters over CoAP.
+ *
+ * Without CONFIG_IAQ_PARAM_COAP only the table is registered.
+ *
+ * @param params Table of the application, used in place
+ * @param count Number of entries, at most IAQ_PARAM_MAX_PARAMS
+ *
+ * @return 0 if successful, -EIO if CoAP could not be started, other
+ *         negative errno codes if the settings could not be loaded.
+ */
+int iaq_param_init(struct iaq_param *params, size_t count);
+
+/**
+ * @brief Get the current value of a parameter.
+ *
+ * @return The value, 0 if the application declared no such parameter.
+ */
+int32_t iaq_param_get(uint8_t id);
+
+/**
+ * @brief Check a reading against the validity bounds of its report field.
+ *
+ * A missing bound does not restrict the reading.
+ */
+bool iaq_param_in_bounds(enum iaq_field field, const struct sensor_value *val);
+
+#endif /* IAQ_PARAM_H_ */
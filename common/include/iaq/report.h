@@ -0,0 +1,169 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IAQ_REPORT_H_
+#define IAQ_REPORT_H_
+
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/drivers/sensor.h>
+
+/*
+ * Binary sensor report, sent with IAQ_REPORT_CONTENT_FORMAT instead of JSON.
+ *
+ * Layout (multi-byte values are big-endian):
+ *   [0]      IAQ_REPORT_VERSION
+ *   [1]      enum iaq_sensor the report belongs to
+ *   [2]      IAQ_STATUS_* flags
+ *   [3..]    fields, each one tag byte (enum iaq_field) followed by an
+ *            int32 value in milli-units
+ *
+ * A full SCD41 report is 18 bytes, against ~110 bytes of JSON text.
+ */
+
+/* CoAP content-formats from the experimental-use range (RFC 7252, 12.3). */
+#define IAQ_REPORT_CONTENT_FORMAT 65000
+
+/*
+ * A batch is a sequence of reports, each prefixed by one byte holding its
+ * length. Sent by the uplink library, split back into reports by the
+ * server node.
+ */
+#define IAQ_BATCH_CONTENT_FORMAT 65001
+
+/*
+ * Selective acknowledgement of the reports of one node, sent by the server
+ * node in the response to a confirmable batch, and on its own when it
+ * notices missing reports in non-confirmable batches.
+ *
+ * Layout (big-endian):
+ *   [0..3]   every IAQ_FIELD_SEQUENCE up to this one was received
+ *   [4..7]   bit i set if sequence number [0..3] + 1 + i was received
+ *   [8..11]  IAQ_FIELD_EPOCH the sequence numbers belong to
+ */
+#define IAQ_ACK_CONTENT_FORMAT 65002
+#define IAQ_ACK_SIZE           12
+#define IAQ_ACK_WINDOW         32
+
+/*
+ * Wall-clock time served by the server node to GET requests on
+ * IAQ_TIME_URI_PATH: milliseconds since the UNIX epoch, big-endian uint64.
+ */
+#define IAQ_TIME_CONTENT_FORMAT 65003
+#define IAQ_TIME_SIZE           8
+#define IAQ_TIME_URI_PATH       "time"
+
+/*
+ * Runtime parameters of a client node, served and changed on
+ * IAQ_CONFIG_URI_PATH. Layout in iaq/param.h.
+ */
+#define IAQ_CONFIG_CONTENT_FORMAT 65004
+#define IAQ_CONFIG_URI_PATH       "config"
+
+#define IAQ_REPORT_VERSION     1
+#define IAQ_REPORT_HEADER_SIZE 3
+#define IAQ_REPORT_FIELD_SIZE  5
+/* Room for a full SPS30 report plus the sequence, epoch, time and age */
+#define IAQ_REPORT_MAX_FIELDS  16
+#define IAQ_REPORT_MAX_SIZE                                                                        \
+	(IAQ_REPORT_HEADER_SIZE + (IAQ_REPORT_MAX_FIELDS * IAQ_REPORT_FIELD_SIZE))
+
+#define IAQ_STATUS_SCD41_OK  BIT(0)
+#define IAQ_STATUS_CCS811_OK BIT(1)
+#define IAQ_STATUS_SPS30_OK  BIT(2)
+
+enum iaq_sensor {
+	/* Node level report, e.g. an error concerning every sensor */
+	IAQ_SENSOR_NONE,
+	IAQ_SENSOR_SCD41,
+	IAQ_SENSOR_CCS811,
+	IAQ_SENSOR_SPS30,
+};
+
+enum iaq_field {
+	IAQ_FIELD_CO2 = 1,
+	IAQ_FIELD_TEMPERATURE,
+	IAQ_FIELD_HUMIDITY,
+	IAQ_FIELD_ECO2,
+	IAQ_FIELD_TVOC,
+	IAQ_FIELD_PM_1_0,
+	IAQ_FIELD_PM_2_5,
+	IAQ_FIELD_PM_10,
+	IAQ_FIELD_PM_4_0,
+	/* Number concentrations in #/cm3 */
+	IAQ_FIELD_NC_0_5,
+	IAQ_FIELD_NC_1_0,
+	IAQ_FIELD_NC_2_5,
+	IAQ_FIELD_NC_4_0,
+	IAQ_FIELD_NC_10,
+	/* Typical particle size in um */
+	IAQ_FIELD_PARTICLE_SIZE,
+	/* Value is an enum iaq_error code, not milli-units */
+	IAQ_FIELD_ERROR = 0x40,
+	/* Store-and-forward sequence number of the report, added on send */
+	IAQ_FIELD_SEQUENCE,
+	/* Milliseconds between taking the report and sending it */
+	IAQ_FIELD_AGE,
+	/* Seconds since the UNIX epoch the report was taken at, as a uint32 */
+	IAQ_FIELD_TIME,
+	/* Epoch of the store-and-forward log the sequence number counts in,
+	 * as a uint32. Added to the first report of every batch; the server
+	 * node starts the window of the node over when it changes.
+	 */
+	IAQ_FIELD_EPOCH,
+};
+
+enum iaq_error {
+	/* Sensor not connected or pins mis-configured */
+	IAQ_ERROR_NOT_READY = 1,
+	/* Every sample in the averaging window was out of bounds */
+	IAQ_ERROR_INVALID_DATA,
+};
+
+struct iaq_report {
+	uint8_t buf[IAQ_REPORT_MAX_SIZE];
+	uint8_t len;
+};
+
+/**
+ * @brief Start a new report.
+ *
+ * @param report Report to initialize
+ * @param sensor Sensor the fields belong to
+ * @param status IAQ_STATUS_* flags of the node
+ */
+void iaq_report_init(struct iaq_report *report, enum iaq_sensor sensor, uint8_t status);
+
+/**
+ * @brief Append a field holding a value in milli-units.
+ *
+ * @return 0 if successful, -ENOMEM if the report is full.
+ */
+int iaq_report_put(struct iaq_report *report, enum iaq_field field, int32_t value);
+
+/**
+ * @brief Append a field from a sensor_value.
+ *
+ * @return 0 if successful, -ENOMEM if the report is full.
+ */
+int iaq_report_put_sensor_value(struct iaq_report *report, enum iaq_field field,
+				const struct sensor_value *val);
+
+/**
+ * @brief Append a field from a value in micro-units, rounded to milli-units.
+ *
+ * @return 0 if successful, -ENOMEM if the report is full.
+ */
+int iaq_report_put_micro(struct iaq_report *report, enum iaq_field field, int64_t micro);
+
+/**
+ * @brief Find the first field with a given tag.
+ *
+ * @param value Set to the value of the field if found, may be NULL
+ *
+ * @return 0 if successful, -ENOENT if the report has no such field.
+ */
+int iaq_report_get(const struct iaq_report *report, enum iaq_field field, int32_t *value);
+
+#endif /* IAQ_REPORT_H_ */
@@ -0,0 +1,106 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IAQ_SENSIRION_H_
+#define IAQ_SENSIRION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/sys/byteorder.h>
+
+/*
+ * Helpers for the I2C protocol shared by the Sensirion sensors (SCD4x,
+ * SPS30): data is exchanged as big-endian 16-bit words, each followed by
+ * a CRC-8 (polynomial 0x31, init 0xFF, no reflection, no final xor).
+ */
+
+#define IAQ_SENSIRION_CRC8_POLY 0x31
+#define IAQ_SENSIRION_CRC8_INIT 0xFF
+
+/* Bytes of one word on the bus: 2 data bytes and the CRC */
+#define IAQ_SENSIRION_WORD_SIZE 3
+/* Receive buffer size for num_words words */
+#define IAQ_SENSIRION_BUF_SIZE(num_words) ((num_words) * IAQ_SENSIRION_WORD_SIZE)
+/* Most argument words any command of the supported sensors takes */
+#define IAQ_SENSIRION_MAX_ARGS 2
+
+/**
+ * @brief Compute the Sensirion CRC-8 of a buffer.
+ *
+ * @param data Bytes to checksum, usually one 2-byte word
+ * @param len Number of bytes
+ *
+ * @return The CRC-8.
+ */
+uint8_t iaq_sensirion_crc8(const uint8_t *data, size_t len);
+
+/**
+ * @brief Compute the CRC-8 of a word as it is sent on the bus (big-endian).
+ */
+uint8_t iaq_sensirion_word_crc(uint16_t word);
+
+/**
+ * @brief Check the CRC of every word of a received buffer.
+ *
+ * @param buf Words as received, IAQ_SENSIRION_WORD_SIZE bytes each
+ * @param num_words Number of words in buf
+ *
+ * @return 0 if every CRC matches, -EIO otherwise.
+ */
+int iaq_sensirion_check_crc(const uint8_t *buf, size_t num_words);
+
+/**
+ * @brief Send a command, with its argument words and their CRCs.
+ *
+ * @param bus Sensor I2C bus
+ * @param cmd 16-bit command code
+ * @param args Argument words, NULL if num_args is 0
+ * @param num_args Number of argument words, at most IAQ_SENSIRION_MAX_ARGS
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int iaq_sensirion_write(const struct i2c_dt_spec *bus, uint16_t cmd, const uint16_t *args,
+			size_t num_args);
+
+/**
+ * @brief Read words from the sensor and check their CRCs in place.
+ *
+ * The words stay in buf as received; decode them with the
+ * iaq_sensirion_get_*() accessors instead of copying them out first.
+ *
+ * @param bus Sensor I2C bus
+ * @param buf At least IAQ_SENSIRION_BUF_SIZE(num_words) bytes
+ * @param num_words Number of words to read
+ *
+ * @return 0 if successful, -EIO on a CRC mismatch, negative errno code if
+ * the transfer failed.
+ */
+int iaq_sensirion_read(const struct i2c_dt_spec *bus, uint8_t *buf, size_t num_words);
+
+/** @brief Word number word of a buffer filled by iaq_sensirion_read(). */
+static inline uint16_t iaq_sensirion_get_u16(const uint8_t *buf, size_t word)
+{
+	return sys_get_be16(&buf[word * IAQ_SENSIRION_WORD_SIZE]);
+}
+
+/** @brief 32-bit value held by words word and word + 1, most significant first. */
+static inline uint32_t iaq_sensirion_get_u32(const uint8_t *buf, size_t word)
+{
+	return ((uint32_t)iaq_sensirion_get_u16(buf, word) << 16) |
+	       iaq_sensirion_get_u16(buf, word + 1);
+}
+
+/** @brief IEEE 754 float held by words word and word + 1. */
+static inline float iaq_sensirion_get_float(const uint8_t *buf, size_t word)
+{
+	uint32_t bits = iaq_sensirion_get_u32(buf, word);
+	float value;
+
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+#endif /* IAQ_SENSIRION_H_ */
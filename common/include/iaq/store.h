@@ -0,0 +1,121 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IAQ_STORE_H_
+#define IAQ_STORE_H_
+
+#include <stdint.h>
+#include <zephyr/fs/fcb.h>
+#include <iaq/report.h>
+
+/*
+ * Store-and-forward log of sensor reports.
+ *
+ * Every report is appended to a flash circular buffer together with a
+ * sequence number and the uptime it was taken at. Records stay pending
+ * until iaq_store_ack() is called with their sequence number; the
+ * acknowledgement is itself logged, so pending records are found again
+ * after a reboot.
+ *
+ * Sequence numbers count within an epoch of the log, a random number drawn
+ * when the log starts over empty. A receiver that remembers the sequence
+ * numbers of a previous epoch must forget them when the epoch changes.
+ */
+
+struct iaq_store_record {
+	/* Monotonic across reboots, starting at 1 */
+	uint32_t seq;
+	/* Low byte of the boot count the record was written in */
+	uint8_t boot;
+	/* k_uptime_get() when the record was written */
+	int64_t uptime_ms;
+	struct iaq_report report;
+};
+
+struct iaq_store_iter {
+	struct fcb_entry loc;
+};
+
+struct iaq_store_stats {
+	/* Reports written to flash */
+	uint32_t appended;
+	/* Reports waiting for an acknowledgement */
+	uint32_t pending;
+	/* Pending reports erased to make room for new ones */
+	uint32_t lost;
+};
+
+/**
+ * @brief Mount the log and recover the pending records.
+ *
+ * @return 0 if successful, negative errno code otherwise.
+ */
+int iaq_store_init(void);
+
+/**
+ * @brief Append a report to the log.
+ *
+ * @param report Report to store
+ * @param seq Sequence number given to the record, may be NULL
+ *
+ * @return 0 if successful, -ENODEV if the log is not mounted, other
+ *         negative errno codes if the record could not be written.
+ */
+int iaq_store_append(const struct iaq_report *report, uint32_t *seq);
+
+/**
+ * @brief Position an iterator before the oldest pending record.
+ */
+void iaq_store_iter_init(struct iaq_store_iter *iter);
+
+/**
+ * @brief Read the next pending record.
+ *
+ * @return 0 if successful, -ENOENT if there are no more pending records.
+ */
+int iaq_store_iter_next(struct iaq_store_iter *iter, struct iaq_store_record *record);
+
+/**
+ * @brief Acknowledge every record up to and including @p seq.
+ *
+ * @return 0 if successful, negative errno code if the acknowledgement
+ *         could not be written. It is still applied until the next reboot.
+ */
+int iaq_store_ack(uint32_t seq);
+
+/**
+ * @brief Number of records waiting for an acknowledgement.
+ */
+uint32_t iaq_store_pending(void);
+
+/**
+ * @brief Boot count stamped into records written since iaq_store_init().
+ */
+uint8_t iaq_store_boot(void);
+
+/**
+ * @brief Epoch the sequence numbers of the log count in.
+ */
+uint32_t iaq_store_epoch(void);
+
+/**
+ * @brief Sequence number the next appended record gets.
+ */
+uint32_t iaq_store_next_seq(void);
+
+/**
+ * @brief Draw a new epoch, for when the receiver acknowledged sequence
+ * numbers this log never assigned. Pending records stay pending.
+ *
+ * @return 0 if successful, negative errno code if the epoch could not be
+ *         written. It is still used until the next reboot.
+ */
+int iaq_store_new_epoch(void);
+
+/**
+ * @brief Get a copy of the log counters.
+ */
+void iaq_store_stats_get(struct iaq_store_stats *stats);
+
+#endif /* IAQ_STORE_H_ */
@@ -0,0 +1,50 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IAQ_TIMESYNC_H_
+#define IAQ_TIMESYNC_H_
+
+#include <errno.h>
+#include <stdint.h>
+
+/*
+ * Wall-clock time of a client node.
+ *
+ * The server node serves the UNIX time it gets from the host on
+ * IAQ_TIME_URI_PATH. Clients read it every CONFIG_IAQ_TIMESYNC_INTERVAL
+ * seconds and keep the offset to k_uptime_get(); the offset is not kept
+ * across reboots.
+ */
+
+#if defined(CONFIG_IAQ_TIMESYNC)
+/**
+ * @brief Start the CoAP client and schedule the first synchronization.
+ *
+ * @return 0 if successful, -EIO if CoAP could not be started.
+ */
+int iaq_timesync_init(void);
+
+/**
+ * @brief Convert an uptime of the current boot to the UNIX time.
+ *
+ * @param uptime_ms Value returned by k_uptime_get()
+ * @param epoch_ms Set to the milliseconds since the UNIX epoch
+ *
+ * @return 0 if successful, -EAGAIN if the node was not synchronized yet.
+ */
+int iaq_timesync_to_epoch(int64_t uptime_ms, int64_t *epoch_ms);
+#else
+/* Never synchronized without a server node to ask */
+static inline int iaq_timesync_init(void)
+{
+	return 0;
+}
+
+static inline int iaq_timesync_to_epoch(int64_t uptime_ms, int64_t *epoch_ms)
+{
+	return -EAGAIN;
+}
+#endif /* CONFIG_IAQ_TIMESYNC */
+
+#endif /* IAQ_TIMESYNC_H_ */
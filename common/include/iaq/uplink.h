@@ -0,0 +1,108 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef IAQ_UPLINK_H_
+#define IAQ_UPLINK_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <iaq/report.h>
+
+struct iaq_uplink_stats {
+	/* CoAP requests handed to OpenThread */
+	uint32_t batches_sent;
+	/* Reports carried by those requests, replays included */
+	uint32_t reports_sent;
+	/* Reports acknowledged by the server */
+	uint32_t reports_delivered;
+	/* Reports that could not be written to the log */
+	uint32_t reports_dropped;
+	/* Requests that were not acknowledged by the server */
+	uint32_t delivery_failed;
+};
+
+#if defined(CONFIG_IAQ_UPLINK)
+/**
+ * @brief Mount the report log and start the CoAP client used to reach the
+ *        server node.
+ *
+ * Reports left pending by a previous boot are replayed after
+ * CONFIG_IAQ_UPLINK_RETRY_INTERVAL seconds.
+ *
+ * @return 0 if successful, -EIO if CoAP could not be started, other
+ *         negative errno codes if the log could not be mounted.
+ */
+int iaq_uplink_init(void);
+
+/**
+ * @brief Append a report to the log.
+ *
+ * Pending reports are sent once enough windows were committed or the
+ * maximum latency expired, and are sent again until acknowledged. With
+ * CONFIG_IAQ_TIMESYNC, the report is stamped with the time it was queued
+ * at as soon as the node is synchronized.
+ *
+ * @return 0 if successful, negative errno code if the report was dropped.
+ */
+int iaq_uplink_queue(const struct iaq_report *report);
+
+/**
+ * @brief Mark the end of an averaging window.
+ *
+ * Sends the batch once CONFIG_IAQ_UPLINK_BATCH_WINDOWS windows were
+ * committed.
+ */
+void iaq_uplink_commit(void);
+
+/**
+ * @brief Change the number of windows collected per batch.
+ *
+ * Replaces CONFIG_IAQ_UPLINK_BATCH_WINDOWS, from the next commit on.
+ */
+void iaq_uplink_set_batch_windows(uint8_t windows);
+
+/**
+ * @brief Send the oldest pending reports right away.
+ *
+ * @return 0 if successful or nothing was pending, -EBUSY if the previous
+ *         batch is still in flight, -EIO if the request could not be sent.
+ */
+int iaq_uplink_flush(void);
+
+/**
+ * @brief Get a copy of the uplink counters.
+ */
+void iaq_uplink_stats_get(struct iaq_uplink_stats *stats);
+#else
+/* No network to send them on (native_sim): reports are encoded and dropped */
+static inline int iaq_uplink_init(void)
+{
+	return 0;
+}
+
+static inline int iaq_uplink_queue(const struct iaq_report *report)
+{
+	return 0;
+}
+
+static inline void iaq_uplink_commit(void)
+{
+}
+
+static inline void iaq_uplink_set_batch_windows(uint8_t windows)
+{
+}
+
+static inline int iaq_uplink_flush(void)
+{
+	return 0;
+}
+
+static inline void iaq_uplink_stats_get(struct iaq_uplink_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+#endif /* CONFIG_IAQ_UPLINK */
+
+#endif /* IAQ_UPLINK_H_ */
@@ -0,0 +1,536 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#if defined(CONFIG_IAQ_PARAM_COAP)
+#include <zephyr/net/openthread.h>
+#include <zephyr/settings/settings.h>
+#include <openthread/coap.h>
+#include <openthread/ip6.h>
+#endif
+
+#include <iaq/param.h>
+
+LOG_MODULE_REGISTER(iaq_param, CONFIG_IAQ_PARAM_LOG_LEVEL);
+
+/* Values are shared by the OpenThread context, the work queue and the app */
+static struct iaq_param *params;
+static size_t num_params;
+static struct k_spinlock param_lock;
+
+/* Must be called with param_lock held. */
+static struct iaq_param *param_find_locked(uint8_t id)
+{
+	for (size_t i = 0; i < num_params; i++) {
+		if (params[i].id == id) {
+			return &params[i];
+		}
+	}
+
+	return NULL;
+}
+
+#if defined(CONFIG_IAQ_PARAM_COAP)
+#define PARAM_SETTINGS_ROOT "iaq/param"
+#define PARAM_OBSERVERS_KEY "obs"
+/* Bit of param_save_bits telling the observer table changed */
+#define PARAM_SAVE_OBSERVERS IAQ_PARAM_MAX_PARAMS
+/* Observe sequence numbers are 24 bits (RFC 7641, 4.4) */
+#define PARAM_OBSERVE_MASK 0xFFFFFF
+
+/* Registration of a GET with Observe 0, unused while port is 0 */
+struct param_observer {
+	otIp6Address addr;
+	uint16_t port;
+	uint8_t token_len;
+	uint8_t token[OT_COAP_MAX_TOKEN_LENGTH];
+};
+
+/* Guarded by param_lock as well */
+static struct param_observer observers[CONFIG_IAQ_PARAM_MAX_OBSERVERS];
+static uint8_t observer_next;
+
+/* Only touched from the OpenThread context */
+static uint32_t observe_seq;
+
+/* Parameters, by index, and observer table waiting to be saved */
+static ATOMIC_DEFINE(param_save_bits, IAQ_PARAM_MAX_PARAMS + 1);
+
+static void param_save_work_handler(struct k_work *work);
+static K_WORK_DEFINE(param_save_work, param_save_work_handler);
+static void param_notify_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(param_notify_work, param_notify_work_handler);
+
+static int param_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+			      void *cb_arg)
+{
+	struct param_observer loaded[CONFIG_IAQ_PARAM_MAX_OBSERVERS];
+	struct iaq_param *param;
+	k_spinlock_key_t key;
+	const char *next;
+	unsigned long id;
+	int32_t value;
+	char *end;
+	int rc;
+
+	if (settings_name_steq(name, PARAM_OBSERVERS_KEY, &next) && next == NULL) {
+		/* Written with another CONFIG_IAQ_PARAM_MAX_OBSERVERS, start over */
+		if (len != sizeof(loaded)) {
+			return 0;
+		}
+		rc = read_cb(cb_arg, loaded, sizeof(loaded));
+		if (rc < 0) {
+			return rc;
+		}
+
+		key = k_spin_lock(&param_lock);
+		memcpy(observers, loaded, sizeof(observers));
+		k_spin_unlock(&param_lock, key);
+		return 0;
+	}
+
+	id = strtoul(name, &end, 16);
+	if (*end != '\0' || len != sizeof(value)) {
+		return -ENOENT;
+	}
+	rc = read_cb(cb_arg, &value, sizeof(value));
+	if (rc < 0) {
+		return rc;
+	}
+
+	/* Values of parameters the application no longer declares are ignored */
+	key = k_spin_lock(&param_lock);
+	param = param_find_locked((uint8_t)id);
+	if (param != NULL && value >= param->min && value <= param->max) {
+		param->value = value;
+	}
+	k_spin_unlock(&param_lock, key);
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(iaq_param, PARAM_SETTINGS_ROOT, NULL, param_settings_set, NULL,
+			       NULL);
+
+/* Flash writes take milliseconds, keep them out of the OpenThread context. */
+static void param_save_work_handler(struct k_work *work)
+{
+	struct param_observer saved[CONFIG_IAQ_PARAM_MAX_OBSERVERS];
+	char name[sizeof(PARAM_SETTINGS_ROOT "/ff")];
+	k_spinlock_key_t key;
+	int32_t value;
+	uint8_t id;
+	int rc;
+
+	for (size_t i = 0; i < num_params; i++) {
+		if (!atomic_test_and_clear_bit(param_save_bits, i)) {
+			continue;
+		}
+
+		key = k_spin_lock(&param_lock);
+		id = params[i].id;
+		value = params[i].value;
+		k_spin_unlock(&param_lock, key);
+
+		snprintf(name, sizeof(name), PARAM_SETTINGS_ROOT "/%02x", id);
+		rc = settings_save_one(name, &value, sizeof(value));
+		if (rc != 0) {
+			LOG_ERR("Failed to save parameter 0x%02x: %d", id, rc);
+		}
+	}
+
+	if (atomic_test_and_clear_bit(param_save_bits, PARAM_SAVE_OBSERVERS)) {
+		key = k_spin_lock(&param_lock);
+		memcpy(saved, observers, sizeof(saved));
+		k_spin_unlock(&param_lock, key);
+
+		rc = settings_save_one(PARAM_SETTINGS_ROOT "/" PARAM_OBSERVERS_KEY, saved,
+				       sizeof(saved));
+		if (rc != 0) {
+			LOG_ERR("Failed to save observers: %d", rc);
+		}
+	}
+}
+
+static otError param_append_payload(otMessage *message)
+{
+	uint8_t buf[IAQ_PARAM_MAX_SIZE];
+	k_spinlock_key_t key;
+	size_t len = 1;
+	otError error;
+
+	buf[0] = IAQ_PARAM_VERSION;
+	key = k_spin_lock(&param_lock);
+	for (size_t i = 0; i < num_params; i++) {
+		buf[len] = params[i].id;
+		sys_put_be32((uint32_t)params[i].value, &buf[len + 1]);
+		len += IAQ_PARAM_SIZE;
+	}
+	k_spin_unlock(&param_lock, key);
+
+	error = otCoapMessageAppendUintOption(message, OT_COAP_OPTION_CONTENT_FORMAT,
+					      IAQ_CONFIG_CONTENT_FORMAT);
+	if (error != OT_ERROR_NONE) {
+		return error;
+	}
+
+	error = otCoapMessageSetPayloadMarker(message);
+	if (error != OT_ERROR_NONE) {
+		return error;
+	}
+
+	return otMessageAppend(message, buf, len);
+}
+
+/* Send every parameter to every observer. Runs in the OpenThread context. */
+static void param_notify(otInstance *instance)
+{
+	struct param_observer observer;
+	otMessageInfo message_info;
+	otMessage *message;
+	k_spinlock_key_t key;
+	otError error;
+
+	observe_seq = (observe_seq + 1) & PARAM_OBSERVE_MASK;
+
+	for (size_t i = 0; i < CONFIG_IAQ_PARAM_MAX_OBSERVERS; i++) {
+		key = k_spin_lock(&param_lock);
+		observer = observers[i];
+		k_spin_unlock(&param_lock, key);
+
+		if (observer.port == 0) {
+			continue;
+		}
+
+		message = otCoapNewMessage(instance, NULL);
+		if (message == NULL) {
+			LOG_ERR("Failed to allocate CoAP notification");
+			return;
+		}
+
+		otCoapMessageInit(message, OT_COAP_TYPE_NON_CONFIRMABLE, OT_COAP_CODE_CONTENT);
+
+		do {
+			error = otCoapMessageSetToken(message, observer.token, observer.token_len);
+			if (error != OT_ERROR_NONE) {
+				break;
+			}
+
+			error = otCoapMessageAppendObserveOption(message, observe_seq);
+			if (error != OT_ERROR_NONE) {
+				break;
+			}
+
+			error = param_append_payload(message);
+			if (error != OT_ERROR_NONE) {
+				break;
+			}
+
+			memset(&message_info, 0, sizeof(message_info));
+			message_info.mPeerAddr = observer.addr;
+			message_info.mPeerPort = observer.port;
+			error = otCoapSendRequest(instance, message, &message_info, NULL, NULL);
+		} while (false);
+
+		if (error != OT_ERROR_NONE) {
+			LOG_WRN("Failed to notify observer %zu: %d", i, error);
+			otMessageFree(message);
+		}
+	}
+}
+
+/* Tell the observers the node restarted, once it had time to attach. */
+static void param_notify_work_handler(struct k_work *work)
+{
+	struct openthread_context *ot_context = openthread_get_default_context();
+
+	openthread_api_mutex_lock(ot_context);
+	param_notify(openthread_get_default_instance());
+	openthread_api_mutex_unlock(ot_context);
+}
+
+/* Register or deregister the requester, see RFC 7641, 3.1 and 3.6. */
+static bool param_observe(const otMessage *request, const otMessageInfo *message_info)
+{
+	otCoapOptionIterator iterator;
+	struct param_observer *observer = NULL;
+	struct param_observer previous;
+	k_spinlock_key_t key;
+	uint64_t observe;
+	bool changed;
+
+	if (otCoapOptionIteratorInit(&iterator, request) != OT_ERROR_NONE ||
+	    otCoapOptionIteratorGetFirstMatchingOption(&iterator, OT_COAP_OPTION_OBSERVE) ==
+		    NULL ||
+	    otCoapOptionIteratorGetOptionUintValue(&iterator, &observe) != OT_ERROR_NONE) {
+		return false;
+	}
+
+	key = k_spin_lock(&param_lock);
+	for (size_t i = 0; i < CONFIG_IAQ_PARAM_MAX_OBSERVERS && observer == NULL; i++) {
+		if (observers[i].port == message_info->mPeerPort &&
+		    otIp6IsAddressEqual(&observers[i].addr, &message_info->mPeerAddr)) {
+			observer = &observers[i];
+		}
+	}
+
+	if (observe == 0) {
+		for (size_t i = 0; i < CONFIG_IAQ_PARAM_MAX_OBSERVERS && observer == NULL; i++) {
+			if (observers[i].port == 0) {
+				observer = &observers[i];
+			}
+		}
+		if (observer == NULL) {
+			/* Full, replace the oldest registration */
+			observer = &observers[observer_next];
+			observer_next = (observer_next + 1) % CONFIG_IAQ_PARAM_MAX_OBSERVERS;
+		}
+		previous = *observer;
+		memset(observer, 0, sizeof(*observer));
+		observer->addr = message_info->mPeerAddr;
+		observer->port = message_info->mPeerPort;
+		observer->token_len = otCoapMessageGetTokenLength(request);
+		memcpy(observer->token, otCoapMessageGetToken(request), observer->token_len);
+		changed = memcmp(&previous, observer, sizeof(previous)) != 0;
+	} else {
+		changed = observer != NULL;
+		if (changed) {
+			memset(observer, 0, sizeof(*observer));
+		}
+	}
+	k_spin_unlock(&param_lock, key);
+
+	/* Periodic re-registrations with the same token cost no flash write */
+	if (changed) {
+		atomic_set_bit(param_save_bits, PARAM_SAVE_OBSERVERS);
+		k_work_submit(&param_save_work);
+	}
+
+	return observe == 0;
+}
+
+/*
+ * Apply a PUT or POST payload, all of it or nothing. Returns -EINVAL if it
+ * is malformed or holds an unknown or out of range parameter.
+ */
+static int param_write(const uint8_t *buf, uint16_t len, bool *changed)
+{
+	struct iaq_param *param;
+	k_spinlock_key_t key;
+	int32_t value;
+	int ret = 0;
+
+	if (len < 1 || buf[0] != IAQ_PARAM_VERSION || (len - 1) % IAQ_PARAM_SIZE != 0) {
+		return -EINVAL;
+	}
+
+	*changed = false;
+	key = k_spin_lock(&param_lock);
+
+	for (uint16_t i = 1; i < len && ret == 0; i += IAQ_PARAM_SIZE) {
+		param = param_find_locked(buf[i]);
+		value = (int32_t)sys_get_be32(&buf[i + 1]);
+		if (param == NULL || value < param->min || value > param->max) {
+			ret = -EINVAL;
+		}
+	}
+
+	for (uint16_t i = 1; i < len && ret == 0; i += IAQ_PARAM_SIZE) {
+		param = param_find_locked(buf[i]);
+		value = (int32_t)sys_get_be32(&buf[i + 1]);
+		if (param->value != value) {
+			param->value = value;
+			atomic_set_bit(param_save_bits, param - params);
+			*changed = true;
+		}
+	}
+
+	k_spin_unlock(&param_lock, key);
+
+	return ret;
+}
+
+static void param_respond(otInstance *instance, otMessage *request,
+			  const otMessageInfo *message_info, otCoapCode code, bool observe)
+{
+	otCoapType type = (otCoapMessageGetType(request) == OT_COAP_TYPE_CONFIRMABLE)
+				  ? OT_COAP_TYPE_ACKNOWLEDGMENT
+				  : OT_COAP_TYPE_NON_CONFIRMABLE;
+	otMessage *response;
+	otError error;
+
+	response = otCoapNewMessage(instance, NULL);
+	if (response == NULL) {
+		LOG_ERR("Failed to allocate CoAP response");
+		return;
+	}
+
+	do {
+		error = otCoapMessageInitResponse(response, request, type, code);
+		if (error != OT_ERROR_NONE) {
+			break;
+		}
+
+		if (observe) {
+			error = otCoapMessageAppendObserveOption(response, observe_seq);
+			if (error != OT_ERROR_NONE) {
+				break;
+			}
+		}
+
+		if (code == OT_COAP_CODE_CONTENT) {
+			error = param_append_payload(response);
+			if (error != OT_ERROR_NONE) {
+				break;
+			}
+		}
+
+		error = otCoapSendResponse(instance, response, message_info);
+	} while (false);
+
+	if (error != OT_ERROR_NONE) {
+		LOG_WRN("Failed to send CoAP response: %d", error);
+		otMessageFree(response);
+	}
+}
+
+static void param_request_cb(void *context, otMessage *message,
+			     const otMessageInfo *message_info)
+{
+	otInstance *instance = context;
+	uint8_t buf[IAQ_PARAM_MAX_SIZE + 1];
+	uint16_t len;
+	bool changed;
+
+	switch (otCoapMessageGetCode(message)) {
+	case OT_COAP_CODE_GET:
+		param_respond(instance, message, message_info, OT_COAP_CODE_CONTENT,
+			      param_observe(message, message_info));
+		break;
+	case OT_COAP_CODE_PUT:
+	case OT_COAP_CODE_POST:
+		len = otMessageRead(message, otMessageGetOffset(message), buf, sizeof(buf));
+		if (len > IAQ_PARAM_MAX_SIZE || param_write(buf, len, &changed) != 0) {
+			param_respond(instance, message, message_info, OT_COAP_CODE_BAD_REQUEST,
+				      false);
+			break;
+		}
+
+		param_respond(instance, message, message_info, OT_COAP_CODE_CHANGED, false);
+		if (changed) {
+			LOG_INF("Parameters changed by the server");
+			k_work_submit(&param_save_work);
+			param_notify(instance);
+		}
+		break;
+	default:
+		param_respond(instance, message, message_info, OT_COAP_CODE_METHOD_NOT_ALLOWED,
+			      false);
+		break;
+	}
+}
+
+static otCoapResource param_resource = {
+	.mUriPath = IAQ_CONFIG_URI_PATH,
+	.mHandler = param_request_cb,
+};
+
+/* Restore the saved values and observers, then start serving them. */
+static int param_coap_init(void)
+{
+	otInstance *instance = openthread_get_default_instance();
+	bool observed = false;
+	otError error;
+	int ret;
+
+	ret = settings_subsys_init();
+	if (ret != 0) {
+		LOG_ERR("Failed to initialize settings: %d", ret);
+		return ret;
+	}
+
+	ret = settings_load_subtree(PARAM_SETTINGS_ROOT);
+	if (ret != 0) {
+		LOG_ERR("Failed to load parameters: %d", ret);
+		return ret;
+	}
+
+	/* Already started by the uplink, if any: then this is a no-op */
+	error = otCoapStart(instance, OT_DEFAULT_COAP_PORT);
+	if (error != OT_ERROR_NONE) {
+		LOG_ERR("Failed to start Coap: %d", error);
+		return -EIO;
+	}
+
+	param_resource.mContext = instance;
+	otCoapAddResource(instance, &param_resource);
+
+	for (size_t i = 0; i < CONFIG_IAQ_PARAM_MAX_OBSERVERS; i++) {
+		observed |= observers[i].port != 0;
+	}
+	if (observed) {
+		k_work_schedule(&param_notify_work, K_SECONDS(CONFIG_IAQ_PARAM_NOTIFY_DELAY));
+	}
+
+	return 0;
+}
+#endif /* CONFIG_IAQ_PARAM_COAP */
+
+int iaq_param_init(struct iaq_param *table, size_t count)
+{
+	k_spinlock_key_t key;
+
+	__ASSERT_NO_MSG(count <= IAQ_PARAM_MAX_PARAMS);
+
+	key = k_spin_lock(&param_lock);
+	params = table;
+	num_params = count;
+	k_spin_unlock(&param_lock, key);
+
+#if defined(CONFIG_IAQ_PARAM_COAP)
+	return param_coap_init();
+#else
+	return 0;
+#endif
+}
+
+int32_t iaq_param_get(uint8_t id)
+{
+	const struct iaq_param *param;
+	k_spinlock_key_t key;
+	int32_t value = 0;
+
+	key = k_spin_lock(&param_lock);
+	param = param_find_locked(id);
+	if (param != NULL) {
+		value = param->value;
+	}
+	k_spin_unlock(&param_lock, key);
+
+	return value;
+}
+
+bool iaq_param_in_bounds(enum iaq_field field, const struct sensor_value *val)
+{
+	int64_t milli = sensor_value_to_milli(val);
+	const struct iaq_param *min;
+	const struct iaq_param *max;
+	k_spinlock_key_t key;
+	bool valid;
+
+	key = k_spin_lock(&param_lock);
+	min = param_find_locked(IAQ_PARAM_MIN(field));
+	max = param_find_locked(IAQ_PARAM_MAX(field));
+	valid = (min == NULL || milli >= min->value) && (max == NULL || milli <= max->value);
+	k_spin_unlock(&param_lock, key);
+
+	return valid;
+}
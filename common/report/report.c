@@ -0,0 +1,57 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <iaq/report.h>
+
+void iaq_report_init(struct iaq_report *report, enum iaq_sensor sensor, uint8_t status)
+{
+	report->buf[0] = IAQ_REPORT_VERSION;
+	report->buf[1] = (uint8_t)sensor;
+	report->buf[2] = status;
+	report->len = IAQ_REPORT_HEADER_SIZE;
+}
+
+int iaq_report_put(struct iaq_report *report, enum iaq_field field, int32_t value)
+{
+	if (report->len + IAQ_REPORT_FIELD_SIZE > sizeof(report->buf)) {
+		return -ENOMEM;
+	}
+
+	report->buf[report->len] = (uint8_t)field;
+	sys_put_be32((uint32_t)value, &report->buf[report->len + 1]);
+	report->len += IAQ_REPORT_FIELD_SIZE;
+
+	return 0;
+}
+
+int iaq_report_put_sensor_value(struct iaq_report *report, enum iaq_field field,
+				const struct sensor_value *val)
+{
+	return iaq_report_put(report, field, (int32_t)sensor_value_to_milli(val));
+}
+
+int iaq_report_put_micro(struct iaq_report *report, enum iaq_field field, int64_t micro)
+{
+	int64_t half = (micro < 0) ? -500 : 500;
+
+	return iaq_report_put(report, field, (int32_t)((micro + half) / 1000));
+}
+
+int iaq_report_get(const struct iaq_report *report, enum iaq_field field, int32_t *value)
+{
+	for (uint8_t i = IAQ_REPORT_HEADER_SIZE; i + IAQ_REPORT_FIELD_SIZE <= report->len;
+	     i += IAQ_REPORT_FIELD_SIZE) {
+		if (report->buf[i] == (uint8_t)field) {
+			if (value != NULL) {
+				*value = (int32_t)sys_get_be32(&report->buf[i + 1]);
+			}
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
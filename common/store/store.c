@@ -0,0 +1,389 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/random/random.h>
+#include <zephyr/storage/flash_map.h>
+
+#include <iaq/store.h>
+
+LOG_MODULE_REGISTER(iaq_store, CONFIG_IAQ_STORE_LOG_LEVEL);
+
+#define STORE_PARTITION_ID FIXED_PARTITION_ID(iaq_store_partition)
+#define STORE_MAGIC        0x49415131 /* "IAQ1" */
+#define STORE_VERSION      1
+/* Largest flash write block handled when padding records */
+#define STORE_MAX_ALIGN    8
+
+enum store_record_type {
+	/* Header followed by the encoded report */
+	STORE_RECORD_DATA = 1,
+	/* Header only, seq is the highest acknowledged record */
+	STORE_RECORD_ACK,
+	/* Header followed by the epoch of the log, seq is unused */
+	STORE_RECORD_EPOCH,
+};
+
+struct store_record_hdr {
+	uint8_t type;
+	uint8_t boot;
+	uint32_t seq;
+	int64_t uptime_ms;
+} __packed;
+
+static struct fcb store_fcb;
+static struct flash_sector store_sectors[CONFIG_IAQ_STORE_MAX_SECTORS];
+/* Last acknowledged data record, fe_sector is NULL if it was erased */
+static struct fcb_entry ack_loc;
+static uint32_t acked_seq;
+static uint32_t next_seq = 1;
+static uint8_t boot;
+static uint32_t epoch;
+static bool store_mounted;
+static struct iaq_store_stats store_stats;
+static K_MUTEX_DEFINE(store_lock);
+
+static int store_read_hdr(const struct fcb_entry *loc, struct store_record_hdr *hdr)
+{
+	if (loc->fe_data_len < sizeof(*hdr)) {
+		return -EBADMSG;
+	}
+
+	return flash_area_read(store_fcb.fap, FCB_ENTRY_FA_DATA_OFF((*loc)), hdr, sizeof(*hdr));
+}
+
+/* Erase the oldest sector, accounting for the pending records it held. */
+static int store_rotate(void)
+{
+	struct fcb_entry loc = {0};
+	struct store_record_hdr hdr;
+	struct flash_sector *oldest = store_fcb.f_oldest;
+	uint32_t lost = 0;
+	int rc;
+
+	while (fcb_getnext(&store_fcb, &loc) == 0 && loc.fe_sector == oldest) {
+		if (store_read_hdr(&loc, &hdr) == 0 && hdr.type == STORE_RECORD_DATA &&
+		    hdr.seq > acked_seq) {
+			lost++;
+		}
+	}
+
+	rc = fcb_rotate(&store_fcb);
+	if (rc != 0) {
+		return rc;
+	}
+
+	if (ack_loc.fe_sector == oldest) {
+		ack_loc.fe_sector = NULL;
+	}
+
+	if (lost > 0) {
+		store_stats.pending -= lost;
+		store_stats.lost += lost;
+		LOG_WRN("Log full, %u pending reports erased", lost);
+	}
+
+	return 0;
+}
+
+static int store_write(uint8_t type, uint32_t seq, const uint8_t *data, uint8_t len)
+{
+	uint8_t buf[ROUND_UP(sizeof(struct store_record_hdr) + IAQ_REPORT_MAX_SIZE,
+			     STORE_MAX_ALIGN)];
+	struct store_record_hdr hdr = {
+		.type = type,
+		.boot = boot,
+		.seq = seq,
+		.uptime_ms = k_uptime_get(),
+	};
+	uint16_t total = sizeof(hdr) + len;
+	struct fcb_entry loc;
+	bool rotated = false;
+	int rc;
+
+	rc = fcb_append(&store_fcb, total, &loc);
+	if (rc == -ENOSPC) {
+		rc = store_rotate();
+		if (rc == 0) {
+			rotated = true;
+			rc = fcb_append(&store_fcb, total, &loc);
+		}
+	}
+	if (rc != 0) {
+		return rc;
+	}
+
+	/* Space is reserved in whole write blocks, pad with the erased value */
+	memset(buf, store_fcb.f_erase_value, sizeof(buf));
+	memcpy(buf, &hdr, sizeof(hdr));
+	if (len > 0) {
+		memcpy(&buf[sizeof(hdr)], data, len);
+	}
+
+	rc = flash_area_write(store_fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), buf,
+			      ROUND_UP(total, store_fcb.f_align));
+	if (rc != 0) {
+		return rc;
+	}
+
+	rc = fcb_append_finish(&store_fcb, &loc);
+	if (rc != 0) {
+		return rc;
+	}
+
+	/* The erased sector may have held the only epoch and acknowledgement records */
+	if (rotated && type != STORE_RECORD_EPOCH) {
+		rc = store_write(STORE_RECORD_EPOCH, 0, (const uint8_t *)&epoch, sizeof(epoch));
+	}
+	if (rc == 0 && rotated && type != STORE_RECORD_ACK && acked_seq > 0) {
+		rc = store_write(STORE_RECORD_ACK, acked_seq, NULL, 0);
+	}
+
+	return rc;
+}
+
+/* Must be called with store_lock held. */
+static int store_new_epoch_locked(void)
+{
+	epoch = sys_rand32_get();
+
+	return store_write(STORE_RECORD_EPOCH, 0, (const uint8_t *)&epoch, sizeof(epoch));
+}
+
+/*
+ * Recover sequence numbers, the acknowledgement position and the epoch from
+ * flash. Returns false if no epoch was found, i.e. the log starts over.
+ */
+static bool store_scan(void)
+{
+	struct fcb_entry loc = {0};
+	struct store_record_hdr hdr;
+	uint32_t last_seq = 0;
+	bool found = false;
+	bool has_epoch = false;
+
+	while (fcb_getnext(&store_fcb, &loc) == 0) {
+		if (store_read_hdr(&loc, &hdr) != 0) {
+			continue;
+		}
+		found = true;
+		boot = hdr.boot;
+		last_seq = MAX(last_seq, hdr.seq);
+		if (hdr.type == STORE_RECORD_ACK) {
+			acked_seq = MAX(acked_seq, hdr.seq);
+		} else if (hdr.type == STORE_RECORD_EPOCH &&
+			   loc.fe_data_len >= sizeof(hdr) + sizeof(epoch) &&
+			   flash_area_read(store_fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc) + sizeof(hdr),
+					   &epoch, sizeof(epoch)) == 0) {
+			/* The newest one wins */
+			has_epoch = true;
+		}
+	}
+
+	memset(&loc, 0, sizeof(loc));
+	while (fcb_getnext(&store_fcb, &loc) == 0) {
+		if (store_read_hdr(&loc, &hdr) != 0 || hdr.type != STORE_RECORD_DATA) {
+			continue;
+		}
+		if (hdr.seq <= acked_seq) {
+			ack_loc = loc;
+		} else {
+			store_stats.pending++;
+		}
+	}
+
+	next_seq = last_seq + 1;
+	if (found) {
+		boot++;
+	}
+
+	return has_epoch;
+}
+
+int iaq_store_init(void)
+{
+	uint32_t sector_cnt = ARRAY_SIZE(store_sectors);
+	int rc;
+
+	rc = flash_area_get_sectors(STORE_PARTITION_ID, &sector_cnt, store_sectors);
+	if (rc != 0) {
+		LOG_ERR("Failed to get flash sectors: %d", rc);
+		return rc;
+	}
+
+	store_fcb.f_magic = STORE_MAGIC;
+	store_fcb.f_version = STORE_VERSION;
+	store_fcb.f_sector_cnt = sector_cnt;
+	store_fcb.f_sectors = store_sectors;
+
+	rc = fcb_init(STORE_PARTITION_ID, &store_fcb);
+	if (rc != 0) {
+		LOG_ERR("Failed to mount log: %d", rc);
+		return rc;
+	}
+
+	k_mutex_lock(&store_lock, K_FOREVER);
+	if (!store_scan()) {
+		/* Wiped, reflashed or written by a firmware without epochs */
+		rc = store_new_epoch_locked();
+		if (rc != 0) {
+			LOG_WRN("Failed to log epoch: %d", rc);
+		}
+	}
+	store_mounted = true;
+	k_mutex_unlock(&store_lock);
+
+	LOG_INF("Log mounted, epoch %08x, boot %u, next seq %u, %u pending", epoch, boot,
+		next_seq, store_stats.pending);
+
+	return 0;
+}
+
+int iaq_store_append(const struct iaq_report *report, uint32_t *seq)
+{
+	int rc;
+
+	k_mutex_lock(&store_lock, K_FOREVER);
+
+	rc = store_mounted ? store_write(STORE_RECORD_DATA, next_seq, report->buf, report->len)
+			   : -ENODEV;
+	if (rc == 0) {
+		if (seq != NULL) {
+			*seq = next_seq;
+		}
+		next_seq++;
+		store_stats.appended++;
+		store_stats.pending++;
+	} else {
+		LOG_ERR("Failed to append report: %d", rc);
+	}
+
+	k_mutex_unlock(&store_lock);
+
+	return rc;
+}
+
+void iaq_store_iter_init(struct iaq_store_iter *iter)
+{
+	k_mutex_lock(&store_lock, K_FOREVER);
+	iter->loc = ack_loc;
+	k_mutex_unlock(&store_lock);
+}
+
+int iaq_store_iter_next(struct iaq_store_iter *iter, struct iaq_store_record *record)
+{
+	struct store_record_hdr hdr;
+	int rc = -ENOENT;
+
+	k_mutex_lock(&store_lock, K_FOREVER);
+
+	while (store_mounted && fcb_getnext(&store_fcb, &iter->loc) == 0) {
+		uint16_t len = iter->loc.fe_data_len - sizeof(hdr);
+
+		if (store_read_hdr(&iter->loc, &hdr) != 0 || hdr.type != STORE_RECORD_DATA ||
+		    hdr.seq <= acked_seq || len > sizeof(record->report.buf)) {
+			continue;
+		}
+
+		if (flash_area_read(store_fcb.fap, FCB_ENTRY_FA_DATA_OFF(iter->loc) + sizeof(hdr),
+				    record->report.buf, len) != 0) {
+			continue;
+		}
+
+		record->seq = hdr.seq;
+		record->boot = hdr.boot;
+		record->uptime_ms = hdr.uptime_ms;
+		record->report.len = len;
+		rc = 0;
+		break;
+	}
+
+	k_mutex_unlock(&store_lock);
+
+	return rc;
+}
+
+int iaq_store_ack(uint32_t seq)
+{
+	struct fcb_entry loc;
+	struct store_record_hdr hdr;
+	int rc = 0;
+
+	k_mutex_lock(&store_lock, K_FOREVER);
+
+	if (!store_mounted || seq <= acked_seq) {
+		goto out;
+	}
+
+	loc = ack_loc;
+	while (fcb_getnext(&store_fcb, &loc) == 0) {
+		if (store_read_hdr(&loc, &hdr) != 0 || hdr.type != STORE_RECORD_DATA) {
+			continue;
+		}
+		if (hdr.seq > seq) {
+			break;
+		}
+		ack_loc = loc;
+		if (hdr.seq > acked_seq && store_stats.pending > 0) {
+			store_stats.pending--;
+		}
+	}
+	acked_seq = seq;
+
+	rc = store_write(STORE_RECORD_ACK, seq, NULL, 0);
+	if (rc != 0) {
+		LOG_ERR("Failed to log acknowledgement: %d", rc);
+	}
+
+out:
+	k_mutex_unlock(&store_lock);
+
+	return rc;
+}
+
+uint32_t iaq_store_pending(void)
+{
+	return store_stats.pending;
+}
+
+uint8_t iaq_store_boot(void)
+{
+	return boot;
+}
+
+uint32_t iaq_store_epoch(void)
+{
+	return epoch;
+}
+
+uint32_t iaq_store_next_seq(void)
+{
+	return next_seq;
+}
+
+int iaq_store_new_epoch(void)
+{
+	int rc;
+
+	k_mutex_lock(&store_lock, K_FOREVER);
+	rc = store_mounted ? store_new_epoch_locked() : -ENODEV;
+	k_mutex_unlock(&store_lock);
+
+	if (rc != 0) {
+		LOG_ERR("Failed to log epoch: %d", rc);
+	}
+
+	return rc;
+}
+
+void iaq_store_stats_get(struct iaq_store_stats *stats)
+{
+	k_mutex_lock(&store_lock, K_FOREVER);
+	*stats = store_stats;
+	k_mutex_unlock(&store_lock);
+}
@@ -0,0 +1,147 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#if defined(CONFIG_TIMING_FUNCTIONS)
+#include <zephyr/timing/timing.h>
+#endif
+
+#include <iaq/sensirion.h>
+
+#define NUM_WORDS (UINT16_MAX + 1)
+
+/* The algorithm of the datasheets, one shift/xor round per bit */
+static uint8_t crc8_bitwise(const uint8_t *data, size_t len)
+{
+	uint8_t crc = IAQ_SENSIRION_CRC8_INIT;
+
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (uint8_t)(crc << 1) ^ IAQ_SENSIRION_CRC8_POLY
+					   : (uint8_t)(crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+ZTEST(sensirion, test_table_matches_poly)
+{
+	for (unsigned int i = 0; i < 256; i++) {
+		uint8_t expected = i;
+		/* A single byte looks up entry byte ^ init */
+		uint8_t byte = i ^ IAQ_SENSIRION_CRC8_INIT;
+
+		for (int bit = 0; bit < 8; bit++) {
+			expected = (expected & 0x80)
+					   ? (uint8_t)(expected << 1) ^ IAQ_SENSIRION_CRC8_POLY
+					   : (uint8_t)(expected << 1);
+		}
+		zassert_equal(iaq_sensirion_crc8(&byte, 1), expected, "entry 0x%02x", i);
+	}
+}
+
+ZTEST(sensirion, test_every_word_matches_bitwise)
+{
+	uint8_t buf[2];
+
+	for (uint32_t word = 0; word < NUM_WORDS; word++) {
+		uint8_t expected;
+
+		sys_put_be16(word, buf);
+		expected = crc8_bitwise(buf, sizeof(buf));
+		zassert_equal(iaq_sensirion_crc8(buf, sizeof(buf)), expected, "word 0x%04x", word);
+		zassert_equal(iaq_sensirion_word_crc(word), expected, "word 0x%04x", word);
+	}
+}
+
+ZTEST(sensirion, test_datasheet_vectors)
+{
+	static const uint8_t beef[] = {0xBE, 0xEF};
+	uint8_t words[] = {0xBE, 0xEF, 0x92, 0x00, 0x00, 0x81};
+
+	/* Example of the SCD4x and SPS30 datasheets */
+	zassert_equal(iaq_sensirion_crc8(beef, sizeof(beef)), 0x92);
+	zassert_equal(iaq_sensirion_word_crc(0xBEEF), 0x92);
+	zassert_equal(iaq_sensirion_word_crc(0x0000), 0x81);
+
+	zassert_ok(iaq_sensirion_check_crc(words, 2));
+	words[5] ^= 0x01;
+	zassert_equal(iaq_sensirion_check_crc(words, 2), -EIO);
+}
+
+#if defined(CONFIG_TIMING_FUNCTIONS)
+typedef timing_t bench_t;
+#define bench_now()              timing_counter_get()
+#define bench_cycles(start, end) timing_cycles_get(&(start), &(end))
+#elif defined(CONFIG_ARCH_POSIX) && (defined(__x86_64__) || defined(__i386__))
+/* Simulated time stands still while code runs on native_sim, count host cycles */
+typedef uint64_t bench_t;
+#define bench_now()              __builtin_ia32_rdtsc()
+#define bench_cycles(start, end) ((end) - (start))
+#endif
+
+#if defined(bench_now)
+static void bench_print(const char *name, uint64_t cycles)
+{
+	uint64_t centi = cycles * 100 / NUM_WORDS;
+
+	TC_PRINT("%-10s %u.%02u cycles/word\n", name, (uint32_t)(centi / 100),
+		 (uint32_t)(centi % 100));
+}
+#endif
+
+/* Cycles per word of the table and of the bitwise algorithm, over every word */
+ZTEST(sensirion, test_benchmark)
+{
+#if defined(bench_now)
+	uint8_t table_sum = 0, bitwise_sum = 0, word_sum = 0;
+	uint8_t buf[2];
+	bench_t start, end;
+
+#if defined(CONFIG_TIMING_FUNCTIONS)
+	timing_init();
+	timing_start();
+#endif
+
+	start = bench_now();
+	for (uint32_t word = 0; word < NUM_WORDS; word++) {
+		sys_put_be16(word, buf);
+		table_sum ^= iaq_sensirion_crc8(buf, sizeof(buf));
+	}
+	end = bench_now();
+	bench_print("table", bench_cycles(start, end));
+
+	start = bench_now();
+	for (uint32_t word = 0; word < NUM_WORDS; word++) {
+		word_sum ^= iaq_sensirion_word_crc(word);
+	}
+	end = bench_now();
+	bench_print("word table", bench_cycles(start, end));
+
+	start = bench_now();
+	for (uint32_t word = 0; word < NUM_WORDS; word++) {
+		sys_put_be16(word, buf);
+		bitwise_sum ^= crc8_bitwise(buf, sizeof(buf));
+	}
+	end = bench_now();
+	bench_print("bitwise", bench_cycles(start, end));
+
+#if defined(CONFIG_TIMING_FUNCTIONS)
+	timing_stop();
+#endif
+
+	/* Keeps the loops from being optimized out */
+	zassert_equal(table_sum, bitwise_sum);
+	zassert_equal(word_sum, bitwise_sum);
+#else
+	ztest_test_skip();
+#endif
+}
+
+ZTEST_SUITE(sensirion, NULL, NULL, NULL, NULL, NULL);
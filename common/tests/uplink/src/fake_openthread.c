@@ -0,0 +1,240 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/openthread.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+#include <openthread/coap.h>
+#include <openthread/thread.h>
+
+#include <iaq/report.h>
+
+#include "fake_openthread.h"
+
+struct otMessage {
+	otCoapType type;
+	otCoapCode code;
+	uint16_t length;
+	uint8_t payload[CONFIG_IAQ_UPLINK_BUFFER_SIZE];
+};
+
+static struct openthread_context ot_context;
+static const otMeshLocalPrefix mesh_prefix = {{0xfd, 0xde, 0xad, 0x00, 0xbe, 0xef, 0x00, 0x00}};
+
+static struct otMessage request;
+static bool request_in_flight;
+static otCoapResponseHandler request_handler;
+static void *request_context;
+static otMessageInfo request_info;
+static struct otMessage response;
+
+/* State of the server node */
+static uint32_t room;
+static uint32_t received;
+static bool synced;
+static uint32_t cum_seq;
+static uint32_t epoch;
+
+void fake_server_set_room(uint32_t slots)
+{
+	room = slots;
+}
+
+uint32_t fake_server_received(void)
+{
+	return received;
+}
+
+static bool report_field(const uint8_t *report, uint8_t length, uint8_t tag, uint32_t *value)
+{
+	for (uint8_t i = IAQ_REPORT_HEADER_SIZE; i + IAQ_REPORT_FIELD_SIZE <= length;
+	     i += IAQ_REPORT_FIELD_SIZE) {
+		if (report[i] == tag) {
+			*value = sys_get_be32(&report[i + 1]);
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint32_t batch_reports(const struct otMessage *batch)
+{
+	uint32_t reports = 0;
+
+	for (uint16_t offset = 0; offset < batch->length; offset += 1 + batch->payload[offset]) {
+		reports++;
+	}
+	return reports;
+}
+
+/* Accepts every report of a batch, or none if they do not all fit. */
+static int server_ingest(const struct otMessage *batch)
+{
+	/* One slot stays for the node table entry */
+	if (batch_reports(batch) + 1 > room) {
+		return -ENOSPC;
+	}
+
+	for (uint16_t offset = 0; offset < batch->length; offset += 1 + batch->payload[offset]) {
+		const uint8_t *report = &batch->payload[offset + 1];
+		uint8_t length = batch->payload[offset];
+		uint32_t seq, value;
+
+		zassert_true(report_field(report, length, IAQ_FIELD_SEQUENCE, &seq));
+		if (report_field(report, length, IAQ_FIELD_EPOCH, &value) && value != epoch) {
+			epoch = value;
+			synced = false;
+		}
+		if (!synced || seq == cum_seq + 1) {
+			synced = true;
+			cum_seq = seq;
+		}
+		received++;
+	}
+
+	return 0;
+}
+
+int fake_server_respond(void)
+{
+	if (!request_in_flight) {
+		return -ENOENT;
+	}
+	request_in_flight = false;
+
+	memset(&response, 0, sizeof(response));
+	response.type = OT_COAP_TYPE_ACKNOWLEDGMENT;
+	if (server_ingest(&request) != 0) {
+		response.code = OT_COAP_CODE_SERVICE_UNAVAILABLE;
+	} else {
+		response.code = OT_COAP_CODE_CHANGED;
+		sys_put_be32(cum_seq, &response.payload[0]);
+		sys_put_be32(0, &response.payload[4]);
+		sys_put_be32(epoch, &response.payload[8]);
+		response.length = IAQ_ACK_SIZE;
+	}
+
+	request_handler(request_context, &response, &request_info, OT_ERROR_NONE);
+
+	return batch_reports(&request);
+}
+
+struct openthread_context *openthread_get_default_context(void)
+{
+	return &ot_context;
+}
+
+otInstance *openthread_get_default_instance(void)
+{
+	return ot_context.instance;
+}
+
+void openthread_api_mutex_lock(struct openthread_context *context)
+{
+}
+
+void openthread_api_mutex_unlock(struct openthread_context *context)
+{
+}
+
+const otMeshLocalPrefix *otThreadGetMeshLocalPrefix(otInstance *instance)
+{
+	return &mesh_prefix;
+}
+
+otError otCoapStart(otInstance *instance, uint16_t port)
+{
+	return OT_ERROR_NONE;
+}
+
+void otCoapAddResource(otInstance *instance, otCoapResource *resource)
+{
+}
+
+otMessage *otCoapNewMessage(otInstance *instance, const otMessageSettings *settings)
+{
+	/* The uplink has one request in flight at most */
+	memset(&request, 0, sizeof(request));
+	return &request;
+}
+
+void otCoapMessageInit(otMessage *message, otCoapType type, otCoapCode code)
+{
+	message->type = type;
+	message->code = code;
+}
+
+void otCoapMessageGenerateToken(otMessage *message, uint8_t token_length)
+{
+}
+
+otError otCoapMessageAppendUriPathOptions(otMessage *message, const char *uri_path)
+{
+	return OT_ERROR_NONE;
+}
+
+otError otCoapMessageAppendUintOption(otMessage *message, uint16_t number, uint32_t value)
+{
+	return OT_ERROR_NONE;
+}
+
+otError otCoapMessageSetPayloadMarker(otMessage *message)
+{
+	return OT_ERROR_NONE;
+}
+
+otCoapCode otCoapMessageGetCode(const otMessage *message)
+{
+	return message->code;
+}
+
+otError otMessageAppend(otMessage *message, const void *buf, uint16_t length)
+{
+	if (message->length + length > sizeof(message->payload)) {
+		return OT_ERROR_NO_BUFS;
+	}
+	memcpy(&message->payload[message->length], buf, length);
+	message->length += length;
+	return OT_ERROR_NONE;
+}
+
+uint16_t otMessageGetOffset(const otMessage *message)
+{
+	return 0;
+}
+
+uint16_t otMessageRead(const otMessage *message, uint16_t offset, void *buf, uint16_t length)
+{
+	if (offset >= message->length) {
+		return 0;
+	}
+	length = MIN(length, message->length - offset);
+	memcpy(buf, &message->payload[offset], length);
+	return length;
+}
+
+void otMessageFree(otMessage *message)
+{
+}
+
+otError otCoapSendRequestWithParameters(otInstance *instance, otMessage *message,
+					const otMessageInfo *message_info,
+					otCoapResponseHandler handler, void *context,
+					const otCoapTxParameters *tx_parameters)
+{
+	if (message->type == OT_COAP_TYPE_NON_CONFIRMABLE) {
+		/* Nothing comes back, a full queue drops it */
+		(void)server_ingest(message);
+		return OT_ERROR_NONE;
+	}
+
+	request_handler = handler;
+	request_context = context;
+	request_info = *message_info;
+	request_in_flight = true;
+	return OT_ERROR_NONE;
+}
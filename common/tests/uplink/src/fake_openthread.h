@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FAKE_OPENTHREAD_H_
+#define FAKE_OPENTHREAD_H_
+
+#include <stdint.h>
+
+/*
+ * The OpenThread calls of the uplink library, answered by a server node
+ * whose ingest queue has room for a limited number of reports. Like
+ * server_node, it keeps one slot for the node table entry, answers 5.03
+ * without touching the window of the node when a batch does not fit, and
+ * acknowledges the reports it received in order.
+ */
+
+/**
+ * @brief Set the free slots of the ingest queue of the server node.
+ */
+void fake_server_set_room(uint32_t slots);
+
+/**
+ * @brief Answer the confirmable request in flight.
+ *
+ * @return Number of reports it carried, -ENOENT if none is in flight.
+ */
+int fake_server_respond(void);
+
+/**
+ * @brief Reports the server node accepted so far.
+ */
+uint32_t fake_server_received(void);
+
+#endif /* FAKE_OPENTHREAD_H_ */
@@ -0,0 +1,76 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/ztest.h>
+
+#include <iaq/report.h>
+#include <iaq/store.h>
+#include <iaq/uplink.h>
+
+#include "fake_openthread.h"
+
+static void queue_reports(int count)
+{
+	struct iaq_report report;
+
+	for (int i = 0; i < count; i++) {
+		iaq_report_init(&report, IAQ_SENSOR_SCD41, 0);
+		zassert_ok(iaq_report_put(&report, IAQ_FIELD_CO2, 400000 + i));
+		zassert_ok(iaq_uplink_queue(&report));
+	}
+}
+
+/* Lets the work queue apply the response */
+static void settle(void)
+{
+	k_sleep(K_MSEC(10));
+}
+
+ZTEST(uplink, test_rejected_batch_stays_pending)
+{
+	struct iaq_uplink_stats before, after;
+
+	/* The ingest queue of the server node is full */
+	fake_server_set_room(0);
+	queue_reports(3);
+	iaq_uplink_stats_get(&before);
+
+	zassert_ok(iaq_uplink_flush());
+	zassert_equal(fake_server_respond(), 3);
+	settle();
+
+	zassert_equal(iaq_store_pending(), 3, "rejected reports left the log");
+	zassert_equal(fake_server_received(), 0);
+	iaq_uplink_stats_get(&after);
+	zassert_equal(after.reports_delivered, before.reports_delivered);
+	zassert_equal(after.delivery_failed, before.delivery_failed + 1);
+
+	/* Sent again once the queue has room */
+	fake_server_set_room(UINT16_MAX);
+	zassert_ok(iaq_uplink_flush());
+	zassert_equal(fake_server_respond(), 3);
+	settle();
+
+	zassert_equal(iaq_store_pending(), 0);
+	zassert_equal(fake_server_received(), 3);
+	iaq_uplink_stats_get(&after);
+	zassert_equal(after.reports_delivered, before.reports_delivered + 3);
+}
+
+static void *uplink_setup(void)
+{
+	const struct flash_area *fa;
+
+	/* The flash of native_sim outlives the process, start with an empty log */
+	zassert_ok(flash_area_open(FIXED_PARTITION_ID(iaq_store_partition), &fa));
+	zassert_ok(flash_area_erase(fa, 0, fa->fa_size));
+	flash_area_close(fa);
+
+	zassert_ok(iaq_uplink_init());
+	return NULL;
+}
+
+ZTEST_SUITE(uplink, NULL, uplink_setup, NULL, NULL, NULL);
@@ -0,0 +1,161 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <openthread/coap.h>
+#include <openthread/thread.h>
+
+#include <iaq/report.h>
+#include <iaq/timesync.h>
+
+LOG_MODULE_REGISTER(iaq_timesync, CONFIG_IAQ_TIMESYNC_LOG_LEVEL);
+
+/* Server node address is <mesh local prefix>::1 */
+static const uint8_t server_interface_id[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+/* epoch_ms = uptime_ms + offset_ms once synced */
+static int64_t offset_ms;
+static bool synced;
+static struct k_spinlock offset_lock;
+
+/* Uptime the request in flight was sent at */
+static int64_t request_ms;
+static atomic_t request_busy;
+
+static void timesync_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(timesync_work, timesync_work_handler);
+
+/*
+ * Runs in the OpenThread context. The server read its clock somewhere
+ * during the round trip; assuming halfway bounds the error to rtt / 2.
+ */
+static void timesync_response_cb(void *context, otMessage *message,
+				 const otMessageInfo *message_info, otError result)
+{
+	int64_t now = k_uptime_get();
+	int64_t rtt = now - request_ms;
+	uint8_t buf[IAQ_TIME_SIZE];
+	k_timeout_t next = K_SECONDS(CONFIG_IAQ_TIMESYNC_RETRY_INTERVAL);
+	k_spinlock_key_t key;
+
+	if (result != OT_ERROR_NONE) {
+		LOG_WRN("Time request failed: %d", result);
+	} else if (otCoapMessageGetCode(message) != OT_COAP_CODE_CONTENT) {
+		/* 5.03 until the host gave the server node the time */
+		LOG_DBG("Server has no time yet");
+	} else if (otMessageRead(message, otMessageGetOffset(message), buf, sizeof(buf)) !=
+		   sizeof(buf)) {
+		LOG_WRN("Short time response");
+	} else if (rtt > CONFIG_IAQ_TIMESYNC_MAX_RTT) {
+		LOG_DBG("Time response took %lld ms, discarded", rtt);
+	} else {
+		key = k_spin_lock(&offset_lock);
+		offset_ms = (int64_t)sys_get_be64(buf) + rtt / 2 - now;
+		synced = true;
+		k_spin_unlock(&offset_lock, key);
+
+		LOG_DBG("Synchronized, round trip %lld ms", rtt);
+		next = K_SECONDS(CONFIG_IAQ_TIMESYNC_INTERVAL);
+	}
+
+	atomic_clear(&request_busy);
+	k_work_reschedule(&timesync_work, next);
+}
+
+static otError timesync_request(otInstance *instance)
+{
+	otError error;
+	otMessage *message;
+	otMessageInfo message_info;
+	const otMeshLocalPrefix *mesh_prefix = otThreadGetMeshLocalPrefix(instance);
+
+	message = otCoapNewMessage(instance, NULL);
+	if (message == NULL) {
+		return OT_ERROR_NO_BUFS;
+	}
+
+	otCoapMessageInit(message, OT_COAP_TYPE_CONFIRMABLE, OT_COAP_CODE_GET);
+	otCoapMessageGenerateToken(message, OT_COAP_DEFAULT_TOKEN_LENGTH);
+
+	do {
+		error = otCoapMessageAppendUriPathOptions(message, IAQ_TIME_URI_PATH);
+		if (error != OT_ERROR_NONE) {
+			break;
+		}
+
+		memset(&message_info, 0, sizeof(message_info));
+		memcpy(&message_info.mPeerAddr.mFields.m8[0], mesh_prefix, 8);
+		memcpy(&message_info.mPeerAddr.mFields.m8[8], server_interface_id, 8);
+		message_info.mPeerPort = OT_DEFAULT_COAP_PORT;
+
+		request_ms = k_uptime_get();
+		error = otCoapSendRequest(instance, message, &message_info, timesync_response_cb,
+					  NULL);
+	} while (false);
+
+	if (error != OT_ERROR_NONE) {
+		otMessageFree(message);
+	}
+
+	return error;
+}
+
+static void timesync_work_handler(struct k_work *work)
+{
+	otInstance *instance = openthread_get_default_instance();
+	otError error;
+
+	/* The response handler schedules the next request */
+	if (!atomic_cas(&request_busy, 0, 1)) {
+		return;
+	}
+
+	openthread_api_mutex_lock(openthread_get_default_context());
+	error = timesync_request(instance);
+	openthread_api_mutex_unlock(openthread_get_default_context());
+
+	if (error != OT_ERROR_NONE) {
+		LOG_WRN("Failed to send time request: %d", error);
+		atomic_clear(&request_busy);
+		k_work_reschedule(&timesync_work, K_SECONDS(CONFIG_IAQ_TIMESYNC_RETRY_INTERVAL));
+	}
+}
+
+int iaq_timesync_init(void)
+{
+	otError error;
+
+	/* Already started by the uplink, if any: then this is a no-op */
+	error = otCoapStart(openthread_get_default_instance(), OT_DEFAULT_COAP_PORT);
+	if (error != OT_ERROR_NONE) {
+		LOG_ERR("Failed to start Coap: %d", error);
+		return -EIO;
+	}
+
+	/* Give the node time to attach before the first request */
+	k_work_schedule(&timesync_work, K_SECONDS(CONFIG_IAQ_TIMESYNC_RETRY_INTERVAL));
+
+	return 0;
+}
+
+int iaq_timesync_to_epoch(int64_t uptime_ms, int64_t *epoch_ms)
+{
+	k_spinlock_key_t key;
+	int ret = -EAGAIN;
+
+	key = k_spin_lock(&offset_lock);
+	if (synced) {
+		*epoch_ms = uptime_ms + offset_ms;
+		ret = 0;
+	}
+	k_spin_unlock(&offset_lock, key);
+
+	return ret;
+}
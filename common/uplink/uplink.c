@@ -0,0 +1,583 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/openthread.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <openthread/coap.h>
+#include <openthread/thread.h>
+
+#include <iaq/store.h>
+#include <iaq/timesync.h>
+#include <iaq/uplink.h>
+
+LOG_MODULE_REGISTER(iaq_uplink, CONFIG_IAQ_UPLINK_LOG_LEVEL);
+
+#define UPLINK_URI_PATH "sensor_data"
+/* Gap reports of the server node in non-confirmable mode */
+#define UPLINK_ACK_URI_PATH "sensor_ack"
+
+#if defined(CONFIG_IAQ_UPLINK_BLOCKWISE)
+/* 64 byte blocks keep every Block1 request inside one 802.15.4 frame */
+#define UPLINK_BLOCK_SZX  OT_COAP_OPTION_BLOCK_LENGTH_64
+#define UPLINK_BLOCK_SIZE 64
+#endif
+
+/* Server node address is <mesh local prefix>::1 */
+static const uint8_t server_interface_id[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+enum uplink_flags {
+	/* tx_buf is owned by OpenThread until the response handler runs */
+	UPLINK_TX_BUSY,
+	/* Set by the response handler, consumed by the work handler */
+	UPLINK_TX_DONE,
+	UPLINK_TX_FAILED,
+	/* A selective acknowledgement is waiting in sack_seq and sack_window */
+	UPLINK_SACK,
+};
+
+static uint8_t tx_buf[CONFIG_IAQ_UPLINK_BUFFER_SIZE];
+static uint16_t tx_len;
+static uint16_t tx_reports;
+/* Highest sequence number carried by the batch in flight */
+static uint32_t tx_last_seq;
+/* Reports queued and windows committed since the last batch was sent */
+static uint16_t queued_reports;
+static uint8_t queued_windows;
+static uint8_t batch_windows = CONFIG_IAQ_UPLINK_BATCH_WINDOWS;
+static atomic_t uplink_flags;
+static struct iaq_uplink_stats uplink_stats;
+static K_MUTEX_DEFINE(uplink_lock);
+
+static void uplink_flush_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(uplink_flush_work, uplink_flush_work_handler);
+
+#if defined(CONFIG_IAQ_UPLINK_NON_CONFIRMABLE)
+/* First sequence number never sent, 0 to start over from the oldest pending */
+static uint32_t tx_next_seq;
+/* Batches sent since the last confirmable one */
+static uint8_t tx_batches;
+/* Resend the reports the last acknowledgement reported missing */
+static bool tx_resend;
+/* Last applied acknowledgement, see IAQ_ACK_CONTENT_FORMAT */
+static uint32_t acked_seq;
+static uint32_t acked_window;
+/* Latest acknowledgement received, written from the OpenThread context */
+static uint32_t sack_seq;
+static uint32_t sack_window;
+static uint32_t sack_epoch;
+static struct k_spinlock sack_lock;
+
+/* Runs in the OpenThread context: only record it for the work queue. */
+static void uplink_sack_receive(const otMessage *message)
+{
+	uint8_t buf[IAQ_ACK_SIZE];
+	k_spinlock_key_t key;
+
+	if (otMessageRead(message, otMessageGetOffset(message), buf, sizeof(buf)) !=
+	    sizeof(buf)) {
+		return;
+	}
+
+	key = k_spin_lock(&sack_lock);
+	sack_seq = sys_get_be32(&buf[0]);
+	sack_window = sys_get_be32(&buf[4]);
+	sack_epoch = sys_get_be32(&buf[8]);
+	k_spin_unlock(&sack_lock, key);
+
+	atomic_set_bit(&uplink_flags, UPLINK_SACK);
+	k_work_reschedule(&uplink_flush_work, K_NO_WAIT);
+}
+
+static void uplink_ack_request_cb(void *context, otMessage *message,
+				  const otMessageInfo *message_info)
+{
+	/* Only the server node knows what arrived */
+	if (otCoapMessageGetCode(message) != OT_COAP_CODE_PUT ||
+	    memcmp(&message_info->mPeerAddr.mFields.m8[8], server_interface_id, 8) != 0) {
+		return;
+	}
+
+	uplink_sack_receive(message);
+}
+
+static otCoapResource uplink_ack_resource = {
+	.mUriPath = UPLINK_ACK_URI_PATH,
+	.mHandler = uplink_ack_request_cb,
+};
+
+/* Must be called with uplink_lock held. */
+static void uplink_sack_apply_locked(void)
+{
+	uint32_t pending = iaq_store_pending();
+	k_spinlock_key_t key;
+	uint32_t epoch;
+
+	key = k_spin_lock(&sack_lock);
+	acked_seq = sack_seq;
+	acked_window = sack_window;
+	epoch = sack_epoch;
+	k_spin_unlock(&sack_lock, key);
+
+	if (epoch != iaq_store_epoch()) {
+		/* Sent before the server saw the current epoch, nothing is
+		 * known: start over from the oldest pending report, which
+		 * carries the epoch
+		 */
+		LOG_DBG("Acknowledgement of epoch %08x ignored", epoch);
+		acked_seq = 0;
+		acked_window = 0;
+		tx_next_seq = 0;
+		tx_resend = false;
+		return;
+	}
+
+	if (acked_seq >= iaq_store_next_seq()) {
+		/* The server remembers sequence numbers this log never assigned,
+		 * from a previous life under the same epoch. Acknowledging them
+		 * would erase undelivered reports: keep them pending and start a
+		 * new epoch so the server forgets the old ones.
+		 */
+		LOG_WRN("Acknowledged seq %u was never sent, resynchronizing", acked_seq);
+		(void)iaq_store_new_epoch();
+		acked_seq = 0;
+		acked_window = 0;
+		tx_next_seq = 0;
+		tx_resend = false;
+		return;
+	}
+
+	/* Reports sent in a previous boot may be acknowledged beyond tx_next_seq */
+	(void)iaq_store_ack(acked_seq);
+	uplink_stats.reports_delivered += pending - iaq_store_pending();
+
+	/* Reports after the first missing one were sent but not acknowledged */
+	tx_resend = acked_seq + 1 < tx_next_seq;
+	LOG_DBG("Acknowledged up to seq %u, window %08x", acked_seq, acked_window);
+}
+
+/* Whether a pending report goes into the next batch. */
+static bool uplink_should_send(uint32_t seq)
+{
+	uint32_t offset;
+
+	if (tx_next_seq == 0 || seq >= tx_next_seq) {
+		return true;
+	}
+
+	/* Sent already: only resend what the server reported missing */
+	offset = seq - acked_seq - 1;
+	return tx_resend && offset < IAQ_ACK_WINDOW && !(acked_window & BIT(offset));
+}
+#endif
+
+/*
+ * Runs in the OpenThread context with its API lock held: only record the
+ * result, the log is updated from the work queue.
+ */
+static void uplink_response_cb(void *context, otMessage *message,
+			       const otMessageInfo *message_info, otError result)
+{
+	if (result == OT_ERROR_NONE && otCoapMessageGetCode(message) == OT_COAP_CODE_CHANGED) {
+#if defined(CONFIG_IAQ_UPLINK_NON_CONFIRMABLE)
+		uplink_sack_receive(message);
+#endif
+		atomic_set_bit(&uplink_flags, UPLINK_TX_DONE);
+	} else if (result == OT_ERROR_NONE) {
+		/* 5.03 when the server node has no room to forward the batch */
+		LOG_WRN("Batch rejected: %u", otCoapMessageGetCode(message));
+		atomic_set_bit(&uplink_flags, UPLINK_TX_FAILED);
+	} else {
+		LOG_WRN("Delivery not confirmed: %d", result);
+		atomic_set_bit(&uplink_flags, UPLINK_TX_FAILED);
+	}
+
+	k_work_reschedule(&uplink_flush_work, K_NO_WAIT);
+}
+
+#if defined(CONFIG_IAQ_UPLINK_BLOCKWISE)
+static otError uplink_block_tx_hook(void *context, uint8_t *block, uint32_t position,
+				    uint16_t *block_length, bool *more)
+{
+	uint16_t length;
+
+	if (position >= tx_len) {
+		return OT_ERROR_INVALID_ARGS;
+	}
+
+	length = MIN(*block_length, tx_len - position);
+	memcpy(block, &tx_buf[position], length);
+	*block_length = length;
+	*more = (position + length) < tx_len;
+
+	return OT_ERROR_NONE;
+}
+#endif
+
+static otError uplink_send(otInstance *instance, otCoapType type)
+{
+	otError error;
+	otMessage *message;
+	otMessageInfo message_info;
+	const otMeshLocalPrefix *mesh_prefix = otThreadGetMeshLocalPrefix(instance);
+	bool blockwise = false;
+
+#if defined(CONFIG_IAQ_UPLINK_BLOCKWISE)
+	blockwise = type == OT_COAP_TYPE_CONFIRMABLE && tx_len > UPLINK_BLOCK_SIZE;
+#endif
+
+	message = otCoapNewMessage(instance, NULL);
+	if (message == NULL) {
+		LOG_ERR("Failed to allocate CoAP message");
+		return OT_ERROR_NO_BUFS;
+	}
+
+	otCoapMessageInit(message, type, OT_COAP_CODE_PUT);
+	otCoapMessageGenerateToken(message, OT_COAP_DEFAULT_TOKEN_LENGTH);
+
+	do {
+		error = otCoapMessageAppendUriPathOptions(message, UPLINK_URI_PATH);
+		if (error != OT_ERROR_NONE) {
+			break;
+		}
+
+		error = otCoapMessageAppendUintOption(message, OT_COAP_OPTION_CONTENT_FORMAT,
+						      IAQ_BATCH_CONTENT_FORMAT);
+		if (error != OT_ERROR_NONE) {
+			break;
+		}
+
+#if defined(CONFIG_IAQ_UPLINK_BLOCKWISE)
+		if (blockwise) {
+			error = otCoapMessageAppendBlock1Option(message, 0, true, UPLINK_BLOCK_SZX);
+			if (error != OT_ERROR_NONE) {
+				break;
+			}
+		}
+#endif
+
+		error = otCoapMessageSetPayloadMarker(message);
+		if (error != OT_ERROR_NONE) {
+			break;
+		}
+
+		memset(&message_info, 0, sizeof(message_info));
+		memcpy(&message_info.mPeerAddr.mFields.m8[0], mesh_prefix, 8);
+		memcpy(&message_info.mPeerAddr.mFields.m8[8], server_interface_id, 8);
+		message_info.mPeerPort = OT_DEFAULT_COAP_PORT;
+
+#if defined(CONFIG_IAQ_UPLINK_BLOCKWISE)
+		if (blockwise) {
+			/* Payload is pulled block by block through the transmit hook */
+			error = otCoapSendRequestBlockWise(instance, message, &message_info,
+							   uplink_response_cb, NULL,
+							   uplink_block_tx_hook, NULL);
+			break;
+		}
+#endif
+
+		error = otMessageAppend(message, tx_buf, tx_len);
+		if (error != OT_ERROR_NONE) {
+			break;
+		}
+
+		/* A handler would keep a copy of a NON request waiting for a response */
+		error = otCoapSendRequest(instance, message, &message_info,
+					  (type == OT_COAP_TYPE_CONFIRMABLE) ? uplink_response_cb : NULL,
+					  NULL);
+	} while (false);
+
+	if (error != OT_ERROR_NONE) {
+		otMessageFree(message);
+	}
+
+	return error;
+}
+
+/* Add the time a report was taken at, if the node knows the time. */
+static int uplink_stamp_time(struct iaq_report *report, int64_t uptime_ms)
+{
+#if defined(CONFIG_IAQ_TIMESYNC)
+	int64_t epoch_ms;
+
+	if (iaq_timesync_to_epoch(uptime_ms, &epoch_ms) != 0) {
+		return -EAGAIN;
+	}
+
+	return iaq_report_put(report, IAQ_FIELD_TIME,
+			      (int32_t)(uint32_t)(epoch_ms / MSEC_PER_SEC));
+#else
+	return -ENOTSUP;
+#endif
+}
+
+/*
+ * Tag a logged report with its sequence number before sending it, and with
+ * its time, or its age when the node was not synchronized yet. The first
+ * report of a batch also carries the epoch of the log.
+ */
+static void uplink_stamp(struct iaq_store_record *record, bool first)
+{
+	int64_t age = k_uptime_get() - record->uptime_ms;
+
+	/* Reports have room for every field, a full one goes out unstamped */
+	(void)iaq_report_put(&record->report, IAQ_FIELD_SEQUENCE, (int32_t)record->seq);
+	if (first) {
+		(void)iaq_report_put(&record->report, IAQ_FIELD_EPOCH,
+				     (int32_t)iaq_store_epoch());
+	}
+
+	/* Uptime of a previous boot says nothing about the time or the age */
+	if (record->boot != iaq_store_boot() ||
+	    iaq_report_get(&record->report, IAQ_FIELD_TIME, NULL) == 0) {
+		return;
+	}
+
+	if (uplink_stamp_time(&record->report, record->uptime_ms) != 0 && age <= INT32_MAX) {
+		(void)iaq_report_put(&record->report, IAQ_FIELD_AGE, (int32_t)age);
+	}
+}
+
+/* Fill tx_buf with the oldest pending reports. */
+static void uplink_fill_locked(void)
+{
+	struct iaq_store_iter iter;
+	struct iaq_store_record record;
+
+	tx_len = 0;
+	tx_reports = 0;
+
+	iaq_store_iter_init(&iter);
+	while (iaq_store_iter_next(&iter, &record) == 0) {
+#if defined(CONFIG_IAQ_UPLINK_NON_CONFIRMABLE)
+		if (!uplink_should_send(record.seq)) {
+			continue;
+		}
+#endif
+		uplink_stamp(&record, tx_reports == 0);
+		if (tx_len + 1 + record.report.len > sizeof(tx_buf)) {
+			break;
+		}
+
+		tx_buf[tx_len++] = record.report.len;
+		memcpy(&tx_buf[tx_len], record.report.buf, record.report.len);
+		tx_len += record.report.len;
+		tx_reports++;
+		tx_last_seq = record.seq;
+	}
+}
+
+/* Must be called with uplink_lock held. */
+static int uplink_flush_locked(void)
+{
+	struct openthread_context *ot_context = openthread_get_default_context();
+	otCoapType type = OT_COAP_TYPE_CONFIRMABLE;
+	otError error;
+
+	if (atomic_test_bit(&uplink_flags, UPLINK_TX_BUSY)) {
+		/* Pending reports go out with the next batch */
+		return -EBUSY;
+	}
+
+	uplink_fill_locked();
+	queued_reports = 0;
+	queued_windows = 0;
+	if (tx_reports == 0) {
+		return 0;
+	}
+
+#if defined(CONFIG_IAQ_UPLINK_NON_CONFIRMABLE)
+	/* A resend after a failure must be confirmed, nothing is known then */
+	if (tx_next_seq > 0 && ++tx_batches < CONFIG_IAQ_UPLINK_CONFIRM_EVERY) {
+		type = OT_COAP_TYPE_NON_CONFIRMABLE;
+	} else {
+		tx_batches = 0;
+	}
+#endif
+
+	atomic_set_bit(&uplink_flags, UPLINK_TX_BUSY);
+	k_work_cancel_delayable(&uplink_flush_work);
+
+	openthread_api_mutex_lock(ot_context);
+	error = uplink_send(ot_context->instance, type);
+	openthread_api_mutex_unlock(ot_context);
+
+	if (error != OT_ERROR_NONE) {
+		atomic_clear_bit(&uplink_flags, UPLINK_TX_BUSY);
+		uplink_stats.delivery_failed++;
+		LOG_ERR("Failed to send CoAP request: %d", error);
+		k_work_reschedule(&uplink_flush_work, K_SECONDS(CONFIG_IAQ_UPLINK_RETRY_INTERVAL));
+		return -EIO;
+	}
+
+	uplink_stats.batches_sent++;
+	uplink_stats.reports_sent += tx_reports;
+	LOG_INF("Sent %s batch of %u reports (%u bytes)",
+		(type == OT_COAP_TYPE_CONFIRMABLE) ? "CON" : "NON", tx_reports, tx_len);
+
+#if defined(CONFIG_IAQ_UPLINK_NON_CONFIRMABLE)
+	tx_next_seq = MAX(tx_next_seq, tx_last_seq + 1);
+	tx_resend = false;
+	if (type == OT_COAP_TYPE_NON_CONFIRMABLE) {
+		/* Nothing to wait for, the server reports gaps on its own */
+		atomic_clear_bit(&uplink_flags, UPLINK_TX_BUSY);
+	}
+#endif
+
+	return 0;
+}
+
+/* Must be called with uplink_lock held. */
+static void uplink_drain_locked(void)
+{
+	/* Keep draining a backlog, fresh reports wait for their windows */
+	if (iaq_store_pending() > queued_reports) {
+		(void)uplink_flush_locked();
+	} else if (queued_reports > 0) {
+		/* The response replaced their latency deadline */
+		k_work_schedule(&uplink_flush_work, K_SECONDS(CONFIG_IAQ_UPLINK_BATCH_MAX_LATENCY));
+	}
+}
+
+static void uplink_flush_work_handler(struct k_work *work)
+{
+	k_mutex_lock(&uplink_lock, K_FOREVER);
+
+#if defined(CONFIG_IAQ_UPLINK_NON_CONFIRMABLE)
+	bool sack = atomic_test_and_clear_bit(&uplink_flags, UPLINK_SACK);
+
+	if (sack) {
+		uplink_sack_apply_locked();
+	}
+#endif
+
+	if (atomic_test_and_clear_bit(&uplink_flags, UPLINK_TX_DONE)) {
+#if !defined(CONFIG_IAQ_UPLINK_NON_CONFIRMABLE)
+		(void)iaq_store_ack(tx_last_seq);
+		uplink_stats.reports_delivered += tx_reports;
+		LOG_DBG("Delivery confirmed up to seq %u", tx_last_seq);
+#endif
+		atomic_clear_bit(&uplink_flags, UPLINK_TX_BUSY);
+		uplink_drain_locked();
+	} else if (atomic_test_and_clear_bit(&uplink_flags, UPLINK_TX_FAILED)) {
+		uplink_stats.delivery_failed++;
+		atomic_clear_bit(&uplink_flags, UPLINK_TX_BUSY);
+#if defined(CONFIG_IAQ_UPLINK_NON_CONFIRMABLE)
+		/* Nothing is known about what arrived, start over from the oldest */
+		tx_next_seq = 0;
+#endif
+		/* Reports stay pending in the log until the retry */
+		k_work_schedule(&uplink_flush_work, K_SECONDS(CONFIG_IAQ_UPLINK_RETRY_INTERVAL));
+#if defined(CONFIG_IAQ_UPLINK_NON_CONFIRMABLE)
+	} else if (sack) {
+		/* Gap report between batches, resend what is missing */
+		if (tx_resend) {
+			(void)uplink_flush_locked();
+		} else if (queued_reports > 0) {
+			/* The report replaced their latency deadline */
+			k_work_schedule(&uplink_flush_work,
+					K_SECONDS(CONFIG_IAQ_UPLINK_BATCH_MAX_LATENCY));
+		}
+#endif
+	} else {
+		/* Latency deadline, retry or replay of a previous boot */
+		(void)uplink_flush_locked();
+	}
+
+	k_mutex_unlock(&uplink_lock);
+}
+
+int iaq_uplink_init(void)
+{
+	otInstance *instance = openthread_get_default_instance();
+	otError error;
+	int ret;
+
+	ret = iaq_store_init();
+	if (ret != 0) {
+		return ret;
+	}
+
+	error = otCoapStart(instance, OT_DEFAULT_COAP_PORT);
+	if (error != OT_ERROR_NONE) {
+		LOG_ERR("Failed to start Coap: %d", error);
+		return -EIO;
+	}
+
+	LOG_INF("Coap started successfully.");
+
+#if defined(CONFIG_IAQ_UPLINK_NON_CONFIRMABLE)
+	otCoapAddResource(instance, &uplink_ack_resource);
+#endif
+
+	/* Replay what a previous boot left behind once the node has attached */
+	if (iaq_store_pending() > 0) {
+		k_work_schedule(&uplink_flush_work, K_SECONDS(CONFIG_IAQ_UPLINK_RETRY_INTERVAL));
+	}
+
+	return 0;
+}
+
+int iaq_uplink_queue(const struct iaq_report *report)
+{
+	struct iaq_report stamped = *report;
+	int ret;
+
+	/* Logged with the report, the time survives a reboot before it is sent */
+	(void)uplink_stamp_time(&stamped, k_uptime_get());
+
+	k_mutex_lock(&uplink_lock, K_FOREVER);
+
+	ret = iaq_store_append(&stamped, NULL);
+	if (ret != 0) {
+		uplink_stats.reports_dropped++;
+	} else if (queued_reports++ == 0) {
+		/* No-op if a retry or the replay is already scheduled earlier */
+		k_work_schedule(&uplink_flush_work, K_SECONDS(CONFIG_IAQ_UPLINK_BATCH_MAX_LATENCY));
+	}
+
+	k_mutex_unlock(&uplink_lock);
+
+	return ret;
+}
+
+void iaq_uplink_commit(void)
+{
+	k_mutex_lock(&uplink_lock, K_FOREVER);
+
+	if (queued_reports > 0 && ++queued_windows >= batch_windows) {
+		(void)uplink_flush_locked();
+	}
+
+	k_mutex_unlock(&uplink_lock);
+}
+
+void iaq_uplink_set_batch_windows(uint8_t windows)
+{
+	k_mutex_lock(&uplink_lock, K_FOREVER);
+	batch_windows = MAX(windows, 1);
+	k_mutex_unlock(&uplink_lock);
+}
+
+int iaq_uplink_flush(void)
+{
+	int ret;
+
+	k_mutex_lock(&uplink_lock, K_FOREVER);
+	ret = uplink_flush_locked();
+	k_mutex_unlock(&uplink_lock);
+
+	return ret;
+}
+
+void iaq_uplink_stats_get(struct iaq_uplink_stats *stats)
+{
+	k_mutex_lock(&uplink_lock, K_FOREVER);
+	*stats = uplink_stats;
+	k_mutex_unlock(&uplink_lock);
+}
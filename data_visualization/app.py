@@ -1,151 +1,305 @@
-from flask import Flask, render_template, jsonify, request
-import pandas as pd
+from flask import Flask, Response, render_template, jsonify, request, send_file
 import json
 from datetime import datetime, timedelta
 import os
-import numpy as np
 import serial
 import threading
 import time
+import io
+import queue
+import struct
 from collections import deque
-from openpyxl import Workbook, load_workbook
+from iaq_report import decode_report
+from iaq_config import decode_config, encode_config
+from serial_frames import (FrameDecoder, FRAME_REPORT, FRAME_TEXT, FRAME_LINK, FRAME_RECORD,
+                           FRAME_CONFIG, decode_link, decode_record, encode_node_config,
+                           encode_time)
+from nodes import NodeTable, RxClock
+from sensor_store import SensorStore
+from rollups import Rollups, RESOLUTIONS
+from streaming_stats import StreamingStats, WINDOWS
+from push import Broadcaster
 
 app = Flask(__name__)
 
 # Configuration
-EXCEL_FILE = 'new_sensor_data.xlsx'
+STORE_DIR = 'sensor_store'
 HISTORICAL_DATA_FILE = 'sensor_data.xlsx'
 PORT = '/dev/tty.usbserial-AQ03LYY2' 
 BAUDRATE = 115200
+# How often the server node gets the time it serves to the nodes
+TIME_SYNC_SECONDS = 60
+# Node id (interface identifier, hex) -> room it is installed in
+NODE_NAMES = {}
 
 # Global variables for real-time data
 current_sensor_data = {
     'co2': '-', 'tvoc': '-', 'eco2': '-',
     'pm1': '-', 'pm25': '-', 'pm10': '-',
     'temperature': '-', 'humidity': '-',
+    'pm4': '-',
+    # SPS30 number concentrations and typical particle size
+    'particles': {},
     'timestamp': None,
     'last_update': None,
     'last_update_co2': None,
     'last_update_pm': None,
     'connection_status': 'Disconnected'
 }
+# Sensor -> time of the sample shown in current_sensor_data
+current_sample_times = {}
+
+# Per-node values and delivery counters; current_sensor_data above holds
+# the newest value of each metric from any node
+nodes = NodeTable(NODE_NAMES)
+rx_clock = RxClock()
 
 # Thread-safe data storage
 data_lock = threading.Lock()
+broadcaster = Broadcaster()
 serial_connection = None
 serial_thread = None
+frame_thread = None
+# (arrival time, frame type, payload) from the serial reader to the frame worker
+frame_queue = queue.SimpleQueue()
+# Encoded frames for the server node, written by the serial reader
+serial_tx_queue = queue.SimpleQueue()
+
+# Sensor-specific fields: report key -> Excel column header. New keys go at
+# the end, stored segments map their columns by position.
+SENSOR_FIELDS = {
+    'scd41': [('CO2', 'CO2 (ppm)'), ('Temperature', 'Temperature (°C)'), ('Humidity', 'Humidity (%)')],
+    'ccs811': [('eCO2', 'eCO2 (ppm)'), ('TVOC', 'TVOC (ppb)')],
+    'sps30': [('PM1.0', 'PM1.0 (µg/m³)'), ('PM2.5', 'PM2.5 (µg/m³)'), ('PM10.0', 'PM10.0 (µg/m³)'),
+              ('PM4.0', 'PM4.0 (µg/m³)'),
+              ('NC0.5', 'NC0.5 (#/cm³)'), ('NC1.0', 'NC1.0 (#/cm³)'), ('NC2.5', 'NC2.5 (#/cm³)'),
+              ('NC4.0', 'NC4.0 (#/cm³)'), ('NC10.0', 'NC10.0 (#/cm³)'),
+              ('TypicalParticleSize', 'Typical Particle Size (µm)')]
+}
 
-# Sensor-specific headers for Excel
-SENSOR_HEADERS = {
-    'scd41': ['Timestamp', 'CO2 (ppm)', 'Temperature (°C)', 'Humidity (%)'],
-    'ccs811': ['Timestamp', 'eCO2 (ppm)', 'TVOC (ppb)'],
-    'sps30': ['Timestamp', 'PM1.0 (µg/m³)', 'PM2.5 (µg/m³)', 'PM10.0 (µg/m³)']
+# Report key -> metric name used by the API
+METRICS = {
+    'CO2': 'co2', 'TVOC': 'tvoc', 'eCO2': 'eco2',
+    'PM1.0': 'pm1', 'PM2.5': 'pm25', 'PM10.0': 'pm10',
+    'Temperature': 'temperature', 'Humidity': 'humidity',
+    'PM4.0': 'pm4',
+    'NC0.5': 'nc0_5', 'NC1.0': 'nc1', 'NC2.5': 'nc2_5', 'NC4.0': 'nc4', 'NC10.0': 'nc10',
+    'TypicalParticleSize': 'particle_size'
 }
 
-def initialize_excel_file():
-    """Initialize Excel file with proper sheets if it doesn't exist"""
-    if not os.path.exists(EXCEL_FILE):
-        wb = Workbook()
-        for idx, (sensor, headers) in enumerate(SENSOR_HEADERS.items()):
-            if idx == 0:
-                ws = wb.active
-                ws.title = sensor.upper()
-            else:
-                ws = wb.create_sheet(title=sensor.upper())
-            ws.append(headers)
-        wb.save(EXCEL_FILE)
-        print(f"Created new Excel file: {EXCEL_FILE}")
+# Metric -> (low, high) limits counted by the insights, unit and decimals shown
+INSIGHTS = {
+    'co2': ((None, 1000), 'ppm', 0),
+    'pm1': ((None, 25), 'µg/m³', 1),
+    'pm25': ((None, 35), 'µg/m³', 1),
+    'pm10': ((None, 100), 'µg/m³', 1),
+    'tvoc': ((None, 500), 'ppb', 0),
+    'temperature': ((16, 28), '°C', 1),
+    'humidity': ((25, 70), '%', 1)
+}
 
-def append_to_sensor_sheet(sensor_name, values):
-    """Append sensor data to the appropriate Excel sheet - using exact logic from read_serial.py"""
+sensor_store = SensorStore(STORE_DIR, SENSOR_FIELDS)
+# Node id -> SensorStore of that node alone, opened on its first sample
+node_stores = {}
+node_stores_lock = threading.Lock()
+rollups = Rollups()
+stats = StreamingStats({metric: limits for metric, (limits, _, _) in INSIGHTS.items()})
+
+def update_aggregates(ts, values):
+    """Fold one sample into the rollups and the streaming statistics"""
+    metrics = {METRICS[key]: values.get(key) for key in values if key in METRICS}
+    rollups.add(ts, metrics)
+    stats.add(ts, metrics)
+
+def node_store(node):
+    """Return the store of one node, None for samples of an unknown node"""
+    if node is None:
+        return None
+    with node_stores_lock:
+        store = node_stores.get(node)
+        if store is None:
+            store = node_stores[node] = SensorStore(
+                os.path.join(STORE_DIR, 'nodes', node), SENSOR_FIELDS)
+        return store
+
+def store_sample(sensor_name, values, sample_time=None, node=None):
+    """Append sensor data to the store; constant cost however much history exists"""
+    sample_time = sample_time or datetime.now()
     try:
-        wb = load_workbook(EXCEL_FILE)
-        sheet_name = sensor_name.upper()
-
-        if sheet_name not in wb.sheetnames:
-            print(f"[WARN] Sheet {sheet_name} missing!")
-            return
-
-        ws = wb[sheet_name]
-        timestamp = datetime.now().strftime("%Y-%m-%d %H:%M:%S")
-
-        if sensor_name == 'scd41':
-            row = [timestamp, values.get('CO2'), values.get('Temperature'), values.get('Humidity')]
-        elif sensor_name == 'ccs811':
-            row = [timestamp, values.get('eCO2'), values.get('TVOC')]
-        elif sensor_name == 'sps30':
-            row = [timestamp, values.get('PM1.0'), values.get('PM2.5'), values.get('PM10.0')]
-        else:
-            print(f"[SKIP] Unknown sensor: {sensor_name}")
-            return
-
-        ws.append(row)
-        wb.save(EXCEL_FILE)
-            
-    except Exception as e:
-        print(f"Error saving to Excel: {e}")
-
-def update_current_data(sensor_name, values):
-    """Update the global current sensor data"""
+        sensor_store.append(sensor_name, values, sample_time)
+        store = node_store(node)
+        if store is not None:
+            store.append(sensor_name, values, sample_time)
+    except KeyError:
+        print(f"[SKIP] Unknown sensor: {sensor_name}")
+        return
+    except OSError as e:
+        print(f"Error saving sample: {e}")
+    update_aggregates(sample_time.timestamp(), values)
+
+def load_history():
+    """Import the legacy workbook into an empty store, then seed the rollups once"""
+    if sensor_store.is_empty() and os.path.exists(HISTORICAL_DATA_FILE):
+        count = sensor_store.import_xlsx(HISTORICAL_DATA_FILE)
+        print(f"Imported {count} samples from {HISTORICAL_DATA_FILE}")
+
+    for sensor, fields in SENSOR_FIELDS.items():
+        keys = [key for key, _ in fields]
+        for ts, row in sensor_store.read(sensor):
+            update_aggregates(ts, dict(zip(keys, row)))
+
+def update_current_data(sensor_name, values, sample_time):
+    """Show a sample unless a newer one of the sensor is already shown"""
     global current_sensor_data
+    # The sensor values carry the time they were measured, last_update
+    # when the link last delivered anything
+    sample_str = sample_time.strftime("%H:%M:%S")
     now_str = datetime.now().strftime("%H:%M:%S")
     with data_lock:
+        # Reports replayed from a node's log after an outage are older
+        shown = current_sample_times.get(sensor_name)
+        if shown is not None and sample_time < shown:
+            return
+        current_sample_times[sensor_name] = sample_time
         if sensor_name == 'scd41':
             current_sensor_data['co2'] = values.get('CO2', '-')
             current_sensor_data['temperature'] = values.get('Temperature', '-')
             current_sensor_data['humidity'] = values.get('Humidity', '-')
-            current_sensor_data['last_update_co2'] = now_str
+            current_sensor_data['last_update_co2'] = sample_str
         elif sensor_name == 'ccs811':
             current_sensor_data['eco2'] = values.get('eCO2', '-')
             current_sensor_data['tvoc'] = values.get('TVOC', '-')
-            current_sensor_data['last_update_co2'] = now_str
+            current_sensor_data['last_update_co2'] = sample_str
         elif sensor_name == 'sps30':
             current_sensor_data['pm1'] = values.get('PM1.0', '-')
             current_sensor_data['pm25'] = values.get('PM2.5', '-')
             current_sensor_data['pm10'] = values.get('PM10.0', '-')
-            current_sensor_data['last_update_pm'] = now_str
-        current_sensor_data['timestamp'] = datetime.now().isoformat()
+            current_sensor_data['pm4'] = values.get('PM4.0', '-')
+            current_sensor_data['particles'] = {
+                METRICS[key]: values[key]
+                for key in ('NC0.5', 'NC1.0', 'NC2.5', 'NC4.0', 'NC10.0', 'TypicalParticleSize')
+                if key in values
+            }
+            current_sensor_data['last_update_pm'] = sample_str
+        # Newest sample of any sensor
+        current_sensor_data['timestamp'] = max(current_sample_times.values()).isoformat()
         current_sensor_data['last_update'] = now_str
         current_sensor_data['connection_status'] = 'Connected'
+    publish_current_data()
+
+def publish_current_data():
+    """Push the dashboard snapshot to every stream subscriber, serialized once"""
+    broadcaster.publish(json.dumps(build_current_data()))
+
+def update_link_stats(received, link):
+    """Keep the latest node table entry of a node and report new losses"""
+    node = link.pop('node')
+    previous = nodes.update_link(node, received, link)
+    if link['gaps'] > previous.get('gaps', 0):
+        print(f"[GAP] Node {node}: {link['missing']} reports missing after seq {link['seq']}")
+    if link['lost'] > previous.get('lost', 0):
+        print(f"[LOST] Node {node}: {link['lost']} reports lost so far")
+
+def handle_frame(received, frame_type, payload):
+    """Decode one frame and feed the dashboard and the sample store"""
+    node = None
+    try:
+        if frame_type == FRAME_RECORD:
+            node, rx_ms, rss, frame_type, payload = decode_record(payload)
+            # Time of reception on the server node, not of the UART arrival
+            received = rx_clock.to_wall(received, rx_ms)
+            # Records without RSS come from the server node, not from the node
+            if rss is not None:
+                nodes.record(node, received, rss)
+
+        if frame_type == FRAME_LINK:
+            update_link_stats(received, decode_link(payload))
+            return
+        elif frame_type == FRAME_CONFIG:
+            if node is not None:
+                nodes.update_config(node, decode_config(payload))
+                print(f"[CONFIG] Node {node} parameters updated")
+            return
+        elif frame_type == FRAME_REPORT:
+            data = decode_report(payload)
+        elif frame_type == FRAME_TEXT:
+            data = json.loads(payload.decode('utf-8'))
+        else:
+            print(f"[SKIP] Unknown frame type {frame_type}")
+            return
+
+        if "sensor" in data and "data" in data:
+            sensor = data["sensor"]
+            values = data["data"]
+
+            # Synchronized nodes stamp their reports, others only their age
+            sample_time = received
+            if "time" in data:
+                sample_time = datetime.fromtimestamp(data["time"])
+            elif "age" in data:
+                sample_time = received - timedelta(seconds=data["age"])
+
+            # Update current data for dashboard
+            update_current_data(sensor, values, sample_time)
+            if node is not None:
+                nodes.update_sensor(node, sensor, values, sample_time)
+
+            # Save to the sample store
+            store_sample(sensor, values, sample_time, node)
+
+            print(f"[{datetime.now()}] Logged data for {sensor.upper()}"
+                  + (f" from node {node}" if node else ""))
+        elif "config_error" in data and node is not None:
+            nodes.config_failed(node, data["config_error"])
+            print(f"[CONFIG] Node {node} parameters not changed: {data['config_error']}")
+        elif "error" in data:
+            print(f"[ERROR] {data['error']}")
+
+    except (json.JSONDecodeError, UnicodeDecodeError):
+        print(f"[INVALID JSON] {payload!r}")
+    except ValueError as e:
+        print(f"[INVALID REPORT] {payload.hex()} ({e})")
+
+def frame_worker():
+    """Consumes decoded frames so storage never stalls the serial reader"""
+    while True:
+        handle_frame(*frame_queue.get())
 
 def serial_reader():
-    """Background thread to continuously read from serial port - using exact logic from read_serial.py"""
+    """Background thread reading CRC-framed records from the server node"""
     global serial_connection, current_sensor_data
     
     try:
-        # Start Serial - exactly like read_serial.py
         ser = serial.Serial(PORT, BAUDRATE, timeout=2)
         print(f"Reading from {PORT}...")
         
         with data_lock:
             current_sensor_data['connection_status'] = 'Connected'
-        
-        # Main Loop - exactly like read_serial.py
+
+        decoder = FrameDecoder()
+        crc_errors = 0
+        time_sent = 0
         while True:
             try:
-                line = ser.readline().decode('utf-8').strip()
-                if not line:
+                # The read below times out, so this runs even when nothing arrives
+                if time.monotonic() - time_sent >= TIME_SYNC_SECONDS:
+                    ser.write(encode_time(int(time.time() * 1000)))
+                    time_sent = time.monotonic()
+                while not serial_tx_queue.empty():
+                    ser.write(serial_tx_queue.get())
+
+                # Whatever arrived, at least one byte; partial frames wait in the decoder
+                chunk = ser.read(ser.in_waiting or 1)
+                if not chunk:
                     continue
 
-                try:
-                    data = json.loads(line)
-
-                    if "sensor" in data and "data" in data:
-                        sensor = data["sensor"]
-                        values = data["data"]
-                        
-                        # Update current data for dashboard
-                        update_current_data(sensor, values)
-                        
-                        # Save to Excel
-                        append_to_sensor_sheet(sensor, values)
-                        
-                        print(f"[{datetime.now()}] Logged data for {sensor.upper()}")
-                    elif "error" in data:
-                        print(f"[ERROR] {data['error']}")
-
-                except json.JSONDecodeError:
-                    print(f"[INVALID JSON] {line}")
+                received = datetime.now()
+                for frame_type, payload in decoder.feed(chunk):
+                    frame_queue.put((received, frame_type, payload))
+
+                if decoder.crc_errors != crc_errors:
+                    crc_errors = decoder.crc_errors
+                    print(f"[CRC ERROR] {crc_errors} corrupt frames so far, resynchronized")
 
             except KeyboardInterrupt:
                 print("Exiting...")
@@ -155,10 +309,14 @@ def serial_reader():
         print(f"Serial connection error: {e}")
         with data_lock:
             current_sensor_data['connection_status'] = 'Disconnected'
+        publish_current_data()
 
 def start_serial_thread():
-    """Start the serial reading thread"""
-    global serial_thread
+    """Start the serial reading and frame handling threads"""
+    global serial_thread, frame_thread
+    if frame_thread is None or not frame_thread.is_alive():
+        frame_thread = threading.Thread(target=frame_worker, daemon=True)
+        frame_thread.start()
     if serial_thread is None or not serial_thread.is_alive():
         serial_thread = threading.Thread(target=serial_reader, daemon=True)
         serial_thread.start()
@@ -408,8 +566,8 @@ def get_detailed_recommendations():
 def index():
     return render_template('index.html')
 
-@app.route('/api/current-data')
-def get_current_data():
+def build_current_data():
+    """Snapshot of the real-time values with their status and recommendations"""
     global current_sensor_data
     with data_lock:
         data = current_sensor_data.copy()
@@ -425,6 +583,8 @@ def get_current_data():
         'pm1': data['pm1'],
         'pm25': data['pm25'],
         'pm10': data['pm10'],
+        'pm4': data['pm4'],
+        'particles': data['particles'],
         'temperature': data['temperature'],
         'humidity': data['humidity'],
         'timestamp': data['timestamp'],
@@ -435,272 +595,156 @@ def get_current_data():
         'air_quality_status': air_quality_status,
         'recommendations': recommendations
     }
-    return jsonify(response_data)
+    return response_data
+
+@app.route('/api/current-data')
+def get_current_data():
+    return jsonify(build_current_data())
+
+@app.route('/api/stream')
+def stream_current_data():
+    """Server-Sent Events: one message per update, slow clients skip stale ones"""
+    initial = json.dumps(build_current_data())
+    return Response(broadcaster.stream(initial), mimetype='text/event-stream',
+                    headers={'Cache-Control': 'no-cache', 'X-Accel-Buffering': 'no'})
+
+@app.route('/api/link-stats')
+def get_link_stats():
+    """Report delivery per node, as counted by the server node"""
+    return jsonify({node: state['link'] for node, state in nodes.snapshot().items()})
+
+@app.route('/api/nodes')
+def get_nodes():
+    """Every node heard so far with its latest values and link state"""
+    return jsonify(nodes.snapshot())
+
+@app.route('/api/nodes/<node>')
+def get_node(node):
+    state = nodes.get(node)
+    if state is None:
+        return jsonify({'error': f"Unknown node {node}"}), 404
+    return jsonify(state)
+
+@app.route('/api/nodes/<node>/config', methods=['GET', 'PUT'])
+def node_config(node):
+    """Runtime parameters of a node; a PUT changes some of them
+
+    The node answers the change through the server node, the new values
+    show up here once it notified them. A change that did not reach the
+    node shows up as 'config_error' of GET /api/nodes/<node> instead.
+    """
+    state = nodes.get(node)
+    if state is None:
+        return jsonify({'error': f"Unknown node {node}"}), 404
+    if request.method == 'GET':
+        return jsonify(state['config'])
+
+    changes = request.get_json(silent=True)
+    if not isinstance(changes, dict):
+        return jsonify({'error': 'Expected an object of parameter values'}), 400
+    try:
+        payload = encode_config(changes)
+    except KeyError as e:
+        return jsonify({'error': f"Unknown parameter {e.args[0]}"}), 400
+    except (ValueError, TypeError, struct.error) as e:
+        return jsonify({'error': str(e)}), 400
+    serial_tx_queue.put(encode_node_config(node, payload))
+    return jsonify({'status': 'sent'}), 202
+
+@app.route('/api/nodes/<node>/export')
+def export_node_data(node):
+    """Download the stored samples of one node as an Excel workbook"""
+    if nodes.get(node) is None:
+        return jsonify({'error': f"Unknown node {node}"}), 404
+    out = io.BytesIO()
+    node_store(node).export_xlsx(out)
+    out.seek(0)
+    name = datetime.now().strftime(f'sensor_data_{node}_%Y%m%d_%H%M%S.xlsx')
+    return send_file(out, as_attachment=True, download_name=name,
+                     mimetype='application/vnd.openxmlformats-officedocument.spreadsheetml.sheet')
+
+@app.route('/api/export')
+def export_data():
+    """Download every stored sample as an Excel workbook"""
+    out = io.BytesIO()
+    sensor_store.export_xlsx(out)
+    out.seek(0)
+    name = datetime.now().strftime('sensor_data_%Y%m%d_%H%M%S.xlsx')
+    return send_file(out, as_attachment=True, download_name=name,
+                     mimetype='application/vnd.openxmlformats-officedocument.spreadsheetml.sheet')
 
 @app.route('/api/historical-data')
 def get_historical_data():
-    try:
-        # Always use HISTORICAL_DATA_FILE for analysis
-        file_to_use = HISTORICAL_DATA_FILE
-        # Read from Excel file for historical data
-        scd41_df = pd.read_excel(file_to_use, sheet_name='SCD41')
-        ccs811_df = pd.read_excel(file_to_use, sheet_name='CCS811') 
-        sps30_df = pd.read_excel(file_to_use, sheet_name='SPS30')
-
-        scd41_df['Timestamp'] = pd.to_datetime(scd41_df['Timestamp'])
-        ccs811_df['Timestamp'] = pd.to_datetime(ccs811_df['Timestamp'])
-        sps30_df['Timestamp'] = pd.to_datetime(sps30_df['Timestamp'])
-
-        combined_df = scd41_df.merge(ccs811_df, on='Timestamp', how='outer', suffixes=('', '_ccs'))
-        combined_df = combined_df.merge(sps30_df, on='Timestamp', how='outer', suffixes=('', '_sps'))
-
-        combined_df = combined_df.sort_values('Timestamp')
-        combined_df = combined_df.fillna(method='ffill')
-
-        if combined_df.empty:
-            return jsonify({'error': 'No data available'})
-
-        # Use all available data (no 24-hour cutoff)
-        recent_data = combined_df.copy()
-
-        if recent_data.empty:
-            return jsonify({'error': 'No data available'})
-
-        recent_data.set_index('Timestamp', inplace=True)
-        hourly_data = recent_data.resample('1h').mean()
-
-        result = {
-            'timestamps': [ts.strftime('%H:%M') for ts in hourly_data.index],
-            'co2': hourly_data['CO2 (ppm)'].fillna(0).tolist(),
-            'tvoc': hourly_data['TVOC (ppb)'].fillna(0).tolist(),
-            'eco2': hourly_data['eCO2 (ppm)'].fillna(0).tolist(),
-            'pm1': hourly_data['PM1.0 (µg/m³)'].fillna(0).tolist(),
-            'pm25': hourly_data['PM2.5 (µg/m³)'].fillna(0).tolist(),
-            'pm10': hourly_data['PM10.0 (µg/m³)'].fillna(0).tolist(),
-            'temperature': hourly_data['Temperature (°C)'].fillna(0).tolist(),
-            'humidity': hourly_data['Humidity (%)'].fillna(0).tolist()
-        }
+    """Serve precomputed buckets; cost depends on the retention, not the history"""
+    resolution = request.args.get('resolution', '1h')
+    if resolution not in RESOLUTIONS:
+        return jsonify({'error': f"Unknown resolution {resolution}"}), 400
 
-        return jsonify(result)
-        
-    except Exception as e:
-        print(f"Error reading historical data: {e}")
+    buckets = rollups.series(resolution)
+    if not buckets:
         return jsonify({'error': 'No data available'})
 
+    width = RESOLUTIONS[resolution][0]
+    time_format = '%Y-%m-%d' if resolution == '1d' else '%H:%M'
+    by_start = dict(buckets)
+    result = {'timestamps': []}
+    result.update({metric: [] for metric in METRICS.values()})
+    last = {}
+
+    for start in range(buckets[0][0], buckets[-1][0] + width, width):
+        means = by_start.get(start)
+        result['timestamps'].append(datetime.fromtimestamp(start).strftime(time_format))
+        for metric in METRICS.values():
+            if means is None:
+                # No sample at all in this bucket, null leaves a gap in the chart
+                value = None
+            elif metric in means:
+                value = last[metric] = round(means[metric], 2)
+            else:
+                # Other sensors reported, carry this metric forward
+                value = last.get(metric)
+            result[metric].append(value)
+
+    return jsonify(result)
+
 @app.route('/api/insights')
 def get_insights():
-    try:
-        # Always use HISTORICAL_DATA_FILE for analysis
-        file_to_use = HISTORICAL_DATA_FILE
-        # Read from Excel file for insights
-        scd41_df = pd.read_excel(file_to_use, sheet_name='SCD41')
-        ccs811_df = pd.read_excel(file_to_use, sheet_name='CCS811') 
-        sps30_df = pd.read_excel(file_to_use, sheet_name='SPS30')
-
-        scd41_df['Timestamp'] = pd.to_datetime(scd41_df['Timestamp'])
-        ccs811_df['Timestamp'] = pd.to_datetime(ccs811_df['Timestamp'])
-        sps30_df['Timestamp'] = pd.to_datetime(sps30_df['Timestamp'])
-
-        combined_df = scd41_df.merge(ccs811_df, on='Timestamp', how='outer', suffixes=('', '_ccs'))
-        combined_df = combined_df.merge(sps30_df, on='Timestamp', how='outer', suffixes=('', '_sps'))
-
-        combined_df = combined_df.sort_values('Timestamp')
-        combined_df = combined_df.fillna(method='ffill')
-
-        if combined_df.empty:
-            return jsonify({'error': 'No data available'})
-
-        # Use all available data (no 24-hour cutoff)
-        recent_data = combined_df.copy()
-
-        if recent_data.empty:
-            return jsonify({'error': 'No data available'})
-
-        insights = {}
-        # Helper to check if column exists and has data
-        def valid_col(col):
-            return col in recent_data.columns and recent_data[col].dropna().shape[0] > 0
-
-        # Helper to get time string from index or column
-        def get_time_str(df, idx):
-            # idx is the index of the row (could be int or datetime)
-            if isinstance(df.index, pd.DatetimeIndex):
-                try:
-                    return df.index[idx].strftime('%H:%M')
-                except Exception:
-                    return str(df.index[idx])
-            # fallback: try Timestamp column
-            ts = df.iloc[idx]['Timestamp'] if 'Timestamp' in df.columns else None
-            if pd.notnull(ts):
-                try:
-                    return pd.to_datetime(ts).strftime('%H:%M')
-                except Exception:
-                    return str(ts)
-            return str(idx)
-
-        # CO2
-        if valid_col('CO2 (ppm)'):
-            co2_data = recent_data['CO2 (ppm)'].dropna()
-            co2_max = co2_data.max()
-            co2_min = co2_data.min()
-            co2_avg = co2_data.mean()
-            max_idx = co2_data.idxmax()
-            min_idx = co2_data.idxmin()
-            co2_max_time = get_time_str(recent_data, max_idx)
-            co2_min_time = get_time_str(recent_data, min_idx)
-            co2_threshold = 1000
-            co2_threshold_exceeded = (co2_data > co2_threshold).sum()
-            insights['co2'] = {
-                'max': f"{co2_max:.0f} ppm",
-                'max_time': co2_max_time,
-                'min': f"{co2_min:.0f} ppm",
-                'min_time': co2_min_time,
-                'avg': f"{co2_avg:.0f} ppm",
-                'threshold': co2_threshold,
-                'threshold_exceeded': int(co2_threshold_exceeded)
-            }
-        # PM1.0
-        if valid_col('PM1.0 (µg/m³)'):
-            pm1_data = recent_data['PM1.0 (µg/m³)'].dropna()
-            pm1_max = pm1_data.max()
-            pm1_min = pm1_data.min()
-            pm1_avg = pm1_data.mean()
-            max_idx = pm1_data.idxmax()
-            min_idx = pm1_data.idxmin()
-            pm1_max_time = get_time_str(recent_data, max_idx)
-            pm1_min_time = get_time_str(recent_data, min_idx)
-            pm1_threshold = 25
-            pm1_threshold_exceeded = (pm1_data > pm1_threshold).sum()
-            insights['pm1'] = {
-                'max': f"{pm1_max:.1f} µg/m³",
-                'max_time': pm1_max_time,
-                'min': f"{pm1_min:.1f} µg/m³",
-                'min_time': pm1_min_time,
-                'avg': f"{pm1_avg:.1f} µg/m³",
-                'threshold': pm1_threshold,
-                'threshold_exceeded': int(pm1_threshold_exceeded)
-            }
-        # PM2.5
-        if valid_col('PM2.5 (µg/m³)'):
-            pm25_data = recent_data['PM2.5 (µg/m³)'].dropna()
-            pm25_max = pm25_data.max()
-            pm25_min = pm25_data.min()
-            pm25_avg = pm25_data.mean()
-            max_idx = pm25_data.idxmax()
-            min_idx = pm25_data.idxmin()
-            pm25_max_time = get_time_str(recent_data, max_idx)
-            pm25_min_time = get_time_str(recent_data, min_idx)
-            pm25_threshold = 35
-            pm25_threshold_exceeded = (pm25_data > pm25_threshold).sum()
-            insights['pm25'] = {
-                'max': f"{pm25_max:.1f} µg/m³",
-                'max_time': pm25_max_time,
-                'min': f"{pm25_min:.1f} µg/m³",
-                'min_time': pm25_min_time,
-                'avg': f"{pm25_avg:.1f} µg/m³",
-                'threshold': pm25_threshold,
-                'threshold_exceeded': int(pm25_threshold_exceeded)
-            }
-        # PM10
-        if valid_col('PM10.0 (µg/m³)'):
-            pm10_data = recent_data['PM10.0 (µg/m³)'].dropna()
-            pm10_max = pm10_data.max()
-            pm10_min = pm10_data.min()
-            pm10_avg = pm10_data.mean()
-            max_idx = pm10_data.idxmax()
-            min_idx = pm10_data.idxmin()
-            pm10_max_time = get_time_str(recent_data, max_idx)
-            pm10_min_time = get_time_str(recent_data, min_idx)
-            pm10_threshold = 100
-            pm10_threshold_exceeded = (pm10_data > pm10_threshold).sum()
-            insights['pm10'] = {
-                'max': f"{pm10_max:.1f} µg/m³",
-                'max_time': pm10_max_time,
-                'min': f"{pm10_min:.1f} µg/m³",
-                'min_time': pm10_min_time,
-                'avg': f"{pm10_avg:.1f} µg/m³",
-                'threshold': pm10_threshold,
-                'threshold_exceeded': int(pm10_threshold_exceeded)
-            }
-        # TVOC
-        if valid_col('TVOC (ppb)'):
-            tvoc_data = recent_data['TVOC (ppb)'].dropna()
-            tvoc_max = tvoc_data.max()
-            tvoc_min = tvoc_data.min()
-            tvoc_avg = tvoc_data.mean()
-            max_idx = tvoc_data.idxmax()
-            min_idx = tvoc_data.idxmin()
-            tvoc_max_time = get_time_str(recent_data, max_idx)
-            tvoc_min_time = get_time_str(recent_data, min_idx)
-            tvoc_threshold = 500
-            tvoc_threshold_exceeded = (tvoc_data > tvoc_threshold).sum()
-            insights['tvoc'] = {
-                'max': f"{tvoc_max:.0f} ppb",
-                'max_time': tvoc_max_time,
-                'min': f"{tvoc_min:.0f} ppb",
-                'min_time': tvoc_min_time,
-                'avg': f"{tvoc_avg:.0f} ppb",
-                'threshold': tvoc_threshold,
-                'threshold_exceeded': int(tvoc_threshold_exceeded)
-            }
-        # Temperature
-        if valid_col('Temperature (°C)'):
-            temp_data = recent_data['Temperature (°C)'].dropna()
-            temp_max = temp_data.max()
-            temp_min = temp_data.min()
-            temp_avg = temp_data.mean()
-            max_idx = temp_data.idxmax()
-            min_idx = temp_data.idxmin()
-            temp_max_time = get_time_str(recent_data, max_idx)
-            temp_min_time = get_time_str(recent_data, min_idx)
-            temp_threshold_high = 28
-            temp_threshold_low = 16
-            temp_threshold_exceeded = ((temp_data > temp_threshold_high) | (temp_data < temp_threshold_low)).sum()
-            insights['temperature'] = {
-                'max': f"{temp_max:.1f} °C",
-                'max_time': temp_max_time,
-                'min': f"{temp_min:.1f} °C",
-                'min_time': temp_min_time,
-                'avg': f"{temp_avg:.1f} °C",
-                'threshold_high': temp_threshold_high,
-                'threshold_low': temp_threshold_low,
-                'threshold_exceeded': int(temp_threshold_exceeded)
-            }
-        # Humidity
-        if valid_col('Humidity (%)'):
-            hum_data = recent_data['Humidity (%)'].dropna()
-            hum_max = hum_data.max()
-            hum_min = hum_data.min()
-            hum_avg = hum_data.mean()
-            max_idx = hum_data.idxmax()
-            min_idx = hum_data.idxmin()
-            hum_max_time = get_time_str(recent_data, max_idx)
-            hum_min_time = get_time_str(recent_data, min_idx)
-            hum_threshold_high = 70
-            hum_threshold_low = 25
-            hum_threshold_exceeded = ((hum_data > hum_threshold_high) | (hum_data < hum_threshold_low)).sum()
-            insights['humidity'] = {
-                'max': f"{hum_max:.1f} %",
-                'max_time': hum_max_time,
-                'min': f"{hum_min:.1f} %",
-                'min_time': hum_min_time,
-                'avg': f"{hum_avg:.1f} %",
-                'threshold_high': hum_threshold_high,
-                'threshold_low': hum_threshold_low,
-                'threshold_exceeded': int(hum_threshold_exceeded)
-            }
-        return jsonify(insights)
-        
-    except Exception as e:
-        print(f"Error reading insights: {e}")
+    """Answer from the streaming statistics; constant time whatever the history"""
+    window = request.args.get('window', 'all')
+    if window not in WINDOWS:
+        return jsonify({'error': f"Unknown window {window}"}), 400
+
+    snapshot = stats.snapshot(window)
+    if not snapshot:
         return jsonify({'error': 'No data available'})
 
+    insights = {}
+    for metric, ((low, high), unit, decimals) in INSIGHTS.items():
+        s = snapshot.get(metric)
+        if s is None or s.count == 0:
+            continue
+        insights[metric] = {
+            'max': f"{s.max:.{decimals}f} {unit}",
+            'max_time': datetime.fromtimestamp(s.max_ts).strftime('%H:%M'),
+            'min': f"{s.min:.{decimals}f} {unit}",
+            'min_time': datetime.fromtimestamp(s.min_ts).strftime('%H:%M'),
+            'avg': f"{s.mean:.{decimals}f} {unit}",
+            'stddev': f"{s.stddev:.{decimals}f} {unit}",
+            'threshold_exceeded': s.exceeded
+        }
+        if low is None:
+            insights[metric]['threshold'] = high
+        else:
+            insights[metric]['threshold_high'] = high
+            insights[metric]['threshold_low'] = low
+
+    return jsonify(insights)
+
 if __name__ == '__main__':
-    # Initialize Excel file
-    initialize_excel_file()
-    
+    load_history()
+
     # Start serial reading thread
     start_serial_thread()
     
     print("Flask app starting with real-time serial data integration...")
-    app.run(debug=True, port=5000)
+    app.run(debug=True, port=5000, threaded=True)
@@ -0,0 +1,79 @@
+"""Codec for the node parameters defined in common/include/iaq/param.h
+
+Parameters are named after what they set: the cadence and mode ones keep
+their integer units, the validity bounds of a report field are 'min.<key>'
+and 'max.<key>' with the key of iaq_report.FIELDS, in the units of the
+reports.
+"""
+import struct
+
+from iaq_report import FIELDS
+
+PARAM_VERSION = 1
+PARAM = struct.Struct('>Bi')
+MAX_PARAMS = 16
+
+MIN_BASE = 0x40
+MAX_BASE = 0x80
+
+# Parameter id -> name, for the ones taken as is
+PLAIN = {
+    1: 'sample_interval_ms',
+    2: 'samples_per_window',
+    3: 'window_ms',
+    4: 'batch_windows',
+    # enum scd4x_mode_t, -1 picks the one using the least energy
+    5: 'scd41_mode',
+}
+
+
+def param_name(param_id):
+    if param_id in PLAIN:
+        return PLAIN[param_id]
+    if MIN_BASE <= param_id < MAX_BASE and param_id - MIN_BASE in FIELDS:
+        return f"min.{FIELDS[param_id - MIN_BASE]}"
+    if MAX_BASE <= param_id and param_id - MAX_BASE in FIELDS:
+        return f"max.{FIELDS[param_id - MAX_BASE]}"
+    return None
+
+
+def param_id(name):
+    for param, plain in PLAIN.items():
+        if plain == name:
+            return param
+    bound, _, key = name.partition('.')
+    for tag, field in FIELDS.items():
+        if field == key and bound in ('min', 'max'):
+            return (MIN_BASE if bound == 'min' else MAX_BASE) + tag
+    raise KeyError(name)
+
+
+def decode_config(payload):
+    """Decode the parameters a node notified into {name: value}"""
+    if len(payload) < 1 or (len(payload) - 1) % PARAM.size:
+        raise ValueError(f"bad config length {len(payload)}")
+    if payload[0] != PARAM_VERSION:
+        raise ValueError(f"unsupported config version {payload[0]}")
+
+    config = {}
+    for offset in range(1, len(payload), PARAM.size):
+        param, value = PARAM.unpack_from(payload, offset)
+        name = param_name(param)
+        if name is None:
+            # Unknown ids are skipped so newer nodes stay readable
+            continue
+        config[name] = value if param in PLAIN else value / 1000
+    return config
+
+
+def encode_config(changes):
+    """Encode {name: value} for a PUT; raises KeyError for unknown names"""
+    if not changes or len(changes) > MAX_PARAMS:
+        raise ValueError(f"between 1 and {MAX_PARAMS} parameters per change")
+
+    payload = bytearray([PARAM_VERSION])
+    for name, value in changes.items():
+        param = param_id(name)
+        value = int(value) if param in PLAIN else round(value * 1000)
+        payload += PARAM.pack(param, value)
+    return bytes(payload)
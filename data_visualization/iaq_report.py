@@ -0,0 +1,91 @@
+"""Decoder for the binary sensor reports defined in common/include/iaq/report.h"""
+import struct
+
+REPORT_VERSION = 1
+HEADER = struct.Struct('>BBB')
+FIELD = struct.Struct('>Bi')
+
+SENSORS = {0: None, 1: 'scd41', 2: 'ccs811', 3: 'sps30'}
+
+# Status flag bit -> key used by the legacy JSON payloads
+STATUS_FLAGS = {0: 'SCD41_OK', 1: 'CCS811_OK', 2: 'SPS30_OK'}
+
+# Field tag -> key used by the legacy JSON payloads
+FIELDS = {
+    1: 'CO2',
+    2: 'Temperature',
+    3: 'Humidity',
+    4: 'eCO2',
+    5: 'TVOC',
+    6: 'PM1.0',
+    7: 'PM2.5',
+    8: 'PM10.0',
+    9: 'PM4.0',
+    10: 'NC0.5',
+    11: 'NC1.0',
+    12: 'NC2.5',
+    13: 'NC4.0',
+    14: 'NC10.0',
+    15: 'TypicalParticleSize',
+}
+FIELD_ERROR = 0x40
+# Added by the node's store-and-forward uplink when the report is sent
+FIELD_SEQUENCE = 0x41
+FIELD_AGE = 0x42
+# UNIX time in seconds the report was taken at, once the node synchronized
+FIELD_TIME = 0x43
+
+ERRORS = {
+    1: "not ready - Sensor not connected or Sensor's PINs mis-configured.",
+    2: "data invalid (Sensor Data out of bound).",
+}
+
+
+def decode_report(payload):
+    """Decode one binary report into the same dict shape as the JSON payloads
+
+    Reports replayed from the node's flash log also carry 'seq', and
+    'time' (UNIX seconds) once the node synchronized its clock with the
+    server node, otherwise 'age' in seconds when sent in the boot they
+    were taken in.
+    """
+    if len(payload) < HEADER.size or (len(payload) - HEADER.size) % FIELD.size:
+        raise ValueError(f"bad report length {len(payload)}")
+
+    version, sensor_id, status = HEADER.unpack_from(payload)
+    if version != REPORT_VERSION:
+        raise ValueError(f"unsupported report version {version}")
+    if sensor_id not in SENSORS:
+        raise ValueError(f"unknown sensor id {sensor_id}")
+    sensor = SENSORS[sensor_id]
+
+    values = {}
+    error = None
+    meta = {}
+    for offset in range(HEADER.size, len(payload), FIELD.size):
+        tag, value = FIELD.unpack_from(payload, offset)
+        if tag == FIELD_ERROR:
+            error = value
+        elif tag == FIELD_SEQUENCE:
+            meta['seq'] = value & 0xFFFFFFFF
+        elif tag == FIELD_AGE:
+            meta['age'] = value / 1000
+        elif tag == FIELD_TIME:
+            meta['time'] = value & 0xFFFFFFFF
+        elif tag in FIELDS:
+            values[FIELDS[tag]] = value / 1000
+        # Unknown tags are skipped so newer nodes stay readable
+
+    flags = {key: bool(status & (1 << bit)) for bit, key in STATUS_FLAGS.items()}
+
+    if error is not None:
+        name = sensor.upper() if sensor else 'All sensors'
+        record = {'error': f"{name} {ERRORS.get(error, f'error {error}')}"}
+        record.update(flags)
+        record.update(meta)
+        return record
+
+    if sensor is None:
+        raise ValueError("data report without sensor id")
+    values[f"{sensor.upper()}_OK"] = flags[f"{sensor.upper()}_OK"]
+    return {'sensor': sensor, 'data': values, **meta}
@@ -0,0 +1,137 @@
+"""Per-node state of the sensor network
+
+Nodes are keyed by the interface identifier of their mesh-local address,
+which the server node stamps on every record it forwards along with its own
+uptime at reception and the received signal strength. Each node keeps its
+latest values per sensor, the delivery counters of the server node and the
+runtime parameters the node last notified.
+"""
+import threading
+from datetime import datetime, timedelta
+
+
+class RxClock:
+    """Maps the server node's uptime stamps to host wall-clock time
+
+    The smallest arrival - uptime seen so far is the offset with the least
+    queueing and UART delay. It restarts whenever the uptime goes backwards,
+    after a reboot of the server node or a 32-bit wrap.
+    """
+
+    def __init__(self):
+        self._offset = None
+        self._last_ms = None
+
+    def to_wall(self, arrival, rx_ms):
+        if self._last_ms is not None and rx_ms < self._last_ms:
+            self._offset = None
+        self._last_ms = rx_ms
+
+        offset = arrival - timedelta(milliseconds=rx_ms)
+        if self._offset is None or offset < self._offset:
+            self._offset = offset
+        return self._offset + timedelta(milliseconds=rx_ms)
+
+
+class Node:
+    __slots__ = ('id', 'name', 'first_seen', 'last_seen', 'rss', 'records', 'sensors', 'link',
+                 'config', 'config_error')
+
+    def __init__(self, node_id, name=None):
+        self.id = node_id
+        self.name = name
+        self.first_seen = self.last_seen = None
+        self.rss = None
+        self.records = 0
+        # sensor -> (sample time, {report key: value})
+        self.sensors = {}
+        # Latest node table entry of the server node
+        self.link = {}
+        # Parameter name -> value, see iaq_config
+        self.config = {}
+        # Why the last change of the parameters failed, until the next notification
+        self.config_error = None
+
+    def seen(self, when, rss=None):
+        if self.first_seen is None:
+            self.first_seen = when
+        if self.last_seen is None or when > self.last_seen:
+            self.last_seen = when
+        if rss is not None:
+            self.rss = rss
+
+    def to_dict(self):
+        link = dict(self.link)
+        if link:
+            expected = link['received'] + link['lost']
+            link['loss_rate'] = round(link['lost'] / expected, 4) if expected else 0.0
+        return {
+            'node': self.id,
+            'name': self.name,
+            'first_seen': self.first_seen.isoformat() if self.first_seen else None,
+            'last_seen': self.last_seen.isoformat() if self.last_seen else None,
+            'rss': self.rss,
+            'records': self.records,
+            'sensors': {sensor: {'time': ts.isoformat(), 'data': dict(values)}
+                        for sensor, (ts, values) in self.sensors.items()},
+            'link': link,
+            'config': dict(self.config),
+            'config_error': self.config_error,
+        }
+
+
+class NodeTable:
+    def __init__(self, names=None):
+        """names maps node ids to the room they are installed in"""
+        self.names = names or {}
+        self._nodes = {}
+        self._lock = threading.Lock()
+
+    def _get(self, node_id):
+        node = self._nodes.get(node_id)
+        if node is None:
+            node = self._nodes[node_id] = Node(node_id, self.names.get(node_id))
+        return node
+
+    def record(self, node_id, when, rss):
+        """Count one record received from a node"""
+        with self._lock:
+            node = self._get(node_id)
+            node.seen(when, rss)
+            node.records += 1
+
+    def update_sensor(self, node_id, sensor, values, sample_time):
+        """Keep the newest values of a sensor; replayed older samples are ignored"""
+        with self._lock:
+            node = self._get(node_id)
+            current = node.sensors.get(sensor)
+            if current is None or sample_time >= current[0]:
+                node.sensors[sensor] = (sample_time, values)
+
+    def update_link(self, node_id, when, link):
+        """Store the node table entry and return the previous one"""
+        with self._lock:
+            node = self._get(node_id)
+            node.seen(when, link.get('rss'))
+            previous, node.link = node.link, link
+            return previous
+
+    def update_config(self, node_id, config):
+        with self._lock:
+            node = self._get(node_id)
+            node.config = config
+            node.config_error = None
+
+    def config_failed(self, node_id, reason):
+        """Keep why a change of the parameters did not reach the node"""
+        with self._lock:
+            self._get(node_id).config_error = reason
+
+    def get(self, node_id):
+        with self._lock:
+            node = self._nodes.get(node_id)
+            return node.to_dict() if node else None
+
+    def snapshot(self):
+        with self._lock:
+            return {node_id: node.to_dict() for node_id, node in self._nodes.items()}
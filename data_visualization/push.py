@@ -0,0 +1,66 @@
+"""Fan-out of dashboard updates to Server-Sent Events subscribers
+
+Every update is serialized once and handed to each subscriber's bounded
+queue. A subscriber that falls behind loses its oldest pending updates
+instead of slowing down the publisher or the other subscribers; updates
+are full snapshots, so the newest one is always enough to catch up.
+"""
+import threading
+from collections import deque
+
+QUEUE_LEN = 4
+HEARTBEAT_SECONDS = 15
+
+
+class Subscriber:
+    def __init__(self, maxlen):
+        self._pending = deque(maxlen=maxlen)
+        self._cond = threading.Condition()
+        self.dropped = 0
+
+    def put(self, event):
+        with self._cond:
+            if len(self._pending) == self._pending.maxlen:
+                self.dropped += 1
+            self._pending.append(event)
+            self._cond.notify()
+
+    def get(self, timeout):
+        """Return the next event, or None if nothing arrived within timeout"""
+        with self._cond:
+            if not self._pending:
+                self._cond.wait(timeout)
+            return self._pending.popleft() if self._pending else None
+
+
+class Broadcaster:
+    def __init__(self, maxlen=QUEUE_LEN):
+        self.maxlen = maxlen
+        self._subscribers = set()
+        self._lock = threading.Lock()
+
+    def publish(self, event):
+        with self._lock:
+            subscribers = list(self._subscribers)
+        for subscriber in subscribers:
+            subscriber.put(event)
+
+    def stream(self, initial=None):
+        """Generator of SSE frames for one client, first sending initial"""
+        subscriber = Subscriber(self.maxlen)
+        with self._lock:
+            self._subscribers.add(subscriber)
+        try:
+            if initial is not None:
+                yield f"data: {initial}\n\n"
+            while True:
+                event = subscriber.get(HEARTBEAT_SECONDS)
+                # Comment lines keep proxies from closing an idle stream
+                yield f"data: {event}\n\n" if event is not None else ": keep-alive\n\n"
+        finally:
+            with self._lock:
+                self._subscribers.discard(subscriber)
+
+    def __len__(self):
+        with self._lock:
+            return len(self._subscribers)
@@ -0,0 +1,76 @@
+"""Incremental per-metric aggregates at fixed time resolutions
+
+Each sample updates one bucket per resolution in O(1); queries read the
+buckets directly instead of re-aggregating the raw history.
+"""
+import threading
+
+# name -> (bucket width in seconds, buckets kept)
+RESOLUTIONS = {
+    '1m': (60, 24 * 60),
+    '1h': (3600, 30 * 24),
+    '1d': (86400, 10 * 365),
+}
+
+
+class Bucket:
+    __slots__ = ('count', 'total', 'min', 'max')
+
+    def __init__(self, value):
+        self.count = 1
+        self.total = value
+        self.min = value
+        self.max = value
+
+    def add(self, value):
+        self.count += 1
+        self.total += value
+        self.min = min(self.min, value)
+        self.max = max(self.max, value)
+
+    @property
+    def mean(self):
+        return self.total / self.count
+
+
+class Rollups:
+    def __init__(self, resolutions=RESOLUTIONS):
+        self.resolutions = resolutions
+        # resolution -> {bucket start: {metric: Bucket}}
+        self._buckets = {name: {} for name in resolutions}
+        self._newest = {name: None for name in resolutions}
+        self._lock = threading.Lock()
+
+    def add(self, ts, values):
+        """Fold one sample ({metric: value}, None values skipped) into every resolution"""
+        with self._lock:
+            for name, (width, keep) in self.resolutions.items():
+                start = int(ts // width) * width
+                buckets = self._buckets[name]
+                newest = self._newest[name]
+
+                if newest is not None and start <= newest - keep * width:
+                    # Older than the retention of this resolution
+                    continue
+                if newest is None or start > newest:
+                    self._newest[name] = newest = start
+                    cutoff = newest - keep * width
+                    for old in [s for s in buckets if s <= cutoff]:
+                        del buckets[old]
+
+                metrics = buckets.setdefault(start, {})
+                for metric, value in values.items():
+                    if value is None:
+                        continue
+                    bucket = metrics.get(metric)
+                    if bucket is None:
+                        metrics[metric] = Bucket(value)
+                    else:
+                        bucket.add(value)
+
+    def series(self, resolution):
+        """Return [(bucket start, {metric: mean}), ...] ordered by time"""
+        with self._lock:
+            buckets = self._buckets[resolution]
+            return [(start, {metric: b.mean for metric, b in buckets[start].items()})
+                    for start in sorted(buckets)]
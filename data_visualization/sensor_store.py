@@ -0,0 +1,200 @@
+"""Append-only storage of sensor samples in fixed-size binary records
+
+Every sensor gets its own directory of segment files. A segment covers one
+period (a day by default) and starts with a short header; every record is a
+float64 UNIX timestamp followed by one float32 per field, NaN when the field
+was missing. Appending a sample is a single write to the open segment, so
+its cost does not depend on how much history exists.
+
+New fields are only ever added at the end of a sensor's list: segments
+written with fewer columns read back with the new ones missing, and the
+segment being appended to is widened once when it is reopened.
+"""
+import math
+import os
+import struct
+import threading
+from datetime import datetime
+
+from openpyxl import Workbook, load_workbook
+
+MAGIC = b'IAQS'
+VERSION = 1
+SEGMENT_HEADER = struct.Struct('<4sBB')
+SEGMENT_SUFFIX = '.seg'
+
+
+class SensorStore:
+    def __init__(self, root, fields, segment_seconds=86400):
+        """fields maps a sensor name to its [(value key, column header), ...]"""
+        self.root = root
+        self.fields = fields
+        self.segment_seconds = segment_seconds
+        self._records = {sensor: struct.Struct('<d' + 'f' * len(cols))
+                         for sensor, cols in fields.items()}
+        # sensor -> (segment start, file) of the newest segment written to
+        self._open = {}
+        self._lock = threading.Lock()
+        for sensor in fields:
+            os.makedirs(os.path.join(root, sensor), exist_ok=True)
+
+    def _segment_path(self, sensor, start):
+        return os.path.join(self.root, sensor, f'{start:010d}{SEGMENT_SUFFIX}')
+
+    def _open_segment(self, sensor, start):
+        """Open a segment for appending, dropping a torn record left by a crash"""
+        path = self._segment_path(sensor, start)
+        f = open(path, 'ab')
+        size = f.seek(0, os.SEEK_END)
+        if size >= SEGMENT_HEADER.size:
+            with open(path, 'rb') as old:
+                _, _, count = SEGMENT_HEADER.unpack(old.read(SEGMENT_HEADER.size))
+            if count != len(self.fields[sensor]):
+                f.close()
+                self._widen_segment(sensor, path, count)
+                f = open(path, 'ab')
+                size = f.seek(0, os.SEEK_END)
+        if size == 0:
+            f.write(SEGMENT_HEADER.pack(MAGIC, VERSION, len(self.fields[sensor])))
+        else:
+            torn = (size - SEGMENT_HEADER.size) % self._records[sensor].size
+            if torn:
+                f.truncate(size - torn)
+                f.seek(0, os.SEEK_END)
+        return f
+
+    def _widen_segment(self, sensor, path, count):
+        """Rewrite a segment written with count columns to the current layout"""
+        ncols = len(self.fields[sensor])
+        with open(path, 'rb') as f:
+            data = f.read()
+        rows = self._unpack(data, count)
+        tmp = path + '.tmp'
+        with open(tmp, 'wb') as f:
+            f.write(SEGMENT_HEADER.pack(MAGIC, VERSION, ncols))
+            for ts, values in rows:
+                values = (values + (None,) * ncols)[:ncols]
+                f.write(self._records[sensor].pack(
+                    ts, *(math.nan if v is None else v for v in values)))
+        os.replace(tmp, path)
+
+    @staticmethod
+    def _unpack(data, count):
+        """Return the [(timestamp, (values...)), ...] of a segment with count columns"""
+        record = struct.Struct('<d' + 'f' * count)
+        end = len(data) - (len(data) - SEGMENT_HEADER.size) % record.size
+        return [(ts, tuple(None if math.isnan(v) else v for v in values))
+                for ts, *values in record.iter_unpack(data[SEGMENT_HEADER.size:end])]
+
+    def append(self, sensor, values, timestamp=None):
+        """Store one sample; values uses the same keys as the sensor reports"""
+        if sensor not in self.fields:
+            raise KeyError(f"unknown sensor {sensor}")
+
+        ts = (timestamp or datetime.now()).timestamp()
+        start = int(ts // self.segment_seconds) * self.segment_seconds
+        row = [ts]
+        for key, _ in self.fields[sensor]:
+            value = values.get(key)
+            row.append(math.nan if value is None else float(value))
+        record = self._records[sensor].pack(*row)
+
+        with self._lock:
+            current = self._open.get(sensor)
+            if current and current[0] == start:
+                f = current[1]
+            elif current is None or start > current[0]:
+                # Rollover to a new period
+                if current:
+                    current[1].close()
+                f = self._open_segment(sensor, start)
+                self._open[sensor] = (start, f)
+            else:
+                # Late sample replayed by a node, goes to its own period
+                with self._open_segment(sensor, start) as f:
+                    f.write(record)
+                return
+            f.write(record)
+            f.flush()
+
+    def read(self, sensor, since=None):
+        """Return [(timestamp, (values...)), ...] ordered by time
+
+        Missing values are None. since is a UNIX timestamp; older segments
+        are skipped without being opened.
+        """
+        ncols = len(self.fields[sensor])
+        directory = os.path.join(self.root, sensor)
+        rows = []
+
+        with self._lock:
+            current = self._open.get(sensor)
+            if current:
+                current[1].flush()
+
+            for name in sorted(os.listdir(directory)):
+                if not name.endswith(SEGMENT_SUFFIX):
+                    continue
+                start = int(name[:-len(SEGMENT_SUFFIX)])
+                if since is not None and start + self.segment_seconds <= since:
+                    continue
+
+                with open(os.path.join(directory, name), 'rb') as f:
+                    data = f.read()
+                if len(data) < SEGMENT_HEADER.size:
+                    continue
+                magic, version, count = SEGMENT_HEADER.unpack_from(data)
+                if magic != MAGIC or version != VERSION or count > ncols:
+                    print(f"[WARN] Skipping incompatible segment {name}")
+                    continue
+
+                padding = (None,) * (ncols - count)
+                for ts, values in self._unpack(data, count):
+                    if since is None or ts >= since:
+                        rows.append((ts, values + padding))
+
+        rows.sort(key=lambda row: row[0])
+        return rows
+
+    def export_xlsx(self, out):
+        """Write every sample to an .xlsx workbook, one sheet per sensor"""
+        wb = Workbook(write_only=True)
+        for sensor, cols in self.fields.items():
+            ws = wb.create_sheet(title=sensor.upper())
+            ws.append(['Timestamp'] + [header for _, header in cols])
+            for ts, values in self.read(sensor):
+                stamp = datetime.fromtimestamp(ts).strftime("%Y-%m-%d %H:%M:%S")
+                ws.append([stamp] + [None if v is None else round(v, 2) for v in values])
+        wb.save(out)
+
+    def is_empty(self):
+        return not any(name.endswith(SEGMENT_SUFFIX)
+                       for sensor in self.fields
+                       for name in os.listdir(os.path.join(self.root, sensor)))
+
+    def import_xlsx(self, path):
+        """Append the rows of a workbook laid out like export_xlsx() writes it"""
+        wb = load_workbook(path, read_only=True)
+        imported = 0
+        for sensor, cols in self.fields.items():
+            if sensor.upper() not in wb.sheetnames:
+                continue
+            rows = wb[sensor.upper()].iter_rows(values_only=True)
+            header = list(next(rows, []))
+            index = {key: header.index(title) for key, title in cols if title in header}
+            for row in rows:
+                if not row or row[0] is None:
+                    continue
+                stamp = row[0]
+                if not isinstance(stamp, datetime):
+                    stamp = datetime.strptime(str(stamp), "%Y-%m-%d %H:%M:%S")
+                self.append(sensor, {key: row[i] for key, i in index.items()}, stamp)
+                imported += 1
+        wb.close()
+        return imported
+
+    def close(self):
+        with self._lock:
+            for _, f in self._open.values():
+                f.close()
+            self._open.clear()
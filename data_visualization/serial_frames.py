@@ -0,0 +1,142 @@
+"""Decoder for the CRC-protected frames sent by server_node over the FT232 link
+
+Frame layout (see forward_thread in server_node/src/main.c):
+    0xA5 0x5A | type | length (uint16 LE) | payload | CRC-16 (BE)
+The CRC is CRC-16/CCITT-FALSE over type, length and payload. The host
+sends FRAME_TIME and FRAME_CONFIG frames to the server node in the same
+layout.
+"""
+import binascii
+import struct
+
+SOF = b'\xa5\x5a'
+HEADER_SIZE = 5
+CRC_SIZE = 2
+MAX_PAYLOAD = 1024
+
+FRAME_REPORT = 0x01
+FRAME_TEXT = 0x02
+FRAME_LINK = 0x03
+FRAME_RECORD = 0x04
+# Host to server node: UNIX time in ms (uint64 LE), served to the nodes
+FRAME_TIME = 0x05
+# Node parameters (see iaq_config); host to server node they are prefixed
+# with the node id and relayed to that node
+FRAME_CONFIG = 0x06
+
+# Node table entry (node_link_forward in server_node/src/main.c)
+LINK = struct.Struct('<8s8Ib')
+# Header of a payload stamped by the server node: node id, server uptime at
+# reception in ms, RSS in dBm and the type of the payload that follows
+RECORD = struct.Struct('<8sIbB')
+# RSS of records the server node made up itself, e.g. a config error
+RSS_NONE = 127
+
+
+def encode_frame(frame_type, payload):
+    """Wrap a payload in a frame for the server node"""
+    body = struct.pack('<BH', frame_type, len(payload)) + payload
+    return SOF + body + struct.pack('>H', binascii.crc_hqx(body, 0xFFFF))
+
+
+def encode_time(epoch_ms):
+    return encode_frame(FRAME_TIME, struct.pack('<Q', epoch_ms))
+
+
+def encode_node_config(node, payload):
+    return encode_frame(FRAME_CONFIG, bytes.fromhex(node) + payload)
+
+
+def decode_link(payload):
+    """Decode a FRAME_LINK payload into the node id and its counters"""
+    if len(payload) != LINK.size:
+        raise ValueError(f"bad link frame length {len(payload)}")
+    iid, seq, received, duplicates, gaps, lost, missing, messages, size, rss = LINK.unpack(payload)
+    return {
+        'node': iid.hex(),
+        'seq': seq,
+        'received': received,
+        'duplicates': duplicates,
+        'gaps': gaps,
+        'lost': lost,
+        'missing': missing,
+        'messages': messages,
+        'bytes': size,
+        'rss': rss,
+    }
+
+
+def decode_record(payload):
+    """Split a FRAME_RECORD payload into (node, rx_ms, rss, type, inner payload)
+
+    rss is None for records that did not come over the radio.
+    """
+    if len(payload) < RECORD.size:
+        raise ValueError(f"bad record frame length {len(payload)}")
+    iid, rx_ms, rss, frame_type = RECORD.unpack_from(payload)
+    if rss == RSS_NONE:
+        rss = None
+    return iid.hex(), rx_ms, rss, frame_type, payload[RECORD.size:]
+
+
+class FrameDecoder:
+    """Resynchronizing parser; bytes can be fed in chunks of any size"""
+
+    def __init__(self):
+        self._buf = bytearray()
+        self._pos = 0
+        self.frames = 0
+        self.crc_errors = 0
+        self.skipped = 0
+
+    def feed(self, data):
+        """Append received bytes and return the [(type, payload), ...] completed"""
+        self._buf += data
+        frames = []
+        buf = self._buf
+
+        while True:
+            start = buf.find(SOF, self._pos)
+            if start < 0:
+                # Keep a trailing 0xA5 not consumed yet, it may be the first
+                # half of a SOF
+                keep = 1 if self._pos < len(buf) and buf.endswith(SOF[:1]) else 0
+                self.skipped += len(buf) - self._pos - keep
+                self._pos = len(buf) - keep
+                break
+            self.skipped += start - self._pos
+            self._pos = start
+
+            if len(buf) - start < HEADER_SIZE:
+                break
+            length = buf[start + 3] | (buf[start + 4] << 8)
+            if length > MAX_PAYLOAD:
+                # Not a real header, look for the next SOF
+                self._pos = start + 1
+                self.skipped += 1
+                continue
+
+            end = start + HEADER_SIZE + length + CRC_SIZE
+            if len(buf) < end:
+                break
+
+            body = memoryview(buf)[start + 2:end - CRC_SIZE]
+            crc = (buf[end - 2] << 8) | buf[end - 1]
+            if binascii.crc_hqx(body, 0xFFFF) != crc:
+                body.release()
+                self.crc_errors += 1
+                self._pos = start + 1
+                self.skipped += 1
+                continue
+
+            frames.append((buf[start + 2], bytes(body[HEADER_SIZE - 2:])))
+            body.release()
+            self.frames += 1
+            self._pos = end
+
+        # Compact once the consumed prefix dominates, not on every frame
+        if self._pos > len(buf) // 2:
+            del buf[:self._pos]
+            self._pos = 0
+
+        return frames
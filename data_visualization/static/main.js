@@ -299,86 +299,103 @@ function updateConnectionStatus(status, lastUpdate) {
     }
 }
 
-// Fetch real-time data from backend
+// Fetch real-time data from backend (fallback when streaming is unavailable)
 async function fetchRealTimeData() {
     try {
         const response = await fetch('/api/current-data');
-        const data = await response.json();
-        
-        // Update connection status
-        updateConnectionStatus(data.connection_status, data.last_update);
-        
-        // Update separate last update times
-        document.getElementById('lastUpdateCO2').textContent = data.last_update_co2 || '-';
-        document.getElementById('lastUpdatePM').textContent = data.last_update_pm || '-';
+        renderRealTimeData(await response.json());
+    } catch (error) {
+        console.error('Error fetching real-time data:', error);
+        // Update status to show connection error
+        updateConnectionStatus('Disconnected', 'Error');
+    }
+}
 
-        // Update sensor values (handle both string and number values)
-        document.getElementById('co2Value').textContent = data.co2;
-        document.getElementById('tvocValue').textContent = data.tvoc;
-        document.getElementById('eco2Value').textContent = data.eco2;
-        
-        // Round PM values to 2 decimal places
-        const pm1Value = data.pm1;
-        const pm25Value = data.pm25;
-        const pm10Value = data.pm10;
-        const tempValue = data.temperature;
-        const humidityValue = data.humidity;
-        
-        document.getElementById('pm1Value').textContent = pm1Value === '-' ? '-' : parseFloat(pm1Value).toFixed(2);
-        document.getElementById('pm25Value').textContent = pm25Value === '-' ? '-' : parseFloat(pm25Value).toFixed(2);
-        document.getElementById('pm10Value').textContent = pm10Value === '-' ? '-' : parseFloat(pm10Value).toFixed(2);
-        document.getElementById('tempValue').textContent = tempValue === '-' ? '-' : parseFloat(tempValue).toFixed(2);
-        document.getElementById('humidityValue').textContent = humidityValue === '-' ? '-' : parseFloat(humidityValue).toFixed(2);
-        
-        // Update all arc gauges
-        updateAllArcGauges(data);
-        
-        // Update AQI
-        const aqiElement = document.getElementById('aqiValue');
-        const aqiLabelElement = document.getElementById('aqiLabel');
-        const aqiDescElement = document.getElementById('aqiDescription');
-        const affectedGroupsElement = document.getElementById('affectedGroups');
-        const affectedGroupsListElement = document.getElementById('affectedGroupsList');
-        
-        if (data.air_quality_status && data.air_quality_status.status && data.air_quality_status.status !== '-') {
-            const status = data.air_quality_status;
-            aqiElement.textContent = status.icon;
-            aqiLabelElement.textContent = status.status;
-            aqiLabelElement.className = `aqi-label ${status.color}`;
-            aqiDescElement.textContent = status.description;
-            
-            // Show affected groups if any
-            if (status.affected_groups && status.affected_groups.length > 0) {
-                affectedGroupsElement.style.display = 'block';
-                affectedGroupsListElement.innerHTML = status.affected_groups.map(group => 
-                    `<div style="margin-bottom: 5px; padding: 5px; background: rgba(255,193,7,0.1); border-radius: 3px;">• ${group}</div>`
-                ).join('');
-            } else {
-                affectedGroupsElement.style.display = 'none';
-            }
-        } else {
-            aqiElement.textContent = '-';
-            aqiLabelElement.textContent = '-';
-            aqiLabelElement.className = 'aqi-label';
-            aqiDescElement.textContent = '-';
-            affectedGroupsElement.style.display = 'none';
+// Subscribe to pushed updates; the browser reconnects on its own after errors
+function subscribeRealTimeData() {
+    const source = new EventSource('/api/stream');
+    source.onmessage = (event) => {
+        try {
+            renderRealTimeData(JSON.parse(event.data));
+        } catch (error) {
+            console.error('Error rendering real-time data:', error);
         }
+    };
+    source.onerror = () => {
+        updateConnectionStatus('Disconnected', 'Error');
+    };
+}
+
+// Render one real-time snapshot
+function renderRealTimeData(data) {
+    // Update connection status
+    updateConnectionStatus(data.connection_status, data.last_update);
+    
+    // Update separate last update times
+    document.getElementById('lastUpdateCO2').textContent = data.last_update_co2 || '-';
+    document.getElementById('lastUpdatePM').textContent = data.last_update_pm || '-';
+
+    // Update sensor values (handle both string and number values)
+    document.getElementById('co2Value').textContent = data.co2;
+    document.getElementById('tvocValue').textContent = data.tvoc;
+    document.getElementById('eco2Value').textContent = data.eco2;
+    
+    // Round PM values to 2 decimal places
+    const pm1Value = data.pm1;
+    const pm25Value = data.pm25;
+    const pm10Value = data.pm10;
+    const tempValue = data.temperature;
+    const humidityValue = data.humidity;
+    
+    document.getElementById('pm1Value').textContent = pm1Value === '-' ? '-' : parseFloat(pm1Value).toFixed(2);
+    document.getElementById('pm25Value').textContent = pm25Value === '-' ? '-' : parseFloat(pm25Value).toFixed(2);
+    document.getElementById('pm10Value').textContent = pm10Value === '-' ? '-' : parseFloat(pm10Value).toFixed(2);
+    document.getElementById('tempValue').textContent = tempValue === '-' ? '-' : parseFloat(tempValue).toFixed(2);
+    document.getElementById('humidityValue').textContent = humidityValue === '-' ? '-' : parseFloat(humidityValue).toFixed(2);
+    
+    // Update all arc gauges
+    updateAllArcGauges(data);
+    
+    // Update AQI
+    const aqiElement = document.getElementById('aqiValue');
+    const aqiLabelElement = document.getElementById('aqiLabel');
+    const aqiDescElement = document.getElementById('aqiDescription');
+    const affectedGroupsElement = document.getElementById('affectedGroups');
+    const affectedGroupsListElement = document.getElementById('affectedGroupsList');
+    
+    if (data.air_quality_status && data.air_quality_status.status && data.air_quality_status.status !== '-') {
+        const status = data.air_quality_status;
+        aqiElement.textContent = status.icon;
+        aqiLabelElement.textContent = status.status;
+        aqiLabelElement.className = `aqi-label ${status.color}`;
+        aqiDescElement.textContent = status.description;
         
-        // Update recommendations
-        const recommendationsContainer = document.querySelector('.recommendations');
-        let recommendationsHTML = `<h3>💡 Recommendations</h3>`;
-        if (data.recommendations && data.recommendations.length === 1 && data.recommendations[0] === '-') {
-            recommendationsHTML += `<div class="recommendation">-</div>`;
+        // Show affected groups if any
+        if (status.affected_groups && status.affected_groups.length > 0) {
+            affectedGroupsElement.style.display = 'block';
+            affectedGroupsListElement.innerHTML = status.affected_groups.map(group => 
+                `<div style="margin-bottom: 5px; padding: 5px; background: rgba(255,193,7,0.1); border-radius: 3px;">• ${group}</div>`
+            ).join('');
         } else {
-            recommendationsHTML += data.recommendations.map(rec => `<div class="recommendation">${rec}</div>`).join('');
+            affectedGroupsElement.style.display = 'none';
         }
-        recommendationsContainer.innerHTML = recommendationsHTML;
-        
-    } catch (error) {
-        console.error('Error fetching real-time data:', error);
-        // Update status to show connection error
-        updateConnectionStatus('Disconnected', 'Error');
+    } else {
+        aqiElement.textContent = '-';
+        aqiLabelElement.textContent = '-';
+        aqiLabelElement.className = 'aqi-label';
+        aqiDescElement.textContent = '-';
+        affectedGroupsElement.style.display = 'none';
+    }
+    
+    // Update recommendations
+    const recommendationsContainer = document.querySelector('.recommendations');
+    let recommendationsHTML = `<h3>💡 Recommendations</h3>`;
+    if (data.recommendations && data.recommendations.length === 1 && data.recommendations[0] === '-') {
+        recommendationsHTML += `<div class="recommendation">-</div>`;
+    } else {
+        recommendationsHTML += data.recommendations.map(rec => `<div class="recommendation">${rec}</div>`).join('');
     }
+    recommendationsContainer.innerHTML = recommendationsHTML;
 }
 
 function updateAllArcGauges(data) {
@@ -566,5 +583,9 @@ function setGaugeArc(id, value, min, max, thresholds, statusText) {
 // Initialize
 updateDateTime();
 setInterval(updateDateTime, 1000);
-fetchRealTimeData(); // Initial load
-setInterval(fetchRealTimeData, 5000); // Update every 5 seconds 
\ No newline at end of file
+if (window.EventSource) {
+    subscribeRealTimeData(); // Updates are pushed as samples arrive
+} else {
+    fetchRealTimeData(); // Initial load
+    setInterval(fetchRealTimeData, 5000); // Update every 5 seconds
+} 
\ No newline at end of file
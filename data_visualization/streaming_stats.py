@@ -0,0 +1,86 @@
+"""One-pass statistics per metric, updated in O(1) for every sample
+
+Keeps Welford's running mean/variance, min/max with the time they were
+seen and threshold exceedance counts, over the whole history and over the
+current hour and day.
+"""
+import math
+import threading
+
+# name -> tumbling window width in seconds, None for the whole history
+WINDOWS = {
+    'all': None,
+    'day': 86400,
+    'hour': 3600,
+}
+
+
+class RunningStats:
+    __slots__ = ('count', 'mean', 'm2', 'min', 'min_ts', 'max', 'max_ts', 'exceeded')
+
+    def __init__(self):
+        self.count = 0
+        self.mean = 0.0
+        self.m2 = 0.0
+        self.min = self.max = None
+        self.min_ts = self.max_ts = None
+        self.exceeded = 0
+
+    def add(self, ts, value, low=None, high=None):
+        self.count += 1
+        delta = value - self.mean
+        self.mean += delta / self.count
+        self.m2 += delta * (value - self.mean)
+
+        if self.min is None or value < self.min:
+            self.min, self.min_ts = value, ts
+        if self.max is None or value > self.max:
+            self.max, self.max_ts = value, ts
+        if (high is not None and value > high) or (low is not None and value < low):
+            self.exceeded += 1
+
+    @property
+    def stddev(self):
+        return math.sqrt(self.m2 / (self.count - 1)) if self.count > 1 else 0.0
+
+
+class StreamingStats:
+    def __init__(self, thresholds, windows=WINDOWS):
+        """thresholds maps every tracked metric to its (low, high) limits, None if unbounded"""
+        self.thresholds = thresholds
+        self.windows = windows
+        # window -> (period start, {metric: RunningStats})
+        self._stats = {name: (None, {}) for name in windows}
+        self._lock = threading.Lock()
+
+    def add(self, ts, values):
+        """Fold one sample ({metric: value}, None values skipped) into every window"""
+        with self._lock:
+            for name, width in self.windows.items():
+                start, stats = self._stats[name]
+                if width is not None:
+                    period = int(ts // width) * width
+                    if start is None or period > start:
+                        start, stats = period, {}
+                        self._stats[name] = (start, stats)
+                    elif period < start:
+                        # Late sample for a window that already closed
+                        continue
+
+                for metric, value in values.items():
+                    if value is None or metric not in self.thresholds:
+                        continue
+                    low, high = self.thresholds[metric]
+                    stats.setdefault(metric, RunningStats()).add(ts, value, low, high)
+
+    def snapshot(self, window):
+        """Return {metric: RunningStats} copies for one window"""
+        with self._lock:
+            _, stats = self._stats[window]
+            copies = {}
+            for metric, s in stats.items():
+                copy = RunningStats()
+                for slot in RunningStats.__slots__:
+                    setattr(copy, slot, getattr(s, slot))
+                copies[metric] = copy
+            return copies
@@ -0,0 +1,61 @@
+"""Tests of serial_frames.FrameDecoder; run with python -m unittest"""
+import unittest
+
+from serial_frames import FRAME_REPORT, FRAME_TEXT, FrameDecoder, encode_frame
+
+
+def frame_ending_in_sof_byte():
+    """A text frame whose CRC ends in 0xA5, the first byte of a SOF"""
+    for i in range(1 << 16):
+        frame = encode_frame(FRAME_TEXT, str(i).encode())
+        if frame[-1] == 0xA5:
+            return frame, str(i).encode()
+    raise AssertionError("no such frame")
+
+
+class FrameDecoderTest(unittest.TestCase):
+
+    def test_frames_in_one_chunk(self):
+        decoder = FrameDecoder()
+        data = encode_frame(FRAME_REPORT, b'\x01\x02') + encode_frame(FRAME_TEXT, b'hi')
+        self.assertEqual(decoder.feed(data), [(FRAME_REPORT, b'\x01\x02'), (FRAME_TEXT, b'hi')])
+        self.assertEqual(decoder.skipped, 0)
+
+    def test_frame_byte_by_byte(self):
+        decoder = FrameDecoder()
+        frames = []
+        for byte in encode_frame(FRAME_TEXT, b'hello'):
+            frames += decoder.feed(bytes([byte]))
+        self.assertEqual(frames, [(FRAME_TEXT, b'hello')])
+        self.assertEqual(decoder.skipped, 0)
+
+    def test_garbage_and_crc_errors_are_skipped(self):
+        decoder = FrameDecoder()
+        bad = bytearray(encode_frame(FRAME_TEXT, b'bad'))
+        bad[-1] ^= 0xFF
+        frames = decoder.feed(b'\x00\x11' + bytes(bad) + encode_frame(FRAME_TEXT, b'ok'))
+        self.assertEqual(frames, [(FRAME_TEXT, b'ok')])
+        self.assertEqual(decoder.crc_errors, 1)
+
+    def test_trailing_sof_byte_split_across_chunks(self):
+        decoder = FrameDecoder()
+        frame = encode_frame(FRAME_TEXT, b'split')
+        self.assertEqual(decoder.feed(b'\x00' + frame[:1]), [])
+        self.assertEqual(decoder.feed(frame[1:]), [(FRAME_TEXT, b'split')])
+        self.assertEqual(decoder.skipped, 1)
+
+    def test_consumed_crc_byte_equal_to_sof_is_not_kept(self):
+        decoder = FrameDecoder()
+        frame, payload = frame_ending_in_sof_byte()
+        self.assertEqual(decoder.feed(frame), [(FRAME_TEXT, payload)])
+        self.assertEqual(decoder.feed(b''), [])
+        self.assertEqual(decoder.skipped, 0)
+        # The next frame follows directly, the 0xA5 must not pair with it
+        self.assertEqual(decoder.feed(b'\x5a' + encode_frame(FRAME_TEXT, b'next')),
+                         [(FRAME_TEXT, b'next')])
+        self.assertEqual(decoder.skipped, 1)
+        self.assertEqual(decoder.frames, 2)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -4,35 +4,661 @@
 #include <openthread/coap.h>
 #include <openthread/thread.h>
 #include <zephyr/net/openthread.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/byteorder.h>
+#include <iaq/param.h>
+#include <iaq/report.h>
 #include <stdio.h>
 
 
 // UART FT232 Configuration
 #define UART1_NODE DT_NODELABEL(uart1)
 static const struct device *uart_dev = DEVICE_DT_GET(UART1_NODE);
-static uint8_t tx_buf[256];
-static int tx_buf_length;
 
+// Every record goes to the host as one frame, decoded by
+// data_visualization/serial_frames.py:
+//   0xA5 0x5A | type | length (LE16) | payload | CRC-16 (BE16)
+// The CRC is CRC-16/CCITT-FALSE (crc16_itu_t, seed 0xFFFF) over type,
+// length and payload; the host resynchronizes on the next SOF after a bad CRC.
+//
+// Payloads received from the nodes go out as FRAME_TYPE_RECORD, stamped
+// with the node they came from (little-endian):
+//   iid[8] | rx uptime ms (32) | RSS dBm (int8) | frame_type | payload
+// Records the server node makes up itself, such as a failed parameter
+// change of a node, carry RECORD_RSS_NONE.
+//
+// The host sends FRAME_TYPE_TIME and FRAME_TYPE_CONFIG frames the other way.
+#define FRAME_SOF_0 0xA5
+#define FRAME_SOF_1 0x5A
+#define FRAME_HEADER_SIZE 5
+#define FRAME_CRC_SIZE 2
+#define FRAME_OVERHEAD (FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
 
-// COAP Server Implenentation
+enum frame_type {
+    FRAME_TYPE_REPORT = 0x01,   // binary report, see iaq/report.h
+    FRAME_TYPE_TEXT = 0x02,     // text payload, JSON from legacy clients
+    FRAME_TYPE_LINK = 0x03,     // node table entry, see node_link_forward()
+    FRAME_TYPE_RECORD = 0x04,   // REPORT or TEXT payload stamped with its node
+    FRAME_TYPE_TIME = 0x05,     // from the host: UNIX time in ms (LE64)
+    FRAME_TYPE_CONFIG = 0x06,   // node parameters, see iaq/param.h; from the
+                                // host: iid[8] | parameters to change
+};
 
+#define RECORD_HEADER_SIZE 14
+#define RECORD_RSS_NONE 127
 #define TEXTBUFFER_SIZE 256
-char myText[TEXTBUFFER_SIZE];
-uint16_t myText_length = 0;
+#define UART_TX_BUF_SIZE (RECORD_HEADER_SIZE + TEXTBUFFER_SIZE + FRAME_OVERHEAD)
+#define UART_TX_RING_LEN 4
+
+// Ring of TX buffers: the forwarding thread fills slots at tx_head, the
+// UART_TX_DONE callback retires them at tx_tail and starts the next one.
+struct uart_tx_slot {
+    uint16_t length;
+    uint8_t buf[UART_TX_BUF_SIZE];
+};
+
+static struct uart_tx_slot tx_ring[UART_TX_RING_LEN];
+static uint8_t tx_head;
+static uint8_t tx_tail;
+static uint8_t tx_pending;
+static bool tx_busy;
+static struct k_spinlock tx_lock;
+
+// Counts free slots; the forwarding thread blocks here when the UART falls behind.
+static K_SEM_DEFINE(tx_free_sem, UART_TX_RING_LEN, UART_TX_RING_LEN);
+
+// Bridge statistics, see the "bridge stats" shell command.
+static uint32_t uart_tx_sent;
+static uint32_t uart_tx_failed;
+static uint8_t uart_tx_pending_max;
+static uint32_t uart_rx_frames;
+static uint32_t uart_rx_errors;
+
+// Double-buffered async RX of the frames sent by the host, parsed byte by
+// byte in the UART callback by frame_rx_byte().
+#define UART_RX_BUF_SIZE 32
+#define UART_RX_TIMEOUT_US 10000
+#define RX_FRAME_MAX_PAYLOAD (8 + IAQ_PARAM_MAX_SIZE)
+
+static uint8_t uart_rx_bufs[2][UART_RX_BUF_SIZE];
+static uint8_t uart_rx_next;
+static uint8_t rx_frame[FRAME_OVERHEAD + RX_FRAME_MAX_PAYLOAD];
+static uint16_t rx_frame_length;
+
+
+// Wall Clock
+
+// UNIX time from the host, served to the nodes on IAQ_TIME_URI_PATH.
+// epoch = uptime + epoch_offset_ms once set.
+static int64_t epoch_offset_ms;
+static int64_t epoch_set_ms;    // uptime of the last update
+static bool epoch_valid;
+static struct k_spinlock epoch_lock;
+
+
+// Ingest Pipeline Configuration
+
+// Room for a full batch of the smallest reports a node logs, a sequence
+// number and nothing else, plus the node table entry sent after it.
+#define INGEST_MIN_REPORT_SIZE (1 + IAQ_REPORT_HEADER_SIZE + IAQ_REPORT_FIELD_SIZE)
+#define INGEST_QUEUE_LEN (CONFIG_IAQ_UPLINK_BUFFER_SIZE / INGEST_MIN_REPORT_SIZE + 1)
+#define FORWARD_THREAD_STACK_SIZE 2048
+#define FORWARD_THREAD_PRIORITY 7
+
+// One CoAP payload, copied out of the OpenThread message buffer, with the
+// node it came from.
+struct ingest_msg {
+    uint16_t length;
+    enum frame_type type;
+    uint8_t iid[8];
+    uint32_t rx_ms;
+    int8_t rss;
+    char payload[TEXTBUFFER_SIZE];
+};
+
+K_MSGQ_DEFINE(ingest_msgq, sizeof(struct ingest_msg), INGEST_QUEUE_LEN, 4);
+K_THREAD_STACK_DEFINE(forward_thread_stack, FORWARD_THREAD_STACK_SIZE);
+static struct k_thread forward_thread_data;
+
+// Never given; main() parks on it once the pipeline is running.
+static K_SEM_DEFINE(main_sem, 0, 1);
+
+static uint32_t ingest_queued;
+static uint32_t ingest_dropped;
+static uint32_t ingest_rejected;    // batches answered 5.03, the node resends
+static uint32_t ingest_malformed;
+static uint32_t ingest_oversize;    // payloads longer than TEXTBUFFER_SIZE
+
+// Reassembly buffer for block-wise (RFC 7959) batches, and the payload of
+// plain requests. Only touched from the OpenThread context.
+#define RX_BUFFER_SIZE 1024
+static uint8_t rx_buf[RX_BUFFER_SIZE];
+static uint32_t rx_block_length;
+
+
+// Node Table
+
+// Nodes are told apart by the interface identifier of their mesh-local
+// address. Every node heard from gets an entry, the one heard from least
+// recently is recycled once the table is full.
+//
+// Reports carry the IAQ_FIELD_SEQUENCE of their node's store-and-forward
+// log. Nodes sending non-confirmable batches rely on the server to notice
+// missing reports: every node gets a window of the IAQ_ACK_WINDOW sequence
+// numbers following the last one received in order, the same window that
+// goes back to the node in a selective acknowledgement (IAQ_ACK_CONTENT_FORMAT).
+// The numbers count in the IAQ_FIELD_EPOCH of the log, the window starts over
+// when a batch arrives with another one.
+#define NODE_TABLE_LEN 32
+// A sequence number this far behind means the node lost its log, for nodes
+// that send no epoch
+#define SEQ_RESTART_DISTANCE 4096
+#define ACK_URI_PATH "sensor_ack"
+
+struct node_link {
+    uint8_t iid[8];
+    bool used;
+    bool synced;
+    bool observed;          // registered as observer of its parameters
+    int8_t rss;             // of the last request, dBm
+    int64_t last_seen_ms;
+    uint32_t messages;      // CoAP requests
+    uint32_t bytes;         // payload bytes
+    uint32_t epoch;         // of the node's log, 0 until one is received
+    uint32_t cum_seq;       // every report up to this one was received
+    uint32_t window;        // bit i: cum_seq + 1 + i was received
+    uint32_t received;
+    uint32_t duplicates;    // resent reports that had arrived already
+    uint32_t gaps;          // sequence numbers found missing
+    uint32_t lost;          // missing ones given up to move the window
+};
+
+// Only touched from the OpenThread context, the shell reads it unlocked.
+static struct node_link node_links[NODE_TABLE_LEN];
+
+
+// COAP Server Implenentation
 
 static void storedata_request_cb(void *p_context, otMessage *p_message, 
     const otMessageInfo *p_message_info);
-static void storedata_response_send(otMessage *p_request_message, 
+static void storedata_response_send(otMessage *p_request_message,
+    const otMessageInfo *p_message_info, const struct node_link *link, otCoapCode code);
+static otError storedata_receive_hook(void *p_context, const uint8_t *p_block,
+    uint32_t position, uint16_t block_length, bool more, uint32_t total_length);
+
+static void time_request_cb(void *p_context, otMessage *p_message,
     const otMessageInfo *p_message_info);
 
-static otCoapResource m_storedata_resource = {
+static otCoapResource m_time_resource = {
+    .mUriPath = IAQ_TIME_URI_PATH,
+    .mHandler = time_request_cb,
+    .mContext = NULL,
+    .mNext = NULL
+};
+
+static otCoapBlockwiseResource m_storedata_resource = {
     .mUriPath = "sensor_data",
     .mHandler = storedata_request_cb,
+    .mReceiveHook = storedata_receive_hook,
+    .mTransmitHook = NULL,
     .mContext = NULL,
     .mNext = NULL
 };
 
 
+// Returns the Content-Format option of a request, text/plain if absent.
+static uint64_t message_content_format(const otMessage *p_message) {
+    otCoapOptionIterator iterator;
+    uint64_t format = OT_COAP_OPTION_CONTENT_FORMAT_TEXT_PLAIN;
+
+    if (otCoapOptionIteratorInit(&iterator, p_message) == OT_ERROR_NONE &&
+        otCoapOptionIteratorGetFirstMatchingOption(&iterator,
+            OT_COAP_OPTION_CONTENT_FORMAT) != NULL) {
+        otCoapOptionIteratorGetOptionUintValue(&iterator, &format);
+    }
+    return format;
+}
+
+// Returns true if the request is the last block of a Block1 transfer.
+static bool message_has_block1(const otMessage *p_message) {
+    otCoapOptionIterator iterator;
+
+    return otCoapOptionIteratorInit(&iterator, p_message) == OT_ERROR_NONE &&
+        otCoapOptionIteratorGetFirstMatchingOption(&iterator,
+            OT_COAP_OPTION_BLOCK1) != NULL;
+}
+
+// Collects the blocks of a block-wise batch into rx_buf.
+static otError storedata_receive_hook(void *p_context, const uint8_t *p_block,
+    uint32_t position, uint16_t block_length, bool more, uint32_t total_length) {
+    if (position == 0) {
+        rx_block_length = 0;
+    }
+
+    // Blocks of another transfer interleaved with ours, or an oversized batch.
+    if (position != rx_block_length || position + block_length > sizeof(rx_buf)) {
+        rx_block_length = 0;
+        ingest_malformed++;
+        return OT_ERROR_NO_BUFS;
+    }
+
+    memcpy(&rx_buf[position], p_block, block_length);
+    rx_block_length += block_length;
+    return OT_ERROR_NONE;
+}
+
+// Queues one payload for the forwarding thread without blocking OpenThread.
+static void ingest_payload(const struct node_link *link, const uint8_t *payload,
+    uint16_t length, enum frame_type type) {
+    struct ingest_msg msg;
+
+    // Cut short, it would only reach the host as an invalid record
+    if (length > TEXTBUFFER_SIZE) {
+        ingest_oversize++;
+        printk("Payload of %u bytes too long, dropped\n", length);
+        return;
+    }
+
+    msg.length = length;
+    msg.type = type;
+    memcpy(msg.iid, link->iid, sizeof(msg.iid));
+    msg.rx_ms = (uint32_t)link->last_seen_ms;
+    msg.rss = link->rss;
+    memcpy(msg.payload, payload, msg.length);
+
+    if (k_msgq_put(&ingest_msgq, &msg, K_NO_WAIT) == 0) {
+        ingest_queued++;
+    } else {
+        ingest_dropped++;
+        printk("Ingest queue full, dropped packet (%u total)\n", ingest_dropped);
+    }
+}
+
+// Returns the entry of a node, NULL if it is not in the table.
+static struct node_link *node_link_find(const uint8_t *iid) {
+    for (size_t i = 0; i < NODE_TABLE_LEN; i++) {
+        if (node_links[i].used && memcmp(node_links[i].iid, iid, 8) == 0) {
+            return &node_links[i];
+        }
+    }
+    return NULL;
+}
+
+// Returns the entry of the node a request came from, recycling the one
+// heard from least recently for a new node, and records the request.
+static struct node_link *node_link_get(const otMessage *p_message,
+    const otMessageInfo *p_message_info) {
+    const uint8_t *iid = &p_message_info->mPeerAddr.mFields.m8[8];
+    struct node_link *link = node_link_find(iid);
+    struct node_link *oldest = &node_links[0];
+
+    if (link == NULL) {
+        for (size_t i = 1; i < NODE_TABLE_LEN && oldest->used; i++) {
+            if (!node_links[i].used || node_links[i].last_seen_ms < oldest->last_seen_ms) {
+                oldest = &node_links[i];
+            }
+        }
+        link = oldest;
+        memset(link, 0, sizeof(*link));
+        memcpy(link->iid, iid, 8);
+        link->used = true;
+    }
+
+    link->last_seen_ms = k_uptime_get();
+    link->rss = otMessageGetRss(p_message);
+    link->messages++;
+    return link;
+}
+
+// Finds a field of a binary report, such as its IAQ_FIELD_SEQUENCE.
+static bool report_field(const uint8_t *report, uint8_t length, uint8_t tag, uint32_t *value) {
+    for (uint8_t i = IAQ_REPORT_HEADER_SIZE; i + IAQ_REPORT_FIELD_SIZE <= length;
+        i += IAQ_REPORT_FIELD_SIZE) {
+        if (report[i] == tag) {
+            *value = sys_get_be32(&report[i + 1]);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Records a report in its node's window. Returns false for a duplicate,
+// which is not forwarded again.
+static bool node_link_accept(struct node_link *link, const uint8_t *report, uint8_t length) {
+    uint32_t seq, epoch, offset, highest;
+
+    if (!report_field(report, length, IAQ_FIELD_SEQUENCE, &seq)) {
+        return true;
+    }
+
+    if (report_field(report, length, IAQ_FIELD_EPOCH, &epoch) && epoch != link->epoch) {
+        // The node's log started over, whatever its sequence numbers
+        link->epoch = epoch;
+        link->synced = false;
+    }
+
+    if (!link->synced || (seq <= link->cum_seq && link->cum_seq - seq > SEQ_RESTART_DISTANCE)) {
+        // First report heard from this node, or its log started over
+        link->synced = true;
+        link->cum_seq = seq;
+        link->window = 0;
+        link->received++;
+        return true;
+    }
+
+    offset = seq - link->cum_seq - 1;
+    if (seq <= link->cum_seq || (offset < IAQ_ACK_WINDOW && (link->window & BIT(offset)))) {
+        link->duplicates++;
+        return false;
+    }
+
+    // Everything between the newest report so far and this one is missing
+    highest = link->cum_seq + (link->window ? 32 - __builtin_clz(link->window) : 0);
+    if (seq > highest + 1) {
+        link->gaps += seq - highest - 1;
+    }
+
+    if (offset >= IAQ_ACK_WINDOW) {
+        // Too far ahead to keep waiting for the missing ones
+        link->lost += offset - __builtin_popcount(link->window);
+        link->cum_seq = seq;
+        link->window = 0;
+    } else {
+        link->window |= BIT(offset);
+        while (link->window & 1) {
+            link->cum_seq++;
+            link->window >>= 1;
+        }
+    }
+    link->received++;
+    return true;
+}
+
+// Selective acknowledgement of a node, see IAQ_ACK_CONTENT_FORMAT.
+static void node_link_ack_encode(const struct node_link *link, uint8_t *ack) {
+    sys_put_be32(link->cum_seq, &ack[0]);
+    sys_put_be32(link->window, &ack[4]);
+    sys_put_be32(link->epoch, &ack[8]);
+}
+
+// Forwards the entry of a node to the host, decoded by
+// data_visualization/serial_frames.py. Little-endian like the frame header:
+//   iid[8] | cum_seq | received | duplicates | gaps | lost | missing |
+//   messages | bytes | RSS dBm (int8)
+static void node_link_forward(const struct node_link *link) {
+    uint8_t frame[8 + 8 * 4 + 1];
+    // Sequence numbers after cum_seq up to the newest report received
+    uint32_t span = link->window ? 32 - __builtin_clz(link->window) : 0;
+
+    memcpy(frame, link->iid, 8);
+    sys_put_le32(link->cum_seq, &frame[8]);
+    sys_put_le32(link->received, &frame[12]);
+    sys_put_le32(link->duplicates, &frame[16]);
+    sys_put_le32(link->gaps, &frame[20]);
+    sys_put_le32(link->lost, &frame[24]);
+    // Still waiting for these
+    sys_put_le32(span - __builtin_popcount(link->window), &frame[28]);
+    sys_put_le32(link->messages, &frame[32]);
+    sys_put_le32(link->bytes, &frame[36]);
+    frame[40] = (uint8_t)link->rss;
+    ingest_payload(link, frame, sizeof(frame), FRAME_TYPE_LINK);
+}
+
+// Reports missing sequence numbers to a node that sent a non-confirmable
+// batch, so it resends them without waiting for its next confirmable one.
+static void node_link_ack_send(const struct node_link *link, const otMessageInfo *p_message_info) {
+    otError error = OT_ERROR_NO_BUFS;
+    otInstance *p_instance = openthread_get_default_instance();
+    otMessage *p_message;
+    otMessageInfo message_info;
+    uint8_t ack[IAQ_ACK_SIZE];
+
+    p_message = otCoapNewMessage(p_instance, NULL);
+    if (p_message == NULL) {
+        printk("Failed to allocate message for CoAP ack\n");
+        return;
+    }
+
+    node_link_ack_encode(link, ack);
+    otCoapMessageInit(p_message, OT_COAP_TYPE_NON_CONFIRMABLE, OT_COAP_CODE_PUT);
+    otCoapMessageGenerateToken(p_message, OT_COAP_DEFAULT_TOKEN_LENGTH);
+
+    do {
+        error = otCoapMessageAppendUriPathOptions(p_message, ACK_URI_PATH);
+        if (error != OT_ERROR_NONE) { break; }
+
+        error = otCoapMessageAppendUintOption(p_message, OT_COAP_OPTION_CONTENT_FORMAT,
+            IAQ_ACK_CONTENT_FORMAT);
+        if (error != OT_ERROR_NONE) { break; }
+
+        error = otCoapMessageSetPayloadMarker(p_message);
+        if (error != OT_ERROR_NONE) { break; }
+
+        error = otMessageAppend(p_message, ack, sizeof(ack));
+        if (error != OT_ERROR_NONE) { break; }
+
+        memset(&message_info, 0, sizeof(message_info));
+        message_info.mPeerAddr = p_message_info->mPeerAddr;
+        message_info.mPeerPort = OT_DEFAULT_COAP_PORT;
+        error = otCoapSendRequest(p_instance, p_message, &message_info, NULL, NULL);
+    } while (false);
+
+    if (error != OT_ERROR_NONE) {
+        printk("Failed to send CoAP ack: %d\n", error);
+        otMessageFree(p_message);
+    }
+}
+
+// Node Configuration
+
+// The server observes the parameters of every node it hears from and
+// forwards them to the host on every change. The host changes them through
+// FRAME_TYPE_CONFIG frames, queued for a work item that relays them to
+// their node as a PUT. A change that finds the queue full, or that its node
+// does not accept, goes back to the host as a {"config_error": ...} text
+// record of that node.
+#define NODE_CONFIG_QUEUE_LEN 4
+
+struct node_config_change {
+    uint16_t length;
+    uint8_t buf[RX_FRAME_MAX_PAYLOAD];  // iid[8] | parameters to change
+};
+
+K_MSGQ_DEFINE(node_config_msgq, sizeof(struct node_config_change), NODE_CONFIG_QUEUE_LEN, 4);
+
+// Tells the host a change of the parameters of a node failed. Called from
+// the UART callback and the OpenThread context.
+static void node_config_error(const uint8_t *iid, const char *reason) {
+    struct ingest_msg msg;
+
+    msg.length = snprintf(msg.payload, sizeof(msg.payload), "{\"config_error\": \"%s\"}",
+        reason);
+    msg.type = FRAME_TYPE_TEXT;
+    memcpy(msg.iid, iid, sizeof(msg.iid));
+    msg.rx_ms = k_uptime_get_32();
+    msg.rss = RECORD_RSS_NONE;
+
+    if (k_msgq_put(&ingest_msgq, &msg, K_NO_WAIT) != 0) {
+        printk("Node config error not forwarded: %s\n", reason);
+    }
+}
+
+// Runs in the OpenThread context for the response and every notification.
+static void node_config_response_cb(void *p_context, otMessage *p_message,
+    const otMessageInfo *p_message_info, otError result) {
+    struct node_link *link = node_link_find(&p_message_info->mPeerAddr.mFields.m8[8]);
+    uint8_t payload[IAQ_PARAM_MAX_SIZE];
+    uint16_t length;
+
+    if (link == NULL) {
+        return;
+    }
+    if (result != OT_ERROR_NONE) {
+        // Try again on the next request of the node
+        link->observed = false;
+        return;
+    }
+    // Nodes without runtime parameters answer 4.04, left alone
+    if (otCoapMessageGetCode(p_message) != OT_COAP_CODE_CONTENT) {
+        return;
+    }
+
+    length = otMessageRead(p_message, otMessageGetOffset(p_message), payload,
+        sizeof(payload));
+    ingest_payload(link, payload, length, FRAME_TYPE_CONFIG);
+}
+
+// Registers as observer of the parameters of a node (RFC 7641).
+static void node_config_observe(struct node_link *link, const otMessageInfo *p_message_info) {
+    otError error = OT_ERROR_NO_BUFS;
+    otInstance *p_instance = openthread_get_default_instance();
+    otMessage *p_message;
+    otMessageInfo message_info;
+
+    p_message = otCoapNewMessage(p_instance, NULL);
+    if (p_message == NULL) {
+        return;
+    }
+
+    otCoapMessageInit(p_message, OT_COAP_TYPE_CONFIRMABLE, OT_COAP_CODE_GET);
+    otCoapMessageGenerateToken(p_message, OT_COAP_DEFAULT_TOKEN_LENGTH);
+
+    do {
+        error = otCoapMessageAppendObserveOption(p_message, 0);
+        if (error != OT_ERROR_NONE) { break; }
+
+        error = otCoapMessageAppendUriPathOptions(p_message, IAQ_CONFIG_URI_PATH);
+        if (error != OT_ERROR_NONE) { break; }
+
+        memset(&message_info, 0, sizeof(message_info));
+        message_info.mPeerAddr = p_message_info->mPeerAddr;
+        message_info.mPeerPort = OT_DEFAULT_COAP_PORT;
+        error = otCoapSendRequest(p_instance, p_message, &message_info,
+            node_config_response_cb, NULL);
+    } while (false);
+
+    if (error != OT_ERROR_NONE) {
+        printk("Failed to observe node config: %d\n", error);
+        otMessageFree(p_message);
+        return;
+    }
+    link->observed = true;
+}
+
+// p_context is the node table entry of the node the change went to.
+static void node_config_put_cb(void *p_context, otMessage *p_message,
+    const otMessageInfo *p_message_info, otError result) {
+    const struct node_link *link = p_context;
+    const char *reason = NULL;
+
+    if (result != OT_ERROR_NONE) {
+        printk("Node config not delivered: %d\n", result);
+        reason = "not delivered";
+    } else if (otCoapMessageGetCode(p_message) != OT_COAP_CODE_CHANGED) {
+        printk("Node config rejected: %u\n", otCoapMessageGetCode(p_message));
+        reason = "rejected by the node";
+    }
+    // Accepted changes come back as a notification
+    if (reason != NULL && link != NULL) {
+        node_config_error(link->iid, reason);
+    }
+}
+
+// Sends one change the host wants made to its node.
+static void node_config_put(const struct node_config_change *change) {
+    struct openthread_context *ot_context = openthread_get_default_context();
+    otInstance *p_instance = openthread_get_default_instance();
+    otError error = OT_ERROR_NO_BUFS;
+    otMessage *p_message;
+    otMessageInfo message_info;
+
+    openthread_api_mutex_lock(ot_context);
+
+    p_message = otCoapNewMessage(p_instance, NULL);
+    if (p_message != NULL) {
+        otCoapMessageInit(p_message, OT_COAP_TYPE_CONFIRMABLE, OT_COAP_CODE_PUT);
+        otCoapMessageGenerateToken(p_message, OT_COAP_DEFAULT_TOKEN_LENGTH);
+
+        do {
+            error = otCoapMessageAppendUriPathOptions(p_message, IAQ_CONFIG_URI_PATH);
+            if (error != OT_ERROR_NONE) { break; }
+
+            error = otCoapMessageAppendUintOption(p_message, OT_COAP_OPTION_CONTENT_FORMAT,
+                IAQ_CONFIG_CONTENT_FORMAT);
+            if (error != OT_ERROR_NONE) { break; }
+
+            error = otCoapMessageSetPayloadMarker(p_message);
+            if (error != OT_ERROR_NONE) { break; }
+
+            error = otMessageAppend(p_message, &change->buf[8], change->length - 8);
+            if (error != OT_ERROR_NONE) { break; }
+
+            // Nodes live at <mesh local prefix>:<iid>
+            memset(&message_info, 0, sizeof(message_info));
+            memcpy(&message_info.mPeerAddr.mFields.m8[0], otThreadGetMeshLocalPrefix(p_instance), 8);
+            memcpy(&message_info.mPeerAddr.mFields.m8[8], change->buf, 8);
+            message_info.mPeerPort = OT_DEFAULT_COAP_PORT;
+            error = otCoapSendRequest(p_instance, p_message, &message_info,
+                node_config_put_cb, node_link_find(change->buf));
+        } while (false);
+
+        if (error != OT_ERROR_NONE) {
+            otMessageFree(p_message);
+        }
+    }
+
+    if (error != OT_ERROR_NONE) {
+        printk("Failed to send node config: %d\n", error);
+        node_config_error(change->buf, "not sent");
+    }
+
+    openthread_api_mutex_unlock(ot_context);
+}
+
+static void node_config_put_work_handler(struct k_work *work) {
+    struct node_config_change change;
+
+    while (k_msgq_get(&node_config_msgq, &change, K_NO_WAIT) == 0) {
+        node_config_put(&change);
+    }
+}
+
+static K_WORK_DEFINE(node_config_put_work, node_config_put_work_handler);
+
+// Counts the reports of a batch, up to the first malformed one.
+static uint32_t batch_reports(const uint8_t *batch, uint32_t length) {
+    uint32_t offset = 0;
+    uint32_t reports = 0;
+
+    while (offset < length && batch[offset] != 0 && offset + 1 + batch[offset] <= length) {
+        offset += 1 + batch[offset];
+        reports++;
+    }
+    return reports;
+}
+
+// Splits a batch of length-prefixed reports, see IAQ_BATCH_CONTENT_FORMAT.
+static void ingest_batch(const uint8_t *batch, uint32_t length, struct node_link *link) {
+    uint32_t offset = 0;
+
+    while (offset < length) {
+        uint8_t report_length = batch[offset++];
+
+        if (report_length == 0 || offset + report_length > length) {
+            ingest_malformed++;
+            printk("Malformed batch at offset %u\n", offset - 1);
+            return;
+        }
+        if (node_link_accept(link, &batch[offset], report_length)) {
+            ingest_payload(link, &batch[offset], report_length, FRAME_TYPE_REPORT);
+        }
+        offset += report_length;
+    }
+}
+
 // Handles incoming PUT requests to the "storedata" resource.
 static void storedata_request_cb(void *p_context, otMessage *p_message, 
     const otMessageInfo *p_message_info) {
@@ -48,21 +674,70 @@ static void storedata_request_cb(void *p_context, otMessage *p_message,
             break;
         }
 
-        myText_length = otMessageRead(p_message, otMessageGetOffset(p_message),
-            myText, TEXTBUFFER_SIZE - 1);
-        myText[myText_length] = '\0';
-        printk("\nReceived: %s\n", myText);
-        tx_buf_length = sprintf(tx_buf, myText);
-        uart_tx(uart_dev, tx_buf, tx_buf_length, SYS_FOREVER_US);
+        uint64_t format = message_content_format(p_message);
+        struct node_link *link = node_link_get(p_message, p_message_info);
+        uint32_t length;
+
+        if (message_has_block1(p_message)) {
+            // The receive hook already reassembled every block.
+            length = rx_block_length;
+            rx_block_length = 0;
+        } else {
+            length = otMessageRead(p_message, otMessageGetOffset(p_message),
+                rx_buf, sizeof(rx_buf));
+        }
+
+        if (!link->observed) {
+            node_config_observe(link, p_message_info);
+        }
+
+        // Batches are split into reports, anything else is forwarded whole
+        if (format != IAQ_BATCH_CONTENT_FORMAT && length > TEXTBUFFER_SIZE) {
+            ingest_oversize++;
+            printk("Payload of %u bytes too long, rejected\n", length);
+            if (messageType == OT_COAP_TYPE_CONFIRMABLE) {
+                storedata_response_send(p_message, p_message_info, link,
+                    OT_COAP_CODE_REQUEST_TOO_LARGE);
+            }
+            break;
+        }
+
+        // Reports enter the window of the node only once queued for the
+        // host: without room for all of them, and the node table entry,
+        // the node keeps the batch and sends it again.
+        if (k_msgq_num_free_get(&ingest_msgq) <
+            (format == IAQ_BATCH_CONTENT_FORMAT ? batch_reports(rx_buf, length) : 1) + 1) {
+            ingest_rejected++;
+            printk("Ingest queue full, rejected request (%u total)\n", ingest_rejected);
+            if (messageType == OT_COAP_TYPE_CONFIRMABLE) {
+                storedata_response_send(p_message, p_message_info, link,
+                    OT_COAP_CODE_SERVICE_UNAVAILABLE);
+            }
+            break;
+        }
+
+        link->bytes += length;
+        if (format == IAQ_BATCH_CONTENT_FORMAT) {
+            ingest_batch(rx_buf, length, link);
+        } else {
+            ingest_payload(link, rx_buf, length, format == IAQ_REPORT_CONTENT_FORMAT ?
+                FRAME_TYPE_REPORT : FRAME_TYPE_TEXT);
+        }
+        node_link_forward(link);
+
         if (messageType == OT_COAP_TYPE_CONFIRMABLE) {
-            storedata_response_send(p_message, p_message_info);
+            storedata_response_send(p_message, p_message_info, link, OT_COAP_CODE_CHANGED);
+        } else if (link->window != 0) {
+            // Something is missing before the newest report
+            node_link_ack_send(link, p_message_info);
         }
     } while (false);
 }
 
-// Sends acknowledgment for confirmable messages.
-static void storedata_response_send(otMessage *p_request_message, 
-    const otMessageInfo *p_message_info) {
+// Sends acknowledgment for confirmable messages, carrying the selective
+// acknowledgement of the node for accepted batches.
+static void storedata_response_send(otMessage *p_request_message,
+    const otMessageInfo *p_message_info, const struct node_link *link, otCoapCode code) {
     otError error = OT_ERROR_NO_BUFS;
     otMessage *p_response;
     otInstance *p_instance = openthread_get_default_instance();
@@ -75,9 +750,24 @@ static void storedata_response_send(otMessage *p_request_message,
 
     do {
         error = otCoapMessageInitResponse(p_response, p_request_message,
-            OT_COAP_TYPE_ACKNOWLEDGMENT, OT_COAP_CODE_CHANGED);
+            OT_COAP_TYPE_ACKNOWLEDGMENT, code);
         if (error != OT_ERROR_NONE) { break; }
 
+        if (code == OT_COAP_CODE_CHANGED && link->synced) {
+            uint8_t ack[IAQ_ACK_SIZE];
+
+            node_link_ack_encode(link, ack);
+            error = otCoapMessageAppendUintOption(p_response, OT_COAP_OPTION_CONTENT_FORMAT,
+                IAQ_ACK_CONTENT_FORMAT);
+            if (error != OT_ERROR_NONE) { break; }
+
+            error = otCoapMessageSetPayloadMarker(p_response);
+            if (error != OT_ERROR_NONE) { break; }
+
+            error = otMessageAppend(p_response, ack, sizeof(ack));
+            if (error != OT_ERROR_NONE) { break; }
+        }
+
         error = otCoapSendResponse(p_instance, p_response, p_message_info);
     } while (false);
 
@@ -87,6 +777,342 @@ static void storedata_response_send(otMessage *p_request_message,
     }
 }
 
+static void epoch_set(int64_t epoch_ms) {
+    k_spinlock_key_t key = k_spin_lock(&epoch_lock);
+
+    epoch_set_ms = k_uptime_get();
+    epoch_offset_ms = epoch_ms - epoch_set_ms;
+    epoch_valid = true;
+    k_spin_unlock(&epoch_lock, key);
+}
+
+// Returns false until the host sent the time. age_ms, if not NULL, gets the
+// time since the host last sent it, read under the same lock.
+static bool epoch_get(int64_t *epoch_ms, int64_t *age_ms) {
+    k_spinlock_key_t key = k_spin_lock(&epoch_lock);
+    bool valid = epoch_valid;
+    int64_t now = k_uptime_get();
+
+    *epoch_ms = now + epoch_offset_ms;
+    if (age_ms != NULL) {
+        *age_ms = now - epoch_set_ms;
+    }
+    k_spin_unlock(&epoch_lock, key);
+    return valid;
+}
+
+// Answers GET requests on the "time" resource with the UNIX time in ms,
+// see IAQ_TIME_CONTENT_FORMAT, or 5.03 until the host sent the time.
+static void time_request_cb(void *p_context, otMessage *p_message,
+    const otMessageInfo *p_message_info) {
+    otError error = OT_ERROR_NO_BUFS;
+    otInstance *p_instance = openthread_get_default_instance();
+    otCoapType messageType = otCoapMessageGetType(p_message);
+    otMessage *p_response;
+    uint8_t payload[IAQ_TIME_SIZE];
+    int64_t epoch_ms;
+    bool valid;
+
+    if (otCoapMessageGetCode(p_message) != OT_COAP_CODE_GET ||
+        (messageType != OT_COAP_TYPE_CONFIRMABLE &&
+         messageType != OT_COAP_TYPE_NON_CONFIRMABLE)) {
+        return;
+    }
+
+    p_response = otCoapNewMessage(p_instance, NULL);
+    if (p_response == NULL) {
+        printk("Failed to allocate message for CoAP time\n");
+        return;
+    }
+
+    // Read as late as possible, the node assumes halfway through the round trip
+    valid = epoch_get(&epoch_ms, NULL);
+
+    do {
+        error = otCoapMessageInitResponse(p_response, p_message,
+            messageType == OT_COAP_TYPE_CONFIRMABLE ? OT_COAP_TYPE_ACKNOWLEDGMENT :
+            OT_COAP_TYPE_NON_CONFIRMABLE,
+            valid ? OT_COAP_CODE_CONTENT : OT_COAP_CODE_SERVICE_UNAVAILABLE);
+        if (error != OT_ERROR_NONE) { break; }
+
+        if (valid) {
+            sys_put_be64((uint64_t)epoch_ms, payload);
+            error = otCoapMessageAppendUintOption(p_response, OT_COAP_OPTION_CONTENT_FORMAT,
+                IAQ_TIME_CONTENT_FORMAT);
+            if (error != OT_ERROR_NONE) { break; }
+
+            error = otCoapMessageSetPayloadMarker(p_response);
+            if (error != OT_ERROR_NONE) { break; }
+
+            error = otMessageAppend(p_response, payload, sizeof(payload));
+            if (error != OT_ERROR_NONE) { break; }
+        }
+
+        error = otCoapSendResponse(p_instance, p_response, p_message_info);
+    } while (false);
+
+    if (error != OT_ERROR_NONE) {
+        printk("Failed to send time response: %d\n", error);
+        otMessageFree(p_response);
+    }
+}
+
+// Starts transmitting the slot at tx_tail. Must be called with tx_lock held.
+static void uart_tx_start_locked(void) {
+    while (tx_pending > 0) {
+        struct uart_tx_slot *slot = &tx_ring[tx_tail];
+
+        if (uart_tx(uart_dev, slot->buf, slot->length, SYS_FOREVER_US) == 0) {
+            tx_busy = true;
+            return;
+        }
+
+        // Drop the slot rather than stall the ring on a driver error.
+        uart_tx_failed++;
+        tx_tail = (tx_tail + 1) % UART_TX_RING_LEN;
+        tx_pending--;
+        k_sem_give(&tx_free_sem);
+    }
+    tx_busy = false;
+}
+
+// Handles a frame received from the host.
+static void frame_rx_dispatch(uint8_t type, const uint8_t *payload, uint16_t length) {
+    if (type == FRAME_TYPE_TIME && length == sizeof(int64_t)) {
+        epoch_set((int64_t)sys_get_le64(payload));
+        uart_rx_frames++;
+    } else if (type == FRAME_TYPE_CONFIG && length > 8) {
+        struct node_config_change change = { .length = length };
+
+        memcpy(change.buf, payload, length);
+        if (k_msgq_put(&node_config_msgq, &change, K_NO_WAIT) == 0) {
+            k_work_submit(&node_config_put_work);
+        } else {
+            node_config_error(payload, "too many pending changes");
+        }
+        uart_rx_frames++;
+    } else {
+        uart_rx_errors++;
+    }
+}
+
+// Collects one frame from the host, same layout and CRC as frame_encode().
+// Runs in the UART callback; bytes before a SOF are skipped.
+static void frame_rx_byte(uint8_t byte) {
+    uint16_t length;
+
+    if (rx_frame_length == 0 && byte != FRAME_SOF_0) {
+        return;
+    }
+    if (rx_frame_length == 1 && byte != FRAME_SOF_1) {
+        rx_frame_length = (byte == FRAME_SOF_0) ? 1 : 0;
+        return;
+    }
+
+    rx_frame[rx_frame_length++] = byte;
+    if (rx_frame_length < FRAME_HEADER_SIZE) {
+        return;
+    }
+
+    length = sys_get_le16(&rx_frame[3]);
+    if (length > RX_FRAME_MAX_PAYLOAD) {
+        uart_rx_errors++;
+        rx_frame_length = 0;
+        return;
+    }
+    if (rx_frame_length < FRAME_OVERHEAD + length) {
+        return;
+    }
+
+    if (crc16_itu_t(0xFFFF, &rx_frame[2], FRAME_HEADER_SIZE - 2 + length) ==
+        sys_get_be16(&rx_frame[FRAME_HEADER_SIZE + length])) {
+        frame_rx_dispatch(rx_frame[2], &rx_frame[FRAME_HEADER_SIZE], length);
+    } else {
+        uart_rx_errors++;
+    }
+    rx_frame_length = 0;
+}
+
+static int uart_rx_start(void) {
+    rx_frame_length = 0;
+    uart_rx_next = 1;
+    return uart_rx_enable(uart_dev, uart_rx_bufs[0], sizeof(uart_rx_bufs[0]),
+        UART_RX_TIMEOUT_US);
+}
+
+// Retires the finished slot and chains the next queued one, and feeds
+// received bytes to the frame parser.
+static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data) {
+    k_spinlock_key_t key;
+
+    switch (evt->type) {
+    case UART_RX_RDY:
+        for (size_t i = 0; i < evt->data.rx.len; i++) {
+            frame_rx_byte(evt->data.rx.buf[evt->data.rx.offset + i]);
+        }
+        break;
+    case UART_RX_BUF_REQUEST:
+        uart_rx_buf_rsp(dev, uart_rx_bufs[uart_rx_next], sizeof(uart_rx_bufs[0]));
+        uart_rx_next ^= 1;
+        break;
+    case UART_RX_STOPPED:
+        uart_rx_errors++;
+        break;
+    case UART_RX_DISABLED:
+        // Stopped by a line error, listen again
+        uart_rx_start();
+        break;
+    case UART_TX_DONE:
+    case UART_TX_ABORTED:
+        key = k_spin_lock(&tx_lock);
+        if (evt->type == UART_TX_DONE) {
+            uart_tx_sent++;
+        } else {
+            uart_tx_failed++;
+        }
+        tx_tail = (tx_tail + 1) % UART_TX_RING_LEN;
+        tx_pending--;
+        k_sem_give(&tx_free_sem);
+        uart_tx_start_locked();
+        k_spin_unlock(&tx_lock, key);
+        break;
+    default:
+        break;
+    }
+}
+
+// Copies one payload into the next free TX slot and kicks the UART if idle.
+static void uart_tx_enqueue(const uint8_t *data, uint16_t length) {
+    struct uart_tx_slot *slot;
+    k_spinlock_key_t key;
+
+    k_sem_take(&tx_free_sem, K_FOREVER);
+
+    // Only this thread advances tx_head, so the slot can be filled unlocked.
+    slot = &tx_ring[tx_head];
+    slot->length = MIN(length, UART_TX_BUF_SIZE);
+    memcpy(slot->buf, data, slot->length);
+
+    key = k_spin_lock(&tx_lock);
+    tx_head = (tx_head + 1) % UART_TX_RING_LEN;
+    tx_pending++;
+    uart_tx_pending_max = MAX(uart_tx_pending_max, tx_pending);
+    if (!tx_busy) {
+        uart_tx_start_locked();
+    }
+    k_spin_unlock(&tx_lock, key);
+}
+
+// Wraps a payload in a frame, returns the frame length.
+static size_t frame_encode(uint8_t *frame, enum frame_type type,
+    const uint8_t *payload, uint16_t length) {
+    uint16_t crc;
+
+    frame[0] = FRAME_SOF_0;
+    frame[1] = FRAME_SOF_1;
+    frame[2] = type;
+    sys_put_le16(length, &frame[3]);
+    memcpy(&frame[FRAME_HEADER_SIZE], payload, length);
+
+    crc = crc16_itu_t(0xFFFF, &frame[2], FRAME_HEADER_SIZE - 2 + length);
+    sys_put_be16(crc, &frame[FRAME_HEADER_SIZE + length]);
+
+    return FRAME_OVERHEAD + length;
+}
+
+// Drains the ingest queue and forwards each payload to the host over UART,
+// one CRC-protected frame per report, stamped with the node it came from.
+static void forward_thread(void *p1, void *p2, void *p3) {
+    struct ingest_msg msg;
+    uint8_t record[RECORD_HEADER_SIZE + TEXTBUFFER_SIZE];
+    uint8_t frame[UART_TX_BUF_SIZE];
+    size_t frame_length;
+
+    while (1) {
+        k_msgq_get(&ingest_msgq, &msg, K_FOREVER);
+
+        if (msg.type == FRAME_TYPE_LINK) {
+            frame_length = frame_encode(frame, msg.type,
+                (const uint8_t *)msg.payload, msg.length);
+            uart_tx_enqueue(frame, frame_length);
+            continue;
+        }
+
+        if (msg.type == FRAME_TYPE_TEXT) {
+            printk("\nReceived: %.*s\n", msg.length, msg.payload);
+        } else {
+            printk("\nReceived: %u byte %s from %02x%02x\n", msg.length,
+                msg.type == FRAME_TYPE_REPORT ? "report" : "config",
+                msg.iid[6], msg.iid[7]);
+        }
+
+        memcpy(record, msg.iid, sizeof(msg.iid));
+        sys_put_le32(msg.rx_ms, &record[8]);
+        record[12] = (uint8_t)msg.rss;
+        record[13] = msg.type;
+        memcpy(&record[RECORD_HEADER_SIZE], msg.payload, msg.length);
+
+        frame_length = frame_encode(frame, FRAME_TYPE_RECORD, record,
+            RECORD_HEADER_SIZE + msg.length);
+        uart_tx_enqueue(frame, frame_length);
+    }
+}
+
+static int cmd_bridge_stats(const struct shell *sh, size_t argc, char **argv) {
+    shell_print(sh, "ingest queued:    %u", ingest_queued);
+    shell_print(sh, "ingest dropped:   %u", ingest_dropped);
+    shell_print(sh, "ingest rejected:  %u", ingest_rejected);
+    shell_print(sh, "ingest malformed: %u", ingest_malformed);
+    shell_print(sh, "ingest oversize:  %u", ingest_oversize);
+    shell_print(sh, "ingest backlog:   %u", k_msgq_num_used_get(&ingest_msgq));
+    shell_print(sh, "uart sent:        %u", uart_tx_sent);
+    shell_print(sh, "uart failed:      %u", uart_tx_failed);
+    shell_print(sh, "uart pending:     %u (max %u of %u)", tx_pending,
+        uart_tx_pending_max, UART_TX_RING_LEN);
+    shell_print(sh, "uart received:    %u", uart_rx_frames);
+    shell_print(sh, "uart rx errors:   %u", uart_rx_errors);
+    return 0;
+}
+
+static int cmd_bridge_time(const struct shell *sh, size_t argc, char **argv) {
+    int64_t epoch_ms, age_ms;
+
+    if (!epoch_get(&epoch_ms, &age_ms)) {
+        shell_print(sh, "time not set by the host yet");
+        return 0;
+    }
+    shell_print(sh, "unix time: %lld.%03lld (set %lld s ago)", epoch_ms / MSEC_PER_SEC,
+        epoch_ms % MSEC_PER_SEC, age_ms / MSEC_PER_SEC);
+    return 0;
+}
+
+static int cmd_bridge_nodes(const struct shell *sh, size_t argc, char **argv) {
+    int64_t now = k_uptime_get();
+
+    shell_print(sh, "node              seen   rss  msgs     seq        received   dup    gaps   lost");
+    for (size_t i = 0; i < NODE_TABLE_LEN; i++) {
+        const struct node_link *link = &node_links[i];
+        const uint8_t *iid = link->iid;
+
+        if (!link->used) {
+            continue;
+        }
+        shell_print(sh, "%02x%02x%02x%02x%02x%02x%02x%02x  %-6lld %-4d %-8u %-10u %-10u %-6u %-6u %u",
+            iid[0], iid[1], iid[2], iid[3], iid[4], iid[5], iid[6], iid[7],
+            (now - link->last_seen_ms) / MSEC_PER_SEC, link->rss, link->messages,
+            link->cum_seq, link->received, link->duplicates, link->gaps, link->lost);
+    }
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_bridge,
+    SHELL_CMD(stats, NULL, "Show UART bridge counters", cmd_bridge_stats),
+    SHELL_CMD(nodes, NULL, "Show the node table", cmd_bridge_nodes),
+    SHELL_CMD(time, NULL, "Show the time served to the nodes", cmd_bridge_time),
+    SHELL_SUBCMD_SET_END
+);
+SHELL_CMD_REGISTER(bridge, &sub_bridge, "Border router UART bridge", NULL);
+
 // Assigns a fixed IPv6 address to the server (fdde:ad00:beef:0::1).
 void addIPv6Address(void) {
     otInstance *myInstance = openthread_get_default_instance();
@@ -111,7 +1137,8 @@ void coap_init(void) {
         error = otCoapStart(p_instance, OT_DEFAULT_COAP_PORT);
         if (error != OT_ERROR_NONE) { break; }
 
-        otCoapAddResource(p_instance, &m_storedata_resource);
+        otCoapAddBlockWiseResource(p_instance, &m_storedata_resource);
+        otCoapAddResource(p_instance, &m_time_resource);
     } while(false);
 
     if (error == OT_ERROR_NONE) {
@@ -122,15 +1149,25 @@ void coap_init(void) {
 }
 
 int main(void) {
-    addIPv6Address();
-    coap_init();
     if (!device_is_ready(uart_dev)) {
         printk("UART device not ready\n");
         return -1;
     }
-    printk("UART device is ready\n");
-    
-    while (1) {
-       
+    uart_callback_set(uart_dev, uart_cb, NULL);
+    if (uart_rx_start() != 0) {
+        printk("UART RX not started, nodes will get no time\n");
     }
+    printk("UART device is ready\n");
+
+    k_thread_create(&forward_thread_data, forward_thread_stack,
+        K_THREAD_STACK_SIZEOF(forward_thread_stack), forward_thread,
+        NULL, NULL, NULL, FORWARD_THREAD_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&forward_thread_data, "uart_forward");
+
+    addIPv6Address();
+    coap_init();
+
+    // Everything else is event driven; sleep instead of spinning.
+    k_sem_take(&main_sem, K_FOREVER);
+    return 0;
 }
\ No newline at end of file